@@ -0,0 +1,137 @@
+/*
+ * Cost per path of .vfignore matching: the compiled matcher in src/ignore.c
+ * (hash set + suffix trie + glob fallback) against trying every pattern in
+ * order with fnmatch(3), as a naive implementation would.
+ *
+ * The patterns avoid '**', which fnmatch cannot express, so both sides
+ * must agree on every path; the ignored counts are printed as a check.
+ *
+ * Usage: ignore_bench [paths] [rounds]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fnmatch.h>
+#include <time.h>
+
+#include "ignore.h"
+
+static const char *patterns =
+    "# Build output\n"
+    "build/\ndist/\nout/\ntarget/\nbin/\nobj/\n"
+    "node_modules\nbower_components\n.cache\n.gradle\n__pycache__\n.venv\n"
+    "*.o\n*.a\n*.so\n*.obj\n*.class\n*.pyc\n*.pyo\n*.log\n*.tmp\n*.swp\n*~\n"
+    "*.min.js\n*.map\n*.tar.gz\n.DS_Store\nThumbs.db\ncore\n"
+    "!keep.log\n"
+    "/coverage/\n/docs/_build/\nsrc/generated/*.c\nlogs/*.txt\n"
+    "test-results-[0-9]*.xml\n*.sw[a-p]\n";
+
+static const char *dirs[] = { "src", "src/core", "src/net", "include", "lib/util", "docs", "tests/unit",
+                              "build", "node_modules/left-pad", "src/generated", "logs", "coverage" };
+static const char *names[] = { "main.c", "main.o", "util.h", "app.min.js", "app.js", "README.md",
+                               "trace.log", "keep.log", "Makefile", "test-results-7.xml", "x.swp",
+                               "notes.txt", "lib.so", "data.json", "index.html", "style.css~" };
+
+// --- Naive matcher: every pattern, in order, last match wins ---
+
+struct naive_pattern {
+    char text[256];
+    int negate, dir_only, anchored;
+};
+
+static struct naive_pattern naive[128];
+static int naive_count;
+
+static void naive_compile(const char *text) {
+    const char *ptr = text;
+    while (*ptr) {
+        const char *nl = strchr(ptr, '\n');
+        size_t len = nl ? (size_t)(nl - ptr) : strlen(ptr);
+        struct naive_pattern *p = &naive[naive_count];
+        memset(p, 0, sizeof(*p));
+        char line[256];
+        snprintf(line, sizeof(line), "%.*s", (int)len, ptr);
+        ptr += len + (nl ? 1 : 0);
+        if (!line[0] || line[0] == '#') continue;
+        char *s = line;
+        if (*s == '!') { p->negate = 1; s++; }
+        size_t l = strlen(s);
+        if (l && s[l - 1] == '/') { p->dir_only = 1; s[--l] = '\0'; }
+        p->anchored = strchr(s, '/') != NULL;
+        if (*s == '/') s++;
+        snprintf(p->text, sizeof(p->text), "%s", s);
+        naive_count++;
+    }
+}
+
+static int naive_match(const char *path, int is_dir) {
+    const char *slash = strrchr(path, '/');
+    const char *name = slash ? slash + 1 : path;
+    for (int i = naive_count - 1; i >= 0; i--) {
+        const struct naive_pattern *p = &naive[i];
+        if (p->dir_only && !is_dir) continue;
+        if (fnmatch(p->text, p->anchored ? path : name, FNM_PATHNAME) == 0) return !p->negate;
+    }
+    return 0;
+}
+
+static double now_sec() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char *argv[]) {
+    int path_count = argc > 1 ? atoi(argv[1]) : 100000;
+    int rounds = argc > 2 ? atoi(argv[2]) : 5;
+    if (path_count <= 0 || rounds <= 0) {
+        fprintf(stderr, "Usage: %s [paths] [rounds]\n", argv[0]);
+        return 1;
+    }
+
+    // Synthetic worktree paths; every 8th one is a directory.
+    char **paths = malloc(sizeof(char *) * path_count);
+    int *is_dir = malloc(sizeof(int) * path_count);
+    int ndirs = sizeof(dirs) / sizeof(dirs[0]), nnames = sizeof(names) / sizeof(names[0]);
+    srand(42);
+    for (int i = 0; i < path_count; i++) {
+        char buf[256];
+        const char *dir = dirs[rand() % ndirs];
+        is_dir[i] = i % 8 == 0;
+        if (is_dir[i]) snprintf(buf, sizeof(buf), "%s/%s", dir, dirs[rand() % ndirs]);
+        else snprintf(buf, sizeof(buf), "%s/%s", dir, names[rand() % nnames]);
+        paths[i] = strdup(buf);
+    }
+
+    struct ignore_list *list = ignore_compile(patterns, strlen(patterns), "", NULL);
+    naive_compile(patterns);
+    if (!list) {
+        fprintf(stderr, "Could not compile the patterns\n");
+        return 1;
+    }
+    printf("%d patterns, %d paths, %d rounds\n", naive_count, path_count, rounds);
+
+    long ignored[2] = { 0, 0 };
+    double best[2] = { 1e9, 1e9 };
+    for (int r = 0; r < rounds; r++) {
+        for (int m = 0; m < 2; m++) {
+            long count = 0;
+            double start = now_sec();
+            for (int i = 0; i < path_count; i++)
+                count += m ? ignore_match(list, paths[i], is_dir[i]) : naive_match(paths[i], is_dir[i]);
+            double elapsed = now_sec() - start;
+            if (elapsed < best[m]) best[m] = elapsed;
+            ignored[m] = count;
+        }
+    }
+
+    printf("%-10s %10.1f ns/path  (%ld ignored)\n", "fnmatch", best[0] * 1e9 / path_count, ignored[0]);
+    printf("%-10s %10.1f ns/path  (%ld ignored)\n", "compiled", best[1] * 1e9 / path_count, ignored[1]);
+    if (ignored[0] != ignored[1]) printf("MISMATCH between the matchers\n");
+
+    ignore_free(list);
+    for (int i = 0; i < path_count; i++) free(paths[i]);
+    free(paths);
+    free(is_dir);
+    return ignored[0] != ignored[1];
+}
@@ -0,0 +1,48 @@
+#ifndef LEGACY_THREADPOOL_H
+#define LEGACY_THREADPOOL_H
+
+#include <pthread.h>
+
+/*
+ * The original single-mutex, single-queue pool that src/threadpool.c
+ * replaced. Kept only so threadpool_bench can compare against it.
+ */
+
+/* Task struct: Represents a unit of work */
+typedef struct {
+    void (*function)(void *);
+    void *argument;
+} legacy_task_t;
+
+/* Threadpool struct */
+typedef struct {
+    pthread_mutex_t lock;       // Mutex for synchronization
+    pthread_cond_t notify;      // Condition variable to wake up threads
+    pthread_t *threads;         // Array of worker threads
+    legacy_task_t *queue;   // Circular buffer for tasks
+    int thread_count;           // Number of threads
+    int queue_size;             // Max size of the queue
+    int head;                   // Queue head index
+    int tail;                   // Queue tail index
+    int count;                  // Current number of tasks in queue
+    int shutdown;               // Flag to signal shutdown
+    int started;                // Number of threads started
+} legacy_pool_t;
+
+/**
+ * @brief Creates a threadpool with the specified number of threads and queue size.
+ */
+legacy_pool_t *legacy_pool_create(int thread_count, int queue_size);
+
+/**
+ * @brief Adds a task to the threadpool.
+ * @return 0 on success, -1 on failure.
+ */
+int legacy_pool_add(legacy_pool_t *pool, void (*function)(void *), void *argument);
+
+/**
+ * @brief Destroys the threadpool, waits for all tasks to finish, and cleans up.
+ */
+int legacy_pool_destroy(legacy_pool_t *pool);
+
+#endif // LEGACY_THREADPOOL_H
@@ -0,0 +1,127 @@
+/*
+ * Tasks-per-second microbenchmark: the work-stealing pool in src/threadpool.c
+ * against the original single-mutex pool (legacy_threadpool.c).
+ *
+ *   flat:   the main thread submits every task (all go through the
+ *           shared queue / inject queue).
+ *   fanout: tasks submit their own children, like the directory walk in
+ *           tree.c (the work-stealing path).
+ *
+ * A failed add runs the task inline, as tree.c does.
+ *
+ * Usage: threadpool_bench [tasks] [max_threads]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "threadpool.h"
+#include "legacy_threadpool.h"
+
+#define QUEUE_SIZE 4096
+#define TASK_SPIN 50            // Iterations of busy work per task
+
+struct pool_ops {
+    const char *name;
+    void *(*create)(int threads, int queue_size);
+    int (*add)(void *pool, void (*function)(void *), void *argument);
+    int (*destroy)(void *pool);
+};
+
+static void *ws_create(int t, int q) { return threadpool_create(t, q); }
+static int ws_add(void *p, void (*f)(void *), void *a) { return threadpool_add(p, f, a); }
+static int ws_destroy(void *p) { return threadpool_destroy(p); }
+static void *legacy_create(int t, int q) { return legacy_pool_create(t, q); }
+static int legacy_add(void *p, void (*f)(void *), void *a) { return legacy_pool_add(p, f, a); }
+static int legacy_destroy(void *p) { return legacy_pool_destroy(p); }
+
+static const struct pool_ops pools[] = {
+    { "mutex", legacy_create, legacy_add, legacy_destroy },
+    { "steal", ws_create, ws_add, ws_destroy },
+};
+
+static const struct pool_ops *ops;
+static void *pool;
+static long completed;
+static volatile unsigned long sink;
+
+static double now_sec() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void submit(void (*function)(void *), void *argument) {
+    if (ops->add(pool, function, argument) != 0) function(argument);
+}
+
+static void do_work() {
+    unsigned long x = 0;
+    for (int i = 0; i < TASK_SPIN; i++) x = x * 31 + i;
+    sink += x;
+    __atomic_fetch_add(&completed, 1, __ATOMIC_RELEASE);
+}
+
+static void flat_task(void *arg) {
+    (void)arg;
+    do_work();
+}
+
+// The argument encodes how many tasks (including itself) this subtree holds.
+static void fanout_task(void *arg) {
+    long n = (long)arg;
+    long rest = n - 1;
+    if (rest > 0) {
+        long left = rest / 2;
+        if (left > 0) submit(fanout_task, (void *)left);
+        if (rest - left > 0) submit(fanout_task, (void *)(rest - left));
+    }
+    do_work();
+}
+
+static void wait_for(long total) {
+    struct timespec nap = { 0, 50000 };
+    while (__atomic_load_n(&completed, __ATOMIC_ACQUIRE) < total) nanosleep(&nap, NULL);
+}
+
+static double run(const struct pool_ops *which, int threads, long tasks, int fanout) {
+    ops = which;
+    pool = ops->create(threads, QUEUE_SIZE);
+    if (!pool) {
+        fprintf(stderr, "Error: could not create %s pool with %d threads\n", which->name, threads);
+        exit(1);
+    }
+    completed = 0;
+
+    double start = now_sec();
+    if (fanout) {
+        submit(fanout_task, (void *)tasks);
+    } else {
+        for (long i = 0; i < tasks; i++) submit(flat_task, NULL);
+    }
+    wait_for(tasks);
+    double elapsed = now_sec() - start;
+
+    ops->destroy(pool);
+    return tasks / elapsed;
+}
+
+int main(int argc, char **argv) {
+    long tasks = argc > 1 ? atol(argv[1]) : 200000;
+    int max_threads = argc > 2 ? atoi(argv[2]) : 64;
+
+    printf("%ld tasks per run, %d spin iterations per task\n\n", tasks, TASK_SPIN);
+    printf("%-8s %14s %14s %8s %14s %14s %8s\n",
+           "threads", "flat mutex/s", "flat steal/s", "ratio", "fanout mutex/s", "fanout steal/s", "ratio");
+    for (int threads = 1; threads <= max_threads; threads *= 2) {
+        double flat_mutex = run(&pools[0], threads, tasks, 0);
+        double flat_steal = run(&pools[1], threads, tasks, 0);
+        double fan_mutex = run(&pools[0], threads, tasks, 1);
+        double fan_steal = run(&pools[1], threads, tasks, 1);
+        printf("%-8d %14.0f %14.0f %7.2fx %14.0f %14.0f %7.2fx\n", threads,
+               flat_mutex, flat_steal, flat_steal / flat_mutex,
+               fan_mutex, fan_steal, fan_steal / fan_mutex);
+    }
+    return 0;
+}
@@ -0,0 +1,265 @@
+/*
+ * Small-file I/O the way commit does it: reading files whole, and creating
+ * objects as temporary file -> write -> close -> rename. Each is timed with
+ * one system call per step, and with the linked io_uring chains of
+ * src/blob_pipeline.c and src/database.c, a batch per submission.
+ *
+ * Files are created under <dir>/src and written to <dir>/dst; the page
+ * cache is left warm, so this measures system call overhead, not the disk.
+ *
+ * Usage: uring_bench [files] [file size] [dir]
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/stat.h>
+
+#include "uring.h"
+
+#define BATCH 32
+
+static double now_sec() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int file_count, file_size;
+static char base[256];
+static char *buffers; // BATCH buffers of file_size bytes
+
+static void src_path(int i, char *out, size_t size) {
+    snprintf(out, size, "%s/src/%02x/f%d", base, i % 256, i);
+}
+
+static void dst_path(int i, int tmp, char *out, size_t size) {
+    if (tmp) snprintf(out, size, "%s/dst/tmp_%d", base, i);
+    else snprintf(out, size, "%s/dst/%02x/o%d", base, i % 256, i);
+}
+
+static int make_dirs(const char *sub) {
+    char path[512];
+    snprintf(path, sizeof(path), "%s/%s", base, sub);
+    if (mkdir(path, 0755) != 0 && errno != EEXIST) return -1;
+    for (int d = 0; d < 256; d++) {
+        snprintf(path, sizeof(path), "%s/%s/%02x", base, sub, d);
+        if (mkdir(path, 0755) != 0 && errno != EEXIST) return -1;
+    }
+    return 0;
+}
+
+static void clear_dst() {
+    char path[512];
+    for (int i = 0; i < file_count; i++) {
+        dst_path(i, 0, path, sizeof(path));
+        unlink(path);
+    }
+}
+
+// --- Blocking ---
+
+static long read_blocking() {
+    long bytes = 0;
+    char path[512];
+    for (int i = 0; i < file_count; i++) {
+        src_path(i, path, sizeof(path));
+        int fd = open(path, O_RDONLY | O_CLOEXEC);
+        if (fd < 0) continue;
+        ssize_t n = read(fd, buffers, file_size);
+        if (n > 0) bytes += n;
+        close(fd);
+    }
+    return bytes;
+}
+
+static long write_blocking() {
+    long written = 0;
+    char tmp[512], path[512];
+    for (int i = 0; i < file_count; i++) {
+        dst_path(i, 1, tmp, sizeof(tmp));
+        dst_path(i, 0, path, sizeof(path));
+        int fd = open(tmp, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+        if (fd < 0) continue;
+        int ok = write(fd, buffers, file_size) == file_size;
+        sync_file_range(fd, 0, 0, SYNC_FILE_RANGE_WRITE);
+        close(fd);
+        if (ok && rename(tmp, path) == 0) written++;
+        else unlink(tmp);
+    }
+    return written;
+}
+
+// --- io_uring ---
+
+static long read_uring(struct uring *ring) {
+    static char paths[BATCH][512];
+    long bytes = 0;
+    for (int start = 0; start < file_count; start += BATCH) {
+        int count = file_count - start < BATCH ? file_count - start : BATCH;
+        for (int i = 0; i < count; i++) {
+            src_path(start + i, paths[i], sizeof(paths[i]));
+            struct io_uring_sqe *sqe = uring_sqe(ring);
+            sqe->opcode = IORING_OP_OPENAT;
+            sqe->fd = AT_FDCWD;
+            sqe->addr = (uintptr_t)paths[i];
+            sqe->open_flags = O_RDONLY;
+            sqe->file_index = i + 1;
+            sqe->flags = IOSQE_IO_LINK;
+            sqe->user_data = 0;
+
+            sqe = uring_sqe(ring);
+            sqe->opcode = uring_has_buffers(ring) ? IORING_OP_READ_FIXED : IORING_OP_READ;
+            sqe->fd = i;
+            sqe->addr = (uintptr_t)(buffers + (size_t)i * file_size);
+            sqe->len = file_size;
+            sqe->buf_index = 0;
+            sqe->flags = IOSQE_FIXED_FILE | IOSQE_IO_HARDLINK;
+            sqe->user_data = 1;
+
+            sqe = uring_sqe(ring);
+            sqe->opcode = IORING_OP_CLOSE;
+            sqe->file_index = i + 1;
+            sqe->user_data = 2;
+        }
+        int submitted = uring_submit(ring, count * 3);
+        for (int got = 0; got < submitted; got++) {
+            uint64_t user_data;
+            int res;
+            if (uring_complete(ring, 1, &user_data, &res) != 1) return -1;
+            if (user_data == 1 && res > 0) bytes += res;
+        }
+        if (submitted != count * 3) return -1;
+    }
+    return bytes;
+}
+
+static long write_uring(struct uring *ring) {
+    static char tmps[BATCH][512], paths[BATCH][512];
+    long written = 0;
+    for (int start = 0; start < file_count; start += BATCH) {
+        int count = file_count - start < BATCH ? file_count - start : BATCH;
+        for (int i = 0; i < count; i++) {
+            dst_path(start + i, 1, tmps[i], sizeof(tmps[i]));
+            dst_path(start + i, 0, paths[i], sizeof(paths[i]));
+            struct io_uring_sqe *sqe = uring_sqe(ring);
+            sqe->opcode = IORING_OP_OPENAT;
+            sqe->fd = AT_FDCWD;
+            sqe->addr = (uintptr_t)tmps[i];
+            sqe->len = 0644;
+            sqe->open_flags = O_WRONLY | O_CREAT | O_EXCL;
+            sqe->file_index = i + 1;
+            sqe->flags = IOSQE_IO_LINK;
+
+            sqe = uring_sqe(ring);
+            sqe->opcode = uring_has_buffers(ring) ? IORING_OP_WRITE_FIXED : IORING_OP_WRITE;
+            sqe->fd = i;
+            sqe->addr = (uintptr_t)(buffers + (size_t)i * file_size);
+            sqe->len = file_size;
+            sqe->flags = IOSQE_FIXED_FILE | IOSQE_IO_LINK;
+
+            sqe = uring_sqe(ring);
+            sqe->opcode = IORING_OP_SYNC_FILE_RANGE;
+            sqe->fd = i;
+            sqe->sync_range_flags = SYNC_FILE_RANGE_WRITE;
+            sqe->flags = IOSQE_FIXED_FILE | IOSQE_IO_LINK;
+
+            sqe = uring_sqe(ring);
+            sqe->opcode = IORING_OP_CLOSE;
+            sqe->file_index = i + 1;
+            sqe->flags = IOSQE_IO_LINK;
+
+            sqe = uring_sqe(ring);
+            sqe->opcode = IORING_OP_RENAMEAT;
+            sqe->fd = AT_FDCWD;
+            sqe->addr = (uintptr_t)tmps[i];
+            sqe->len = AT_FDCWD;
+            sqe->addr2 = (uintptr_t)paths[i];
+            sqe->user_data = 1;
+        }
+        int submitted = uring_submit(ring, count * 5);
+        for (int got = 0; got < submitted; got++) {
+            uint64_t user_data;
+            int res;
+            if (uring_complete(ring, 1, &user_data, &res) != 1) return -1;
+            if (user_data == 1 && res == 0) written++;
+        }
+        if (submitted != count * 5) return -1;
+    }
+    return written;
+}
+
+int main(int argc, char *argv[]) {
+    file_count = argc > 1 ? atoi(argv[1]) : 100000;
+    file_size = argc > 2 ? atoi(argv[2]) : 4096;
+    snprintf(base, sizeof(base), "%s", argc > 3 ? argv[3] : "/tmp/uring_bench");
+    if (file_count <= 0 || file_size <= 0) {
+        fprintf(stderr, "Usage: %s [files] [file size] [dir]\n", argv[0]);
+        return 1;
+    }
+
+    // One registered buffer covers every slot of a batch (buf_index 0).
+    struct iovec iov = { .iov_len = (size_t)BATCH * file_size };
+    buffers = aligned_alloc(4096, (iov.iov_len + 4095) & ~(size_t)4095);
+    iov.iov_base = buffers;
+    if (!buffers || (mkdir(base, 0755) != 0 && errno != EEXIST) || make_dirs("src") != 0 || make_dirs("dst") != 0) {
+        fprintf(stderr, "Could not set up %s\n", base);
+        return 1;
+    }
+    memset(buffers, 'x', iov.iov_len);
+
+    char path[512];
+    for (int i = 0; i < file_count; i++) {
+        src_path(i, path, sizeof(path));
+        struct stat st;
+        if (stat(path, &st) == 0 && st.st_size == file_size) continue;
+        int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0 || write(fd, buffers, file_size) != file_size) {
+            fprintf(stderr, "Could not create %s\n", path);
+            return 1;
+        }
+        close(fd);
+    }
+
+#ifdef VF_HAVE_IO_URING
+    struct uring *ring = uring_create(256, BATCH, &iov, 1);
+#else
+    void *ring = NULL;
+#endif
+    printf("%d files of %d bytes in %s%s\n", file_count, file_size, base,
+           ring ? "" : " (io_uring unavailable)");
+
+    double start = now_sec();
+    long bytes = read_blocking();
+    double elapsed = now_sec() - start;
+    printf("%-16s %8.2f us/file  (%ld bytes)\n", "read, blocking", elapsed * 1e6 / file_count, bytes);
+
+    clear_dst();
+    start = now_sec();
+    long written = write_blocking();
+    elapsed = now_sec() - start;
+    printf("%-16s %8.2f us/file  (%ld objects)\n", "write, blocking", elapsed * 1e6 / file_count, written);
+
+#ifdef VF_HAVE_IO_URING
+    if (ring) {
+        start = now_sec();
+        bytes = read_uring(ring);
+        elapsed = now_sec() - start;
+        printf("%-16s %8.2f us/file  (%ld bytes)\n", "read, io_uring", elapsed * 1e6 / file_count, bytes);
+
+        clear_dst();
+        start = now_sec();
+        written = write_uring(ring);
+        elapsed = now_sec() - start;
+        printf("%-16s %8.2f us/file  (%ld objects)\n", "write, io_uring", elapsed * 1e6 / file_count, written);
+        uring_destroy(ring);
+    }
+#endif
+    clear_dst();
+    free(buffers);
+    return 0;
+}
@@ -0,0 +1,71 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h> // For size_t
+
+/*
+ * Bump allocator for short-lived objects that die together: the entries of
+ * one directory while its tree is built, or the listings of a tree walk.
+ * Allocation moves a pointer through a block; nothing is freed on its own,
+ * and arena_destroy() returns every block at once.
+ *
+ * An arena is not thread safe. Whoever allocates from it must be the only
+ * one doing so at the time (memory handed out may be used anywhere).
+ */
+struct arena;
+
+/* A position to roll an arena back to; see arena_mark(). */
+struct arena_mark {
+    void *block;
+    size_t used;
+};
+
+/**
+ * @brief Creates an arena. Its first block holds the arena itself.
+ * @param block_size Size of the first block; later blocks double, up to 64 KB.
+ * @return The arena, or NULL if out of memory.
+ */
+struct arena *arena_create(size_t block_size);
+
+/**
+ * @brief Allocates 'size' bytes, aligned for any type.
+ * @return The memory, or NULL if out of memory.
+ */
+void *arena_alloc(struct arena *a, size_t size);
+
+/**
+ * @brief arena_alloc(), zeroed.
+ */
+void *arena_calloc(struct arena *a, size_t size);
+
+/**
+ * @brief Resizes the most recent allocation in place when it is the last
+ * one in its block and there is room; otherwise copies it to a new one.
+ *
+ * For arrays that grow while nothing else is allocated from the arena;
+ * the old copy is only reclaimed with the arena.
+ * @return The memory (possibly 'old'), or NULL if out of memory.
+ */
+void *arena_grow(struct arena *a, void *old, size_t old_size, size_t new_size);
+
+char *arena_strdup(struct arena *a, const char *s);
+char *arena_strndup(struct arena *a, const char *s, size_t n);
+
+/**
+ * @brief Records the current position, for arena_reset().
+ */
+struct arena_mark arena_mark(const struct arena *a);
+
+/**
+ * @brief Releases everything allocated since 'mark' was taken.
+ *
+ * Marks must be reset in the reverse order they were taken (stack order).
+ */
+void arena_reset(struct arena *a, struct arena_mark mark);
+
+/**
+ * @brief Frees every block, and with it everything allocated from the arena.
+ */
+void arena_destroy(struct arena *a);
+
+#endif // ARENA_H
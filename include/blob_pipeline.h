@@ -0,0 +1,82 @@
+#ifndef BLOB_PIPELINE_H
+#define BLOB_PIPELINE_H
+
+#include <stddef.h> // For size_t
+#include <openssl/sha.h> // For SHA_DIGEST_LENGTH
+
+/*
+ * Blob ingestion for commit, as three stages with their own threads and
+ * bounded queues in between:
+ *   read          reads each file whole, in one large read,
+ *   hash+deflate  hashes it and, unless the object is stored, deflates it,
+ *   write         creates the object files, a batch at a time.
+ * A stage that cannot keep up fills its input queue, which blocks the
+ * stage before it and, in the end, whoever submits files.
+ *
+ * Stage sizes come from the config (pipeline.readers, pipeline.compressors,
+ * pipeline.writers); network file systems want more readers than NVMe.
+ *
+ * Where the kernel supports it, each reader and writer drives its own
+ * io_uring ring: a batch of files is opened, read and closed in one
+ * submission, and a batch of objects created the same way (see
+ * write_compressed_objects()). pipeline.iouring=false, or VF_IO_URING=0
+ * in the environment, keeps them on plain system calls.
+ */
+#define BLOB_PIPELINE_READERS_KEY "pipeline.readers"
+#define BLOB_PIPELINE_COMPRESSORS_KEY "pipeline.compressors"
+#define BLOB_PIPELINE_WRITERS_KEY "pipeline.writers"
+#define BLOB_PIPELINE_IOURING_KEY "pipeline.iouring"
+
+enum blob_stage {
+    BLOB_STAGE_READ,
+    BLOB_STAGE_COMPRESS,
+    BLOB_STAGE_WRITE,
+    BLOB_STAGE_COUNT
+};
+
+struct blob_stage_stats {
+    const char *name;
+    int threads;
+    long items;
+    double busy;                // Fraction of the stage's thread time spent working
+    double blocked;             // Fraction spent waiting for room in the next queue
+    int uring;                  // Threads that ran on an io_uring ring
+};
+
+/* Called once per submitted file, on a pipeline thread; sha1 is set when result is 0. */
+typedef void (*blob_done_fn)(void *arg, int result, const unsigned char *sha1);
+
+struct blob_pipeline;
+
+/**
+ * @brief Starts the stage threads.
+ * @return The pipeline, or NULL if its threads could not be started.
+ */
+struct blob_pipeline *blob_pipeline_start();
+
+/**
+ * @brief Queues a file to be stored as a blob; waits while the read queue is full.
+ *
+ * Meant for small files: each one is held in memory whole while it
+ * moves between stages.
+ * @param size The file size from stat().
+ * @return 0 if queued ('done' will be called), -1 otherwise.
+ */
+int blob_pipeline_submit(struct blob_pipeline *p, const char *filepath, size_t size,
+                         blob_done_fn done, void *arg);
+
+/**
+ * @brief Drains every stage, stops the threads and frees the pipeline.
+ *
+ * Every 'done' callback has run when this returns. The stage statistics
+ * are kept for blob_pipeline_stats().
+ */
+void blob_pipeline_finish(struct blob_pipeline *p);
+
+/**
+ * @brief Reports the stages of the last finished pipeline.
+ * @return 1 if one ran and stored anything, 0 otherwise.
+ */
+int blob_pipeline_stats(struct blob_stage_stats out[BLOB_STAGE_COUNT]);
+
+#endif // BLOB_PIPELINE_H
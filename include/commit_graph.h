@@ -0,0 +1,82 @@
+#ifndef COMMIT_GRAPH_H
+#define COMMIT_GRAPH_H
+
+#include <stdint.h>
+
+#define COMMIT_GRAPH_FILE ".minivcs/objects/info/commit-graph"
+
+#define COMMIT_GRAPH_MAX_PARENTS 16
+
+/*
+ * The commit graph: every known commit's SHA-1, root tree, parents, commit
+ * time and generation number in one sorted table, mmap'd and binary
+ * searched. History walks follow it without inflating commit objects.
+ *
+ * The generation number of a root commit is 1, and of any other commit one
+ * more than the highest of its parents': a commit can only be an ancestor of
+ * commits with a higher generation. Commits never change, so the file is
+ * only ever extended.
+ *
+ * The loaded graph is per process and not thread safe.
+ */
+struct commit_graph;
+
+/* One commit, decoded from the table */
+struct commit_graph_entry {
+    const unsigned char *sha1;      // SHA_DIGEST_LENGTH bytes, inside the mapping
+    const unsigned char *tree;
+    uint32_t generation;
+    uint64_t time;                  // Committer time, seconds since the epoch
+    int parent_count;
+    uint32_t parents[COMMIT_GRAPH_MAX_PARENTS]; // Positions in the graph
+};
+
+/**
+ * @brief Returns the graph, mapping the file on first use.
+ * @return The graph, or NULL if there is none (or it is invalid).
+ */
+struct commit_graph *commit_graph_get();
+
+/**
+ * @brief Finds a commit's position by binary search.
+ * @return 0 with 'pos' set, or -1 if the commit is not in the graph.
+ */
+int commit_graph_find(const struct commit_graph *graph, const unsigned char *sha1, uint32_t *pos);
+
+/**
+ * @brief Decodes the commit at 'pos'.
+ * @return 0, or -1 if 'pos' or the record is out of range.
+ */
+int commit_graph_entry(const struct commit_graph *graph, uint32_t pos, struct commit_graph_entry *out);
+
+/**
+ * @brief The SHA-1 of the commit at 'pos', which must be in range (any
+ * position from commit_graph_find() or a decoded entry's parents is).
+ */
+const unsigned char *commit_graph_sha1(const struct commit_graph *graph, uint32_t pos);
+
+/**
+ * @brief Adds 'tip_hash' and whichever of its ancestors are missing, reading
+ * only those commit objects, and rewrites the file.
+ *
+ * Positions taken from an earlier commit_graph_get() are invalid afterwards.
+ * @return 0 (also when there was nothing to add), or -1 if a commit could not
+ * be read or the file not written.
+ */
+int commit_graph_update(const char *tip_hash);
+
+/**
+ * @brief Finds a commit, adding it (and its history) first if it is missing.
+ * @return The graph with 'pos' set, or NULL if the commit cannot be added.
+ */
+struct commit_graph *commit_graph_lookup(const char *hash, uint32_t *pos);
+
+/**
+ * @brief Checks whether 'ancestor' is reachable from 'descendant' (a commit is
+ * its own ancestor). Commits with a lower generation than 'ancestor' are
+ * never searched past.
+ * @return 1 if it is, 0 if not, -1 if either commit is not available.
+ */
+int commit_graph_is_ancestor(const char *ancestor, const char *descendant);
+
+#endif // COMMIT_GRAPH_H
@@ -1,6 +1,8 @@
 #ifndef CONFIG_H
 #define CONFIG_H
 
+#include <stddef.h> // For size_t
+
 // Set a global config value (e.g., user.name "John")
 int do_config(const char *key, const char *value);
 
@@ -8,4 +10,8 @@ int do_config(const char *key, const char *value);
 // buffer should be large enough (e.g., 256 bytes).
 int get_config_value(const char *key, char *buffer, size_t size);
 
+// Get a size in bytes (e.g., "64m"). Accepts k/m/g suffixes.
+// Returns default_value if the key is missing or not a valid size.
+size_t get_config_size(const char *key, size_t default_value);
+
 #endif
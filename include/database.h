@@ -7,10 +7,13 @@
 /**
  * @brief Creates a version forge object and saves it to the object store.
  *
+ * Objects that already exist are not compressed or written again. New
+ * objects go to a temporary file that is renamed into place.
+ *
  * @param data The raw data to store.
  * @param len The length of the data.
  * @param type The type of object ("blob", "tree", "commit").
- * @param out_sha1_hex A buffer (at least 41 chars) to store the resulting hex SHA-1.
+ * @param out_sha1_hex A buffer (at least 41 chars) to store the resulting hex SHA-1. Can be NULL.
  * @param out_sha1_binary A buffer (at least SHA_DIGEST_LENGTH chars) to 
  * store the resulting binary SHA-1. Can be NULL.
  * @return 0 on success, -1 on failure.
@@ -18,9 +21,137 @@
 int write_object(const void *data, size_t len, const char *type, 
                  char *out_sha1_hex, unsigned char *out_sha1_binary);
 
+/* Bytes of compressed output (and file input) buffered per streamed object */
+#define OBJECT_STREAM_CHUNK (64 * 1024)
+
+/* Streaming object writer; see object_writer_open(). */
+struct object_writer;
+
+/**
+ * @brief Starts writing an object whose payload arrives in pieces.
+ *
+ * The payload is hashed and deflated as it arrives and goes straight to a
+ * temporary file, so memory use does not depend on the object size.
+ *
+ * @param type The type of object ("blob", "tree", "commit").
+ * @param len The exact payload size (it is part of the object header).
+ * @return A writer, or NULL on failure.
+ */
+struct object_writer *object_writer_open(const char *type, size_t len);
+
+/**
+ * @brief Feeds the next piece of the payload.
+ * @return 0 on success, -1 on failure (the writer must then be aborted).
+ */
+int object_writer_update(struct object_writer *w, const void *data, size_t len);
+
+/**
+ * @brief Completes the object and renames it into the object store. Frees the writer.
+ *
+ * Fails if fewer bytes than announced to object_writer_open() were fed.
+ * @return 0 on success, -1 on failure.
+ */
+int object_writer_finish(struct object_writer *w, char *out_sha1_hex, unsigned char *out_sha1_binary);
+
+/**
+ * @brief Discards a writer and its temporary file.
+ */
+void object_writer_abort(struct object_writer *w);
+
+/**
+ * @brief Stores a file as a blob, streaming it in OBJECT_STREAM_CHUNK pieces.
+ *
+ * @param len The file size from stat(); the write fails if the file changes size.
+ * @return 0 on success, -1 on failure.
+ */
+int write_object_from_file(const char *filepath, size_t len,
+                           char *out_sha1_hex, unsigned char *out_sha1_binary);
+
+/**
+ * @brief Stores an object that was already deflated in loose form
+ * (zlib stream of "type size\0data") under its SHA-1.
+ *
+ * The caller vouches for the SHA; nothing is inflated to check it.
+ * @return 0 on success (also when the object turns out to exist), -1 on failure.
+ */
+int write_compressed_object(const unsigned char *sha1, const void *data, size_t len);
+
+/**
+ * @brief Checks whether the object is stored, loose or in a pack.
+ */
+int has_object(const unsigned char *sha1);
+
+/**
+ * @brief Reports objects stored by this process and writes skipped because
+ * the object already existed.
+ */
+void object_write_stats(long *written, long *skipped);
+
+struct uring;
+
+/* One object for write_compressed_objects() */
+struct object_write {
+    const unsigned char *sha1;
+    const void *data;           // Deflated loose-object bytes
+    size_t len;
+    int buf_index;              // Registered buffer of the ring holding 'data', or -1
+    int result;                 // 0 or -1, set by write_compressed_objects()
+};
+
+/**
+ * @brief write_compressed_object() for a batch.
+ *
+ * With a ring, every object's create, write, writeback start, close and
+ * rename go out as one linked chain, and the whole batch is submitted
+ * with one system call. An object whose chain fails is retried on the
+ * blocking path. With 'ring' NULL, the objects are written one by one.
+ *
+ * @param ring The calling thread's ring (at least 'count' direct descriptor
+ *        slots and 5 * 'count' entries), or NULL.
+ * @return 0 if every object was stored, -1 otherwise (see each 'result').
+ */
+int write_compressed_objects(struct uring *ring, struct object_write *objects, int count);
+
+/**
+ * @brief Counts a write skipped because the object already existed, for
+ * callers that checked has_object() themselves.
+ */
+void note_object_skipped();
+
+/**
+ * @brief Flushes every object written since the last call, then their
+ * directories, to disk.
+ *
+ * Writes do not fsync individually; call this once before publishing
+ * anything (e.g., a ref) that points at the new objects.
+ * @return 0 on success, -1 if any flush failed.
+ */
+int sync_written_objects();
+
+/**
+ * @brief Computes the SHA-1 an object would have, without storing anything.
+ *
+ * @param out_sha1_binary A buffer (at least SHA_DIGEST_LENGTH chars).
+ * @return 0 on success, -1 on failure.
+ */
+int hash_object(const void *data, size_t len, const char *type, unsigned char *out_sha1_binary);
+
+/**
+ * @brief Computes a file's blob SHA-1 without storing anything.
+ *
+ * The file is read in OBJECT_STREAM_CHUNK pieces; nothing is compressed.
+ * @param len The file size from stat(); fails if the file changes size.
+ * @return 0 on success, -1 on failure.
+ */
+int hash_object_from_file(const char *filepath, size_t len, unsigned char *out_sha1_binary);
+
 /**
  * @brief Reads and decompresses an object from the store.
  *
+ * Only the header is inflated before the payload buffer is allocated, so
+ * the buffer has the exact size and the payload is inflated straight into
+ * it. out_data is NUL-terminated (the terminator is not counted in out_size).
+ *
  * @param hash The 40-char hex SHA-1 of the object.
  * @param out_type A pointer to store the object type (e.g., "blob"). MALLOC'D.
  * @param out_data A pointer to store the raw object data. MALLOC'D.
@@ -29,5 +160,32 @@ int write_object(const void *data, size_t len, const char *type,
  */
 int read_object(const char *hash, char **out_type, char **out_data, size_t *out_size);
 
+/* Buffer size for the type names returned by read_object_header() and read_object_typed() */
+#define OBJECT_TYPE_MAX 16
+
+/**
+ * @brief read_object() with the type name written to 'out_type' (at least
+ * OBJECT_TYPE_MAX chars) instead of allocated; only out_data is MALLOC'D.
+ */
+int read_object_typed(const char *hash, char *out_type, char **out_data, size_t *out_size);
+
+/**
+ * @brief Returns an object's type and size without inflating its payload.
+ *
+ * @param out_type A buffer (at least OBJECT_TYPE_MAX chars) for the type name.
+ * @param out_size A pointer to store the payload size.
+ * @return 0 on success, -1 if the object is missing or corrupt.
+ */
+int read_object_header(const char *hash, char *out_type, size_t *out_size);
+
+/**
+ * @brief Returns an object in loose-file form (zlib stream of "type size\0data"),
+ * whether it is stored loose or in a pack. Used to ship objects over the network.
+ *
+ * @param out_data A pointer to store the compressed bytes. MALLOC'D.
+ * @return 0 on success, -1 on failure.
+ */
+int read_object_loose_bytes(const char *hash, unsigned char **out_data, size_t *out_size);
+
 
 #endif // DATABASE_H
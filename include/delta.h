@@ -0,0 +1,35 @@
+#ifndef DELTA_H
+#define DELTA_H
+
+#include <stddef.h> // For size_t
+
+/*
+ * Delta format: varint source size | varint target size | instructions...
+ *
+ *   copy:   1xxxxxxx [offset bytes] [size bytes]
+ *           bits 0-3 select which of the 4 little-endian offset bytes follow,
+ *           bits 4-6 which of the 3 size bytes follow (size 0 means 0x10000).
+ *   insert: 0nnnnnnn followed by n (1..127) literal bytes.
+ */
+
+/**
+ * @brief Encodes 'target' as copy/insert instructions against 'source'.
+ *
+ * @param max_delta_size Give up once the delta would exceed this many bytes (0 = no limit).
+ * @param out_size Receives the delta length.
+ * @return A MALLOC'D delta, or NULL if none smaller than the limit was found.
+ */
+void *create_delta(const void *source, size_t source_size,
+                   const void *target, size_t target_size,
+                   size_t max_delta_size, size_t *out_size);
+
+/**
+ * @brief Rebuilds the target of a delta.
+ *
+ * @param out_size Receives the target length.
+ * @return A MALLOC'D, NUL-terminated target buffer, or NULL if the delta is corrupt.
+ */
+void *apply_delta(const void *source, size_t source_size,
+                  const void *delta, size_t delta_size, size_t *out_size);
+
+#endif // DELTA_H
@@ -0,0 +1,62 @@
+#ifndef DIFF_H
+#define DIFF_H
+
+#include <openssl/sha.h> // For SHA_DIGEST_LENGTH
+#include "index.h"
+
+/* Kinds of change reported by the diff engine */
+#define DIFF_ADDED 'A'
+#define DIFF_MODIFIED 'M'
+#define DIFF_DELETED 'D'
+
+/**
+ * @brief Called once per changed file, in path order.
+ *
+ * @param change DIFF_ADDED, DIFF_MODIFIED or DIFF_DELETED.
+ * @param path The worktree-relative path, e.g. "src/main.c".
+ * @param old_sha1 The blob on the old side (NULL when added).
+ * @param new_sha1 The blob on the new side (NULL when deleted).
+ */
+typedef void (*diff_callback)(char change, const char *path, const unsigned char *old_sha1,
+                              const unsigned char *new_sha1, void *data);
+
+/**
+ * @brief Restricts a diff to part of the tree (e.g., a sparse-checkout cone).
+ *
+ * @param is_dir Whether 'path' is a directory on the side being checked.
+ * @return 0 to leave 'path' out; for a directory, nothing under it is read.
+ */
+typedef int (*diff_filter)(const char *path, int is_dir, void *data);
+
+/**
+ * @brief Compares two stored trees file by file.
+ *
+ * Both trees are walked in lockstep; a subtree with the same SHA on both
+ * sides is skipped without being read, so the cost follows the size of
+ * the change rather than the size of the trees. A path that is a file on
+ * one side and a directory on the other is reported as a deletion plus
+ * additions.
+ *
+ * @param old_tree_hex The old tree, or NULL for the empty tree.
+ * @param new_tree_hex The new tree, or NULL for the empty tree.
+ * @param filter Paths to consider, or NULL for all. Receives 'data' too.
+ * @return 0 on success, -1 if a tree could not be read.
+ */
+int diff_trees(const char *old_tree_hex, const char *new_tree_hex, diff_filter filter,
+               diff_callback fn, void *data);
+
+/**
+ * @brief Compares a stored tree with the files and cache-tree of an index.
+ *
+ * 'idx' is usually the index just refreshed by write_tree_indexed() or
+ * hash_tree_indexed(), so it describes the working tree: a directory whose
+ * cache-tree SHA matches the stored subtree is skipped.
+ *
+ * @param tree_hex The old tree, or NULL for the empty tree.
+ * @param filter Paths to consider, or NULL for all. Receives 'data' too.
+ * @return 0 on success, -1 if a tree could not be read.
+ */
+int diff_tree_to_index(const char *tree_hex, struct index *idx, diff_filter filter,
+                       diff_callback fn, void *data);
+
+#endif // DIFF_H
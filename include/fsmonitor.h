@@ -0,0 +1,49 @@
+#ifndef FSMONITOR_H
+#define FSMONITOR_H
+
+/*
+ * File system monitor. `version_forge fsmonitor start` runs a daemon that
+ * keeps inotify watches on every worktree directory and numbers each
+ * change it sees. A token ("<instance>:<sequence>") names a point in that
+ * numbering; asking the daemon for the changes since a token returns the
+ * paths touched since then and a fresh token.
+ *
+ * A reported path stands for itself and everything below it (a new or
+ * renamed directory is reported once). When the daemon cannot answer
+ * exactly (another instance issued the token, the kernel queue overflowed,
+ * too many paths changed), it asks for a full scan instead.
+ */
+#define FSMONITOR_SOCKET ".minivcs/fsmonitor.sock"
+
+/* Stop remembering individual paths beyond this; older tokens get a full scan. */
+#define FSMONITOR_MAX_CHANGES 100000
+
+struct fsmonitor_changes {
+    char *token;                // Token to store with the refreshed index
+    int full_scan;              // The daemon could not answer for the old token
+    char **paths;               // Sorted worktree-relative paths (when !full_scan)
+    int count;
+    char *data;                 // The reply the strings point into
+};
+
+/**
+ * @brief Handles `fsmonitor start|stop|status|run` (run stays in the foreground).
+ */
+int do_fsmonitor(const char *action);
+
+/**
+ * @brief Asks the daemon what changed since 'token' (NULL for a first query).
+ * @return The answer, or NULL if no daemon is running.
+ */
+struct fsmonitor_changes *fsmonitor_query(const char *token);
+
+/**
+ * @brief Checks whether anything at, below or above 'path' was reported.
+ *
+ * A directory for which this returns 0 is unchanged since the token.
+ */
+int fsmonitor_is_dirty(const struct fsmonitor_changes *changes, const char *path);
+
+void fsmonitor_free(struct fsmonitor_changes *changes);
+
+#endif // FSMONITOR_H
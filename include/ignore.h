@@ -0,0 +1,58 @@
+#ifndef IGNORE_H
+#define IGNORE_H
+
+#include <stddef.h> // For size_t
+
+/*
+ * Ignore rules. Any directory may hold a .vfignore file with gitignore-style
+ * patterns, relative to that directory:
+ *   - blank lines and lines starting with '#' are skipped ("\#" for a '#'),
+ *   - a leading '!' re-includes what an earlier pattern ignored,
+ *   - a trailing '/' only matches directories,
+ *   - a pattern with a '/' at the start or in the middle is matched against
+ *     the path below the .vfignore directory; one without is matched
+ *     against the name at any depth,
+ *   - '*', '?' and '[...]' do not match '/'; '**' does.
+ * The last matching pattern wins, and a deeper .vfignore wins over its
+ * ancestors. An ignored directory is never descended into, so nothing
+ * inside it can be re-included.
+ */
+#define IGNORE_FILE ".vfignore"
+
+/* The compiled patterns of one .vfignore file, chained to its ancestors'. */
+struct ignore_list;
+
+/**
+ * @brief Compiles the patterns of a .vfignore file.
+ *
+ * Literal names go into a hash set, "*<suffix>" patterns into a suffix
+ * trie; only the rest are matched as globs.
+ *
+ * @param rel_dir The worktree-relative directory holding the file ("" for the root).
+ * @param parent The nearest ancestor list, consulted when no pattern here matches.
+ * @return The list, or NULL if there are no patterns (use 'parent' instead).
+ */
+struct ignore_list *ignore_compile(const char *text, size_t size, const char *rel_dir,
+                                   const struct ignore_list *parent);
+
+/**
+ * @brief ignore_compile() on the .vfignore in the open directory 'dir_fd'; NULL if there is none.
+ */
+struct ignore_list *ignore_load(int dir_fd, const char *rel_dir, const struct ignore_list *parent);
+
+/**
+ * @brief Checks whether a path is ignored.
+ *
+ * @param list The list of the path's directory (or its nearest ancestor with one); NULL ignores nothing.
+ * @param rel_path The worktree-relative path, e.g. "build/out.o".
+ * @param is_dir Whether the path is a directory.
+ * @return 1 if ignored, 0 otherwise.
+ */
+int ignore_match(const struct ignore_list *list, const char *rel_path, int is_dir);
+
+/**
+ * @brief Frees one list (not its ancestors).
+ */
+void ignore_free(struct ignore_list *list);
+
+#endif // IGNORE_H
@@ -0,0 +1,178 @@
+#ifndef INDEX_H
+#define INDEX_H
+
+#include <stddef.h> // For size_t
+#include <stdint.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <openssl/sha.h> // For SHA_DIGEST_LENGTH
+
+#define INDEX_FILE ".minivcs/index"
+#define INDEX_LOCK_FILE ".minivcs/index.lock"
+
+/* index_entry.flags: the blob is known to be in the object store. Entries
+ * recorded by a hash-only walk (status) lack it until a commit stores them. */
+#define INDEX_ENTRY_STORED 0x0001
+/* In memory only: dropped by index_remove_path(), purged on the next sort. */
+#define INDEX_ENTRY_REMOVED 0x8000
+
+/* One cached file: the stat data we saw when we last hashed it, plus its blob SHA. */
+struct index_entry {
+    uint32_t ctime_sec;
+    uint32_t ctime_nsec;
+    uint32_t mtime_sec;
+    uint32_t mtime_nsec;
+    uint64_t ino;
+    uint64_t size;
+    uint32_t mode;
+    uint16_t flags;
+    unsigned char sha1[SHA_DIGEST_LENGTH];
+    char *path;                 // Relative to the worktree root, e.g. "src/main.c"
+};
+
+/* A directory's tree as of the last walk: valid while nothing beneath it changed. */
+struct cache_tree_entry {
+    uint32_t entry_count;       // Entries in the tree object (direct children)
+    int stored;                 // The tree object (and so everything under it) is stored
+    int removed;                // Invalidated; purged on the next sort
+    unsigned char sha1[SHA_DIGEST_LENGTH];
+    char *path;                 // Worktree-relative directory, "" for the root
+};
+
+/*
+ * The stat cache. The previous index is kept mmap'd read-only and is only
+ * consulted; the entries seen during the current walk are collected into a
+ * fresh list, which replaces the file on index_write().
+ */
+struct index {
+    void *map;                  // mmap of .minivcs/index (NULL if none)
+    size_t map_size;
+    const unsigned char **records; // Sorted pointers into the map
+    int record_count;
+    const unsigned char **tree_records; // Sorted cache-tree records in the map
+    int tree_record_count;
+    uint32_t stamp_sec;         // mtime of the index file when loaded
+    uint32_t stamp_nsec;
+
+    pthread_mutex_t lock;       // Guards the fields below
+    struct index_entry *entries;
+    int count;
+    int capacity;
+    struct cache_tree_entry *trees;
+    int tree_count;
+    int tree_capacity;
+    int sorted;                 // entries and trees are in path order
+    int purge;                  // Some entries or trees are marked removed
+
+    long hits;                  // Files taken from the cache
+    long misses;                // Files that had to be reopened and hashed
+    long trees_reused;          // Directories whose cached tree SHA was reused
+    long trees_rebuilt;         // Directories whose tree was serialized and hashed again
+
+    char *fsmonitor_token;      // fsmonitor token the loaded entries are valid as of, or NULL
+    char *fsmonitor_next;       // Token index_write() records (set by the walk), or NULL
+    long fsmonitor_dirty;       // Paths the monitor reported for the walk, -1 if it was not used
+};
+
+/**
+ * @brief Loads .minivcs/index. A missing or corrupt file yields an empty index.
+ * @return A new index, or NULL on allocation failure.
+ */
+struct index *index_load();
+
+/**
+ * @brief Looks up a path and checks whether its stat data is unchanged.
+ *
+ * @param path The worktree-relative path.
+ * @param st Fresh stat data for the path.
+ * @param out_entry Filled with the cached entry (path not set) on a match.
+ * @return 1 if the cached SHA can be reused, 0 otherwise.
+ */
+int index_lookup(struct index *idx, const char *path, const struct stat *st,
+                 struct index_entry *out_entry);
+
+/**
+ * @brief Records a path for the next index. Thread-safe.
+ * @param flags INDEX_ENTRY_* bits to persist with the entry.
+ */
+int index_add(struct index *idx, const char *path, const struct stat *st,
+              const unsigned char *sha1, uint16_t flags);
+
+/**
+ * @brief Looks up the cached tree of a directory.
+ *
+ * Only call this for a directory whose files were all stat cache hits and
+ * whose subdirectories were all reused; the entry count catches deletions.
+ *
+ * @param path The worktree-relative directory ("" for the root).
+ * @param entry_count The number of entries the directory has now.
+ * @param out_sha1 Receives the tree SHA on a match.
+ * @param out_stored Receives whether the tree object was stored when recorded.
+ * @return 1 if the cached tree SHA is still valid, 0 otherwise.
+ */
+int cache_tree_lookup(struct index *idx, const char *path, uint32_t entry_count,
+                      unsigned char *out_sha1, int *out_stored);
+
+/**
+ * @brief Records a directory's tree for the next index. Thread-safe.
+ * @param stored Whether the tree object is in the object store.
+ */
+int cache_tree_add(struct index *idx, const char *path, uint32_t entry_count,
+                   const unsigned char *sha1, int stored);
+
+/**
+ * @brief Looks up a directory's cached tree, whatever its entry count.
+ *
+ * For a directory a file system monitor reports untouched since the index
+ * was written, so nothing beneath it needs to be checked.
+ *
+ * @return 1 if the directory has a cache-tree entry, 0 otherwise.
+ */
+int cache_tree_peek(struct index *idx, const char *path, unsigned char *out_sha1, int *out_stored);
+
+/**
+ * @brief Carries a directory over from the previous index unchanged.
+ *
+ * Copies the directory's cache-tree entry and every entry and cache-tree
+ * below it into the next index, without a single stat call. Use after
+ * cache_tree_peek() succeeded. Thread-safe.
+ *
+ * @param path The worktree-relative directory ("" for the root).
+ * @param stored Record the directory's tree as stored.
+ * @return The number of file entries kept, or -1 on failure.
+ */
+int index_keep_dir(struct index *idx, const char *path, int stored);
+
+/**
+ * @brief Sets the fsmonitor token index_write() records (NULL records none).
+ *
+ * The token loaded with the index is kept for later queries: the mapped
+ * entries are only valid as of that one.
+ */
+int index_set_fsmonitor_token(struct index *idx, const char *token);
+
+/**
+ * @brief Drops a path's entry and the cache-tree of every directory above it.
+ *
+ * For callers that change files behind a walk's back (e.g., checkout): a
+ * fresh entry can then be added with index_add(). Removing many paths
+ * before adding any keeps this to a single sort.
+ */
+void index_remove_path(struct index *idx, const char *path);
+
+/**
+ * @brief Sorts the entries and cache-tree entries added so far by path.
+ *
+ * index_write() does this too; afterwards both arrays can be binary searched.
+ */
+void index_sort(struct index *idx);
+
+/**
+ * @brief Atomically replaces .minivcs/index with the entries added so far.
+ * @return 0 on success, -1 on failure.
+ */
+int index_write(struct index *idx);
+
+void index_free(struct index *idx);
+
+#endif // INDEX_H
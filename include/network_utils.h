@@ -1,14 +1,23 @@
 #ifndef NETWORK_UTILS_H
 #define NETWORK_UTILS_H
 
+#include <stddef.h> // For size_t
+
 /**
- * @brief Sends a specific object file over the socket.
+ * @brief Sends one object's compressed bytes over the socket.
  * Follows protocol: Header -> Wait ACK -> Content -> Wait Saved.
  */
-void send_object_file(int sock, const char *filepath, const char *filename);
+void send_object_data(int sock, const char *hash, const unsigned char *content, size_t size);
+
+/**
+ * @brief Sends a specific loose object file over the socket.
+ * @param hash The full 40-char hex SHA-1 of the object.
+ */
+void send_object_file(int sock, const char *filepath, const char *hash);
 
 /**
- * @brief Recursively scans a directory and sends all object files found.
+ * @brief Sends every object in the store: loose objects under the fanout
+ * directories of 'base_path', then every packed object in loose form.
  */
 void scan_and_send(int sock, const char *base_path);
 
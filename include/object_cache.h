@@ -0,0 +1,69 @@
+#ifndef OBJECT_CACHE_H
+#define OBJECT_CACHE_H
+
+#include <stddef.h> // For size_t
+#include <openssl/sha.h> // For SHA_DIGEST_LENGTH
+
+#include "database.h" // For OBJECT_TYPE_MAX
+
+/* Config key holding the cache's byte budget (k/m/g suffixes allowed) */
+#define OBJECT_CACHE_LIMIT_KEY "core.objectcachelimit"
+#define OBJECT_CACHE_DEFAULT_LIMIT (64 * 1024 * 1024)
+
+/*
+ * A decoded object shared between all callers that asked for it.
+ * The data is read-only: callers must not modify it.
+ */
+struct cached_object {
+    unsigned char sha1[SHA_DIGEST_LENGTH];
+    char type[OBJECT_TYPE_MAX];
+    const char *data;               // NUL-terminated payload
+    size_t size;
+
+    // Owned by the cache
+    int refs;                       // Callers holding it, plus one while cached
+    int cached;                     // Still reachable from the hash table
+    struct cached_object *hash_next;
+    struct cached_object *lru_prev;
+    struct cached_object *lru_next;
+};
+
+/**
+ * @brief Returns the object, reading it through read_object() on a miss.
+ *
+ * Thread-safe. The returned object stays valid until it is passed to
+ * object_cache_release(), even if the cache evicts it meanwhile.
+ *
+ * @param hash The 40-char hex SHA-1.
+ * @return A referenced object, or NULL if it cannot be read.
+ */
+struct cached_object *object_cache_get(const char *hash);
+
+/**
+ * @brief Returns the object only if it is in the cache; never reads it.
+ */
+struct cached_object *object_cache_peek(const char *hash);
+
+/**
+ * @brief Reads the object into a private copy that is never cached; it is
+ * freed by its last object_cache_release().
+ */
+struct cached_object *object_cache_read(const char *hash);
+
+/**
+ * @brief Takes another reference on an object.
+ */
+void object_cache_retain(struct cached_object *obj);
+
+/**
+ * @brief Drops a reference taken by object_cache_get() (or the other
+ * functions here). NULL is ignored.
+ */
+void object_cache_release(struct cached_object *obj);
+
+/**
+ * @brief Reports lookups served from memory and lookups that had to read the object.
+ */
+void object_cache_stats(long *hits, long *misses);
+
+#endif // OBJECT_CACHE_H
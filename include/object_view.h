@@ -0,0 +1,114 @@
+#ifndef OBJECT_VIEW_H
+#define OBJECT_VIEW_H
+
+#include <stddef.h> // For size_t
+#include <openssl/sha.h> // For SHA_DIGEST_LENGTH
+
+/*
+ * Read-only access to decoded objects. A view is a reference to the
+ * object's one decompressed buffer (normally the object cache's copy):
+ * nothing is copied out of it, and nothing may write to it. Trees and
+ * commits are parsed in place into slices that point into the buffer and
+ * stay valid for as long as the view is held.
+ */
+struct object_view;
+
+/* Bytes inside a view; not NUL-terminated unless stated otherwise. */
+struct object_slice {
+    const char *ptr;
+    size_t len;
+};
+
+/**
+ * @brief Returns a view of the object, through the object cache.
+ * @param hash The 40-char hex SHA-1.
+ * @return A referenced view, or NULL if the object cannot be read.
+ */
+struct object_view *object_view_open(const char *hash);
+
+/**
+ * @brief object_view_open() for a hash that may name the wrong kind of
+ * object (user input): unless the object is cached already, its header
+ * is checked before the payload is inflated.
+ * @return The view, or NULL if unreadable or not of type 'type'.
+ */
+struct object_view *object_view_open_as(const char *hash, const char *type);
+
+/**
+ * @brief A view that bypasses the cache, for objects read once (blobs being
+ * written out) that would only push trees and commits out of it.
+ */
+struct object_view *object_view_read(const char *hash);
+
+/**
+ * @brief Takes another reference.
+ */
+struct object_view *object_view_retain(struct object_view *view);
+
+/**
+ * @brief Drops a reference. NULL is ignored.
+ */
+void object_view_release(struct object_view *view);
+
+const char *object_view_type(const struct object_view *view);
+const unsigned char *object_view_sha1(const struct object_view *view);
+/* The payload; a NUL follows it, but it may contain NULs itself. */
+const char *object_view_data(const struct object_view *view);
+size_t object_view_size(const struct object_view *view);
+
+/**
+ * @brief Copies a slice into 'out' as a C string, truncating to 'size' - 1 bytes.
+ * @return 'out'.
+ */
+char *object_slice_copy(struct object_slice slice, char *out, size_t size);
+
+// --- Trees ---
+
+struct tree_entry_view {
+    struct object_slice mode;           // e.g. "100644"
+    struct object_slice name;           // NUL-terminated in the buffer: name.ptr is a C string
+    const unsigned char *sha1;          // SHA_DIGEST_LENGTH bytes
+    int is_dir;
+};
+
+/* Walks the entries of a tree in stored (sorted) order. */
+struct tree_iter {
+    const char *ptr;
+    const char *end;
+};
+
+/**
+ * @brief Starts at the first entry.
+ * @return 0, or -1 if the view is not a tree.
+ */
+int tree_iter_init(struct tree_iter *it, const struct object_view *tree);
+
+/**
+ * @brief Moves to the next entry.
+ * @return 1 with 'out' filled in, 0 at the end, -1 if the tree is malformed.
+ */
+int tree_iter_next(struct tree_iter *it, struct tree_entry_view *out);
+
+// --- Commits ---
+
+#define COMMIT_VIEW_MAX_PARENTS 16
+
+struct commit_view {
+    struct object_slice tree;           // 40 hex chars
+    struct object_slice parents[COMMIT_VIEW_MAX_PARENTS]; // 40 hex chars each
+    int parent_count;
+    struct object_slice author;         // "Name <email> time zone"
+    struct object_slice committer;
+    struct object_slice message;        // Everything after the blank line; a C string
+};
+
+/**
+ * @brief Splits a commit into its header fields and message.
+ *
+ * Only the header lines (up to the first blank line) are searched, so a
+ * message mentioning "parent " is never mistaken for one.
+ * @return 0, or -1 if the view is not a commit or has no valid tree line.
+ */
+int commit_view_parse(const struct object_view *commit, struct commit_view *out);
+
+#endif // OBJECT_VIEW_H
@@ -0,0 +1,104 @@
+#ifndef PACK_H
+#define PACK_H
+
+#include <stddef.h> // For size_t
+#include <stdint.h>
+#include <openssl/sha.h> // For SHA_DIGEST_LENGTH
+
+#define PACK_DIR ".minivcs/objects/pack"
+
+/* Object type codes as stored in pack entry headers */
+#define OBJ_NONE   0
+#define OBJ_COMMIT 1
+#define OBJ_TREE   2
+#define OBJ_BLOB   3
+#define OBJ_REF_DELTA 7     // Delta against the object named by a 20-byte SHA-1
+
+/* One pack-<sha>.pack / pack-<sha>.idx pair, both mmap'd read-only */
+struct pack_file {
+    char pack_path[512];
+    unsigned char *pack_map;
+    size_t pack_size;
+    unsigned char *idx_map;
+    size_t idx_size;
+    uint32_t count;                 // Number of objects in the pack
+    const unsigned char *fanout;    // 256 x u32: objects with first byte <= i
+    const unsigned char *sha1s;     // count x 20 bytes, sorted
+    const unsigned char *offsets;   // count x u64 offsets into the pack
+    struct pack_file *next;
+};
+
+const char *object_type_name(int type);
+int object_type_from_name(const char *name);
+
+/**
+ * @brief Returns the list of packs under .minivcs/objects/pack, loading them on first use.
+ *
+ * The list may be walked without a lock: it stays valid until exit, also
+ * after reprepare_packs() replaces it.
+ */
+struct pack_file *get_packs();
+
+/**
+ * @brief Drops the loaded pack list so the next lookup rescans the pack directory.
+ *
+ * The old list is kept mapped (until exit), as other threads may be walking it.
+ */
+void reprepare_packs();
+
+/**
+ * @brief Checks whether any pack contains the object.
+ */
+int pack_has_object(const unsigned char *sha1);
+
+/**
+ * @brief Reads an object out of the packs.
+ *
+ * Same contract as read_object(): out_type and out_data are MALLOC'D.
+ * @return 0 on success, -1 if no pack holds the object or it is corrupt.
+ */
+int pack_read_object(const unsigned char *sha1, char **out_type, char **out_data, size_t *out_size);
+
+/**
+ * @brief pack_read_object() with the type name written to a buffer
+ * (at least OBJECT_TYPE_MAX chars) instead of allocated.
+ */
+int pack_read_object_typed(const unsigned char *sha1, char *out_type, char **out_data, size_t *out_size);
+
+/**
+ * @brief Returns an object's type name and size without inflating its payload.
+ *
+ * @param out_type A buffer (at least OBJECT_TYPE_MAX chars).
+ * @return 0 on success, -1 if no pack holds the object or it is corrupt.
+ */
+int pack_read_object_header(const unsigned char *sha1, char *out_type, size_t *out_size);
+
+/**
+ * @brief Calls 'fn' for every object in every pack. Stops early if 'fn' returns non-zero.
+ */
+int pack_for_each_object(int (*fn)(const unsigned char *sha1, void *data), void *data);
+
+struct pack_stats {
+    int objects;
+    int deltas;             // Objects stored as deltas
+    uint64_t raw_bytes;     // Sum of the uncompressed object sizes
+    uint64_t pack_bytes;    // Size of the resulting .pack file
+};
+
+/**
+ * @brief Writes a new pack (and its .idx) holding the given objects.
+ *
+ * Blobs are stored as deltas against a similar object when that is smaller.
+ * Candidates come from a sliding window over the objects sorted by path
+ * hint and size, and delta chains are kept short.
+ *
+ * @param hashes Hex SHA-1s of objects readable through read_object().
+ * @param names Path hint per object (entries may be NULL), or NULL for none.
+ * @param count Number of entries in 'hashes'.
+ * @param out_pack_hex Receives the pack name checksum (at least 41 chars). Can be NULL.
+ * @param stats Receives size and delta counts. Can be NULL.
+ * @return 0 on success, -1 on failure.
+ */
+int write_pack(char **hashes, char **names, int count, char *out_pack_hex, struct pack_stats *stats);
+
+#endif // PACK_H
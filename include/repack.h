@@ -0,0 +1,10 @@
+#ifndef REPACK_H
+#define REPACK_H
+
+/**
+ * @brief Moves every loose object into a new pack and deletes the loose copies.
+ * @return 0 on success, non-zero on failure.
+ */
+int do_repack();
+
+#endif // REPACK_H
@@ -0,0 +1,65 @@
+#ifndef SPARSE_H
+#define SPARSE_H
+
+/*
+ * Sparse checkout. The patterns file lists directories, one per line
+ * ("src/lib" or "/src/lib/"); '#' starts a comment. Like git's cone mode:
+ *   - everything under a listed directory is checked out,
+ *   - files directly inside the root and inside every parent of a listed
+ *     directory are checked out,
+ *   - every other directory is left out as a whole.
+ *
+ * checkout applies SPARSE_CHECKOUT_FILE and records the patterns it applied
+ * in SPARSE_APPLIED_FILE; status and commit follow the applied patterns.
+ */
+#define SPARSE_CHECKOUT_FILE ".minivcs/info/sparse-checkout"
+#define SPARSE_APPLIED_FILE ".minivcs/info/sparse-checkout.applied"
+
+/* How a directory relates to the cone */
+#define SPARSE_EXCLUDED 0       // Nothing under it is checked out
+#define SPARSE_PARENT 1         // Its files are; each subdirectory must be matched
+#define SPARSE_RECURSIVE 2      // Everything under it is
+
+/* The patterns, compiled into a trie of path components. */
+struct sparse_cone;
+
+/**
+ * @brief Compiles a patterns file.
+ * @return The cone, or NULL if the file is missing or lists no directory
+ * (a full checkout).
+ */
+struct sparse_cone *sparse_load(const char *patterns_file);
+
+/**
+ * @brief Matches a worktree-relative directory ("" for the root).
+ * @return SPARSE_EXCLUDED, SPARSE_PARENT or SPARSE_RECURSIVE. A NULL cone
+ * matches everything recursively.
+ */
+int sparse_match_dir(const struct sparse_cone *cone, const char *dir_path);
+
+/**
+ * @brief Checks whether a worktree-relative file is inside the cone.
+ */
+int sparse_match_file(const struct sparse_cone *cone, const char *path);
+
+/**
+ * @brief sparse_match_file() for files; for directories, whether anything
+ * under them is inside the cone. Fits diff.h's diff_filter when the
+ * callback data is the cone.
+ */
+int sparse_match_path(const char *path, int is_dir, void *cone);
+
+/**
+ * @brief Checks whether two cones select the same paths (NULL is the full tree).
+ */
+int sparse_same_cone(const struct sparse_cone *a, const struct sparse_cone *b);
+
+/**
+ * @brief Records SPARSE_CHECKOUT_FILE as applied (or forgets it if missing).
+ * @return 0 on success, -1 on failure.
+ */
+int sparse_mark_applied();
+
+void sparse_free(struct sparse_cone *cone);
+
+#endif // SPARSE_H
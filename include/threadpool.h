@@ -2,6 +2,7 @@
 #define THREADPOOL_H
 
 #include <pthread.h>
+#include <stdint.h>
 
 /* Task struct: Represents a unit of work */
 typedef struct {
@@ -9,32 +10,112 @@ typedef struct {
     void *argument;
 } threadpool_task_t;
 
-/* Threadpool struct */
+/*
+ * Chase-Lev work-stealing deque. The owning worker pushes and takes at the
+ * bottom without locking; other workers steal from the top with a CAS.
+ */
+typedef struct {
+    int64_t top;
+    int64_t bottom;
+    threadpool_task_t *buffer;  // Ring of 'mask + 1' slots (a power of two)
+    int64_t mask;
+} threadpool_deque_t;
+
+typedef struct threadpool threadpool_t;
+
+/* One worker thread and the deque it owns */
 typedef struct {
-    pthread_mutex_t lock;       // Mutex for synchronization
-    pthread_cond_t notify;      // Condition variable to wake up threads
-    pthread_t *threads;         // Array of worker threads
-    threadpool_task_t *queue;   // Circular buffer for tasks
+    threadpool_t *pool;
+    pthread_t thread;
+    threadpool_deque_t deque;
+    uint32_t rng;               // xorshift state for picking steal victims
+} threadpool_worker_t;
+
+/* Threadpool struct */
+struct threadpool {
+    threadpool_worker_t *workers;
     int thread_count;           // Number of threads
-    int queue_size;             // Max size of the queue
+    int started;                // Number of threads started
+
+    // Tasks submitted from threads outside the pool
+    pthread_mutex_t lock;       // Guards the inject queue
+    threadpool_task_t *queue;   // Circular buffer for injected tasks
+    int queue_size;             // Max size of the queue (and of each deque)
     int head;                   // Queue head index
     int tail;                   // Queue tail index
     int count;                  // Current number of tasks in queue
+
+    // Parking (an eventcount on a futex word)
+    uint32_t epoch;             // Bumped whenever work arrives for sleepers
+    int sleepers;               // Workers parked or about to park
+    int searching;              // Workers currently trying to steal
     int shutdown;               // Flag to signal shutdown
-    int started;                // Number of threads started
-} threadpool_t;
+};
 
 /**
  * @brief Creates a threadpool with the specified number of threads and queue size.
+ *
+ * Each worker owns a deque of 'queue_size' slots (rounded up to a power of
+ * two) for tasks it submits itself; idle workers steal from random victims.
+ * Tasks submitted from outside the pool go through a shared queue of
+ * 'queue_size' slots.
  */
 threadpool_t *threadpool_create(int thread_count, int queue_size);
 
 /**
  * @brief Adds a task to the threadpool.
- * @return 0 on success, -1 on failure.
+ *
+ * From a worker of this pool the task goes to that worker's own deque.
+ * @return 0 on success, -1 on failure (queue full or shutting down).
  */
 int threadpool_add(threadpool_t *pool, void (*function)(void *), void *argument);
 
+/**
+ * @brief Adds a task, waiting for room instead of failing when the queue is full.
+ *
+ * A worker of this pool whose deque is full runs the task itself (depth
+ * first). Other threads help run queued tasks until the task fits.
+ * @return 0 once the task is queued or has run, -1 if the pool is shutting down.
+ */
+int threadpool_submit(threadpool_t *pool, void (*function)(void *), void *argument);
+
+/*
+ * A set of tasks that can be waited for as a whole. Tasks submitted to a
+ * group may submit more tasks to the same group.
+ */
+typedef struct {
+    threadpool_t *pool;         // NULL runs every task inline on submit
+    int pending;                // Submitted tasks not yet finished (futex word)
+    int finishing;              // Completers that may still touch the group
+} threadpool_group_t;
+
+/**
+ * @brief Creates an empty task group on 'pool' (which may be NULL).
+ */
+threadpool_group_t *threadpool_group_create(threadpool_t *pool);
+
+/**
+ * @brief Submits a task to the group, with threadpool_submit() backpressure.
+ * @return 0 on success, -1 on failure (the task did not run).
+ */
+int threadpool_group_submit(threadpool_group_t *group, void (*function)(void *), void *argument);
+
+/**
+ * @brief Waits until every task of the group has finished.
+ *
+ * The caller runs queued tasks while it waits, so waiting from inside a
+ * worker does not tie up a thread.
+ */
+void threadpool_group_wait(threadpool_group_t *group);
+
+/**
+ * @brief Frees a group. Call threadpool_group_wait() first.
+ *
+ * Also waits out the task that finished last, which may still be waking
+ * the waiter when threadpool_group_wait() returns.
+ */
+void threadpool_group_destroy(threadpool_group_t *group);
+
 /**
  * @brief Destroys the threadpool, waits for all tasks to finish, and cleans up.
  */
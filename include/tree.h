@@ -3,10 +3,44 @@
 
 #include <openssl/sha.h>
 #include "threadpool.h" 
+#include "index.h"
 
 /**
  * @brief Recursively writes a tree object.
  */
 int write_tree_recursive(threadpool_t *pool, const char *path, char *out_sha1_hex, unsigned char *out_sha1_binary);
 
+/**
+ * @brief Like write_tree_recursive, but consults and refreshes the stat cache.
+ *
+ * Any file that cannot be read or stored, or a walk interrupted by a
+ * signal, fails the whole call: a tree is only returned when it holds every
+ * path (empty and unreadable directories are left out).
+ *
+ * Files whose stat data matches their index entry reuse the cached blob SHA
+ * and are never reopened. Every file seen is recorded in 'index' so that a
+ * following index_write() persists the refreshed cache. 'index' may be NULL.
+ *
+ * Directories are scanned as pool tasks, so sibling directories are walked
+ * in parallel; the calling thread helps run them until the root tree is
+ * built. 'pool' may be NULL to walk on the calling thread.
+ *
+ * @return 0 on success, 1 if no files were found, -1 on failure.
+ */
+int write_tree_indexed(threadpool_t *pool, struct index *index, const char *path,
+                       char *out_sha1_hex, unsigned char *out_sha1_binary);
+
+/**
+ * @brief Like write_tree_indexed, but only computes the SHAs (a dry run).
+ *
+ * Nothing is compressed or written to the object store. Blobs and trees
+ * hashed here are recorded in 'index' without INDEX_ENTRY_STORED (or the
+ * cache-tree stored bit), so the next write_tree_indexed() stores them.
+ * Use it wherever only the tree SHA is needed, e.g. for status.
+ *
+ * @return 0 on success, 1 if no files were found, -1 on failure.
+ */
+int hash_tree_indexed(threadpool_t *pool, struct index *index, const char *path,
+                      char *out_sha1_hex, unsigned char *out_sha1_binary);
+
 #endif // TREE_H
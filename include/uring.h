@@ -0,0 +1,80 @@
+#ifndef URING_H
+#define URING_H
+
+#include <stdint.h>
+#include <sys/uio.h> // For struct iovec
+
+/*
+ * A minimal io_uring ring over the raw system calls (there is no liburing
+ * dependency). It is only built when the kernel headers know about direct
+ * descriptors (VF_HAVE_IO_URING); at run time uring_create() returns NULL
+ * when the kernel refuses, and callers keep their blocking path.
+ *
+ * Each ring has a sparse table of direct descriptors, so a linked chain
+ * like openat -> read -> close never returns an fd to user space, and
+ * optionally a set of registered buffers for the *_FIXED operations.
+ * A ring belongs to the thread that created it.
+ */
+#if defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#if defined(IORING_FILE_INDEX_ALLOC) && defined(IORING_RSRC_REGISTER_SPARSE)
+#define VF_HAVE_IO_URING 1
+#endif
+#endif
+#endif
+
+/* Set to 0 to keep every caller on its blocking path. */
+#define URING_ENV "VF_IO_URING"
+
+struct uring;
+
+#ifdef VF_HAVE_IO_URING
+
+/**
+ * @brief Sets up a ring.
+ *
+ * @param entries Submission queue size (a power of two).
+ * @param files Direct descriptor slots; slot i is file_index i + 1 in openat/close.
+ * @param buffers Buffers to register, or NULL; registration may fail
+ *        (e.g., RLIMIT_MEMLOCK) without failing the ring.
+ * @return The ring, or NULL if io_uring is unavailable or disabled by VF_IO_URING=0.
+ */
+struct uring *uring_create(unsigned entries, unsigned files, const struct iovec *buffers, unsigned buffer_count);
+
+/**
+ * @brief Whether the buffers given to uring_create() were registered.
+ */
+int uring_has_buffers(const struct uring *r);
+
+/**
+ * @brief Free submission entries; 0 once the ring is broken (see uring_submit()).
+ */
+unsigned uring_space(const struct uring *r);
+
+/**
+ * @brief Returns a zeroed submission entry, or NULL if the queue is full.
+ */
+struct io_uring_sqe *uring_sqe(struct uring *r);
+
+/**
+ * @brief Submits every queued entry and waits for 'wait_nr' completions.
+ *
+ * If the kernel takes fewer entries than were queued, only those will
+ * complete, and the ring is marked broken: callers finish what was
+ * submitted and go back to their blocking path.
+ * @return The number of entries submitted.
+ */
+int uring_submit(struct uring *r, unsigned wait_nr);
+
+/**
+ * @brief Takes one completion, waiting for it if 'wait' is set.
+ * @return 1 with 'user_data' and 'res' filled in, 0 if none is ready, -errno on failure.
+ */
+int uring_complete(struct uring *r, int wait, uint64_t *user_data, int *res);
+
+void uring_destroy(struct uring *r);
+
+#endif // VF_HAVE_IO_URING
+
+#endif // URING_H
@@ -2,6 +2,7 @@
 #define UTILS_H
 
 #include <stddef.h> // For size_t
+#include <stdint.h>
 #include <openssl/sha.h> // For SHA_DIGEST_LENGTH
 
 char* read_file_to_buffer(const char *filepath, size_t *out_size);
@@ -18,5 +19,19 @@ int update_ref(const char *ref_path, const char *sha1_hex);
  */
 void sha1_bin_to_hex(const unsigned char *sha1, char *hex_out);
 
+/**
+ * @brief Converts a 40-char hex SHA-1 to its 20-byte binary form.
+ * @return 0 on success, -1 if 'hex' is not a valid SHA-1.
+ */
+int sha1_hex_to_bin(const char *hex, unsigned char *sha1_out);
+
+// Big-endian helpers for the on-disk binary formats (.minivcs/index, ...)
+uint16_t get_be16(const unsigned char *p);
+uint32_t get_be32(const unsigned char *p);
+uint64_t get_be64(const unsigned char *p);
+void put_be16(unsigned char *p, uint16_t v);
+void put_be32(unsigned char *p, uint32_t v);
+void put_be64(unsigned char *p, uint64_t v);
+
 
 #endif // UTILS_H
@@ -0,0 +1,26 @@
+#ifndef WORKER_POOL_H
+#define WORKER_POOL_H
+
+#include "threadpool.h"
+
+/* Overrides for the worker count; the environment wins over the config. */
+#define WORKER_POOL_THREADS_ENV "VF_THREADS"
+#define WORKER_POOL_THREADS_KEY "core.threads"
+
+/**
+ * @brief Returns the process-wide worker pool, starting it on first use.
+ *
+ * The pool is sized from the CPUs this process may run on, capped by the
+ * cgroup CPU quota, unless VF_THREADS or core.threads says otherwise. Its
+ * threads are stopped once, at exit.
+ *
+ * @return The pool, or NULL if it could not be started (callers then run serially).
+ */
+threadpool_t *get_worker_pool();
+
+/**
+ * @brief The number of threads get_worker_pool() starts (or has started).
+ */
+int worker_pool_size();
+
+#endif // WORKER_POOL_H
@@ -0,0 +1,125 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "arena.h"
+
+#define ARENA_ALIGN 16              // Enough for any type we store
+#define ARENA_MAX_BLOCK (64 * 1024) // Blocks stop doubling here
+
+#define ALIGN_UP(n) (((n) + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1))
+
+struct arena_block {
+    struct arena_block *prev;       // The block before this one
+    size_t size;                    // Usable bytes after the header
+    size_t used;
+};
+
+struct arena {
+    struct arena_block *current;
+    size_t next_size;
+    void *last;                     // Most recent allocation, for arena_grow()
+};
+
+#define BLOCK_HEADER ALIGN_UP(sizeof(struct arena_block))
+
+static char *block_data(struct arena_block *b) {
+    return (char *)b + BLOCK_HEADER;
+}
+
+static struct arena_block *new_block(struct arena_block *prev, size_t size) {
+    struct arena_block *b = malloc(BLOCK_HEADER + size);
+    if (!b) return NULL;
+    b->prev = prev;
+    b->size = size;
+    b->used = 0;
+    return b;
+}
+
+struct arena *arena_create(size_t block_size) {
+    size_t size = ALIGN_UP(block_size > sizeof(struct arena) ? block_size : sizeof(struct arena));
+    struct arena_block *first = new_block(NULL, size);
+    if (!first) return NULL;
+    struct arena *a = (struct arena *)block_data(first);
+    first->used = ALIGN_UP(sizeof(struct arena));
+    a->current = first;
+    a->next_size = size * 2 < ARENA_MAX_BLOCK ? size * 2 : ARENA_MAX_BLOCK;
+    a->last = NULL;
+    return a;
+}
+
+void *arena_alloc(struct arena *a, size_t size) {
+    size = ALIGN_UP(size ? size : 1);
+    struct arena_block *b = a->current;
+    if (b->size - b->used < size) {
+        // Whatever is left in the old block is given up.
+        size_t block_size = size > a->next_size ? size : a->next_size;
+        b = new_block(b, block_size);
+        if (!b) return NULL;
+        a->current = b;
+        if (a->next_size < ARENA_MAX_BLOCK) a->next_size *= 2;
+    }
+    void *ptr = block_data(b) + b->used;
+    b->used += size;
+    a->last = ptr;
+    return ptr;
+}
+
+void *arena_calloc(struct arena *a, size_t size) {
+    void *ptr = arena_alloc(a, size);
+    if (ptr) memset(ptr, 0, size);
+    return ptr;
+}
+
+void *arena_grow(struct arena *a, void *old, size_t old_size, size_t new_size) {
+    if (!old) return arena_alloc(a, new_size);
+    struct arena_block *b = a->current;
+    if (old == a->last) {
+        size_t end = ALIGN_UP((size_t)((char *)old - block_data(b)) + new_size);
+        if (end <= b->size) {
+            b->used = end;
+            return old;
+        }
+    }
+    void *ptr = arena_alloc(a, new_size);
+    if (ptr) memcpy(ptr, old, old_size < new_size ? old_size : new_size);
+    return ptr;
+}
+
+char *arena_strndup(struct arena *a, const char *s, size_t n) {
+    size_t len = strnlen(s, n);
+    char *copy = arena_alloc(a, len + 1);
+    if (!copy) return NULL;
+    memcpy(copy, s, len);
+    copy[len] = '\0';
+    return copy;
+}
+
+char *arena_strdup(struct arena *a, const char *s) {
+    return arena_strndup(a, s, strlen(s));
+}
+
+struct arena_mark arena_mark(const struct arena *a) {
+    struct arena_mark mark = { a->current, a->current->used };
+    return mark;
+}
+
+void arena_reset(struct arena *a, struct arena_mark mark) {
+    while (a->current != mark.block) {
+        struct arena_block *prev = a->current->prev;
+        free(a->current);
+        a->current = prev;
+    }
+    a->current->used = mark.used;
+    a->last = NULL;
+}
+
+void arena_destroy(struct arena *a) {
+    if (!a) return;
+    // The arena lives in the first block, which goes last.
+    struct arena_block *b = a->current;
+    while (b) {
+        struct arena_block *prev = b->prev;
+        free(b);
+        b = prev;
+    }
+}
@@ -0,0 +1,581 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+#include <zlib.h>
+
+#include "blob_pipeline.h"
+#include "database.h"
+#include "uring.h"
+#include "config.h"
+#include "worker_pool.h"
+#include "vf_signals.h"
+
+#define BLOB_QUEUE_DEPTH 32         // Jobs waiting in front of each stage
+#define BLOB_STAGE_BATCH 8          // Jobs a compressor (or a reader without io_uring) takes at once
+#define BLOB_IO_BATCH 32            // Jobs a reader or writer takes at once: one io_uring submission
+#define BLOB_MAX_STAGE_THREADS 64
+#define BLOB_HEADER_ROOM 32         // "blob <size>\0" is placed right before the contents
+
+// File contents and deflated objects that fit a slot live in one of two
+// buffer pools, registered with the readers' and the writers' rings.
+// Larger ones, and any beyond the pools, are malloc'd.
+#define BLOB_SLOT_SIZE (16 * 1024)
+#define BLOB_SLOTS 128              // 2 MB per pool: four rings fit the default RLIMIT_MEMLOCK
+
+// One file on its way through the stages. The reader leaves room for the
+// object header in front of the contents, so the header and the payload
+// are hashed and deflated as one buffer, without a copy.
+struct blob_job {
+    char *filepath;
+    size_t size;
+    char *buffer;                   // BLOB_HEADER_ROOM bytes, then the contents
+    int buffer_slot;                // Slot of the read pool holding 'buffer', or -1
+    size_t header_len;
+    unsigned char *deflated;
+    int deflated_slot;              // Slot of the deflate pool holding 'deflated', or -1
+    size_t deflated_len;
+    int stored;                     // The object exists already: nothing to write
+    int result;                     // Outcome of the write stage
+    unsigned char sha1[SHA_DIGEST_LENGTH];
+    blob_done_fn done;
+    void *arg;
+};
+
+// Bounded FIFO in front of a stage.
+struct blob_queue {
+    pthread_mutex_t lock;
+    pthread_cond_t not_empty;
+    pthread_cond_t not_full;
+    struct blob_job *jobs[BLOB_QUEUE_DEPTH];
+    int head;
+    int count;
+    int push_waiters;
+    int pop_waiters;
+    int closed;                     // No more pushes; pops drain what is left
+};
+
+struct buffer_pool {
+    char *memory;                   // BLOB_SLOTS slots, or NULL
+    struct iovec iov[BLOB_SLOTS];   // Registered in this order: slot i is buf_index i
+    int free_slots[BLOB_SLOTS];
+    int free_count;
+    pthread_mutex_t lock;
+};
+
+struct stage_threads {
+    struct blob_pipeline *pipeline;
+    enum blob_stage id;
+    int threads;
+    int started;
+    pthread_t *tids;
+    long items;
+    long busy_ns;
+    long blocked_ns;
+    int uring;                      // Threads running on an io_uring ring
+};
+
+struct blob_pipeline {
+    struct blob_queue queues[BLOB_STAGE_COUNT]; // The input queue of each stage
+    struct stage_threads stages[BLOB_STAGE_COUNT];
+    struct buffer_pool read_pool;   // File contents
+    struct buffer_pool deflate_pool; // Deflated objects
+    int use_uring;
+    long start_ns;
+};
+
+static const char *stage_names[BLOB_STAGE_COUNT] = { "read", "hash+deflate", "write" };
+
+static struct blob_stage_stats last_stats[BLOB_STAGE_COUNT];
+static int have_last_stats;
+
+static long now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+// --- Queues ---
+
+static void queue_init(struct blob_queue *q) {
+    memset(q, 0, sizeof(*q));
+    pthread_mutex_init(&q->lock, NULL);
+    pthread_cond_init(&q->not_empty, NULL);
+    pthread_cond_init(&q->not_full, NULL);
+}
+
+static void queue_destroy(struct blob_queue *q) {
+    pthread_mutex_destroy(&q->lock);
+    pthread_cond_destroy(&q->not_empty);
+    pthread_cond_destroy(&q->not_full);
+}
+
+// Queues 'count' jobs, waiting for room when the queue is full; the time
+// spent waiting is added to 'blocked_ns'. Returns how many were queued
+// (fewer if the queue was closed).
+static int queue_push(struct blob_queue *q, struct blob_job **jobs, int count, long *blocked_ns) {
+    int pushed = 0;
+    pthread_mutex_lock(&q->lock);
+    while (pushed < count && !q->closed) {
+        if (q->count == BLOB_QUEUE_DEPTH) {
+            if (q->pop_waiters) pthread_cond_broadcast(&q->not_empty);
+            long start = now_ns();
+            q->push_waiters++;
+            while (q->count == BLOB_QUEUE_DEPTH && !q->closed) pthread_cond_wait(&q->not_full, &q->lock);
+            q->push_waiters--;
+            __atomic_fetch_add(blocked_ns, now_ns() - start, __ATOMIC_RELAXED);
+            continue;
+        }
+        q->jobs[(q->head + q->count) % BLOB_QUEUE_DEPTH] = jobs[pushed++];
+        q->count++;
+    }
+    if (pushed && q->pop_waiters) {
+        if (pushed > 1) pthread_cond_broadcast(&q->not_empty);
+        else pthread_cond_signal(&q->not_empty);
+    }
+    pthread_mutex_unlock(&q->lock);
+    return pushed;
+}
+
+// Takes up to 'max' jobs, waiting for the first one. Returns 0 once the
+// queue is closed and empty. Blocked pushers are only woken once the
+// queue is half empty, so a slow stage does not trade wakeups with its
+// producer one job at a time.
+static int queue_pop(struct blob_queue *q, struct blob_job **out, int max) {
+    pthread_mutex_lock(&q->lock);
+    q->pop_waiters++;
+    while (q->count == 0 && !q->closed) pthread_cond_wait(&q->not_empty, &q->lock);
+    q->pop_waiters--;
+    int n = q->count < max ? q->count : max;
+    for (int i = 0; i < n; i++) {
+        out[i] = q->jobs[q->head];
+        q->head = (q->head + 1) % BLOB_QUEUE_DEPTH;
+    }
+    q->count -= n;
+    if (q->push_waiters && q->count <= BLOB_QUEUE_DEPTH / 2) pthread_cond_broadcast(&q->not_full);
+    pthread_mutex_unlock(&q->lock);
+    return n;
+}
+
+static void queue_close(struct blob_queue *q) {
+    pthread_mutex_lock(&q->lock);
+    q->closed = 1;
+    pthread_cond_broadcast(&q->not_empty);
+    pthread_cond_broadcast(&q->not_full);
+    pthread_mutex_unlock(&q->lock);
+}
+
+// --- Buffer Pools ---
+
+static void pool_init(struct buffer_pool *pool) {
+    pthread_mutex_init(&pool->lock, NULL);
+    pool->memory = aligned_alloc(4096, (size_t)BLOB_SLOTS * BLOB_SLOT_SIZE);
+    if (!pool->memory) return;
+    for (int i = 0; i < BLOB_SLOTS; i++) {
+        pool->iov[i].iov_base = pool->memory + (size_t)i * BLOB_SLOT_SIZE;
+        pool->iov[i].iov_len = BLOB_SLOT_SIZE;
+        pool->free_slots[i] = BLOB_SLOTS - 1 - i;
+    }
+    pool->free_count = BLOB_SLOTS;
+}
+
+static void pool_destroy(struct buffer_pool *pool) {
+    pthread_mutex_destroy(&pool->lock);
+    free(pool->memory);
+}
+
+// A free slot for 'size' bytes, or -1 (too large, or none left).
+static int pool_get(struct buffer_pool *pool, size_t size) {
+    if (size > BLOB_SLOT_SIZE) return -1;
+    pthread_mutex_lock(&pool->lock);
+    int slot = pool->free_count ? pool->free_slots[--pool->free_count] : -1;
+    pthread_mutex_unlock(&pool->lock);
+    return slot;
+}
+
+static void pool_put(struct buffer_pool *pool, int slot) {
+    pthread_mutex_lock(&pool->lock);
+    pool->free_slots[pool->free_count++] = slot;
+    pthread_mutex_unlock(&pool->lock);
+}
+
+// Points '*out' at a pool slot or a malloc'd buffer of 'size' bytes.
+static int buffer_get(struct buffer_pool *pool, size_t size, void **out) {
+    int slot = pool_get(pool, size);
+    *out = slot >= 0 ? pool->iov[slot].iov_base : malloc(size);
+    return slot;
+}
+
+static void buffer_put(struct buffer_pool *pool, void *buffer, int slot) {
+    if (slot >= 0) pool_put(pool, slot);
+    else free(buffer);
+}
+
+// --- Stages ---
+
+static void finish_job(struct blob_pipeline *p, struct blob_job *job, int result) {
+    job->done(job->arg, result, result == 0 ? job->sha1 : NULL);
+    free(job->filepath);
+    buffer_put(&p->read_pool, job->buffer, job->buffer_slot);
+    buffer_put(&p->deflate_pool, job->deflated, job->deflated_slot);
+    free(job);
+}
+
+static int alloc_read_buffer(struct blob_pipeline *p, struct blob_job *job) {
+    job->buffer_slot = buffer_get(&p->read_pool, BLOB_HEADER_ROOM + job->size, (void **)&job->buffer);
+    return job->buffer ? 0 : -1;
+}
+
+static void set_blob_header(struct blob_job *job) {
+    char header[BLOB_HEADER_ROOM];
+    job->header_len = snprintf(header, sizeof(header), "blob %zu", job->size) + 1;
+    memcpy(job->buffer + BLOB_HEADER_ROOM - job->header_len, header, job->header_len);
+}
+
+// The whole file in one read, straight after the header room.
+static int read_blob(struct blob_job *job) {
+    int fd = open(job->filepath, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return -1;
+    char *data = job->buffer + BLOB_HEADER_ROOM;
+    size_t total = 0;
+    int err = 0;
+    while (!err && total < job->size) {
+        ssize_t n = read(fd, data + total, job->size - total);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) err = 1;
+        else total += n;
+    }
+    close(fd);
+    if (err) {
+        fprintf(stderr, "Error reading file %s\n", job->filepath);
+        return -1;
+    }
+    set_blob_header(job);
+    return 0;
+}
+
+#ifdef VF_HAVE_IO_URING
+// Linked operations per file; user_data is file * 3 + op.
+enum { READ_OP_OPEN, READ_OP_READ, READ_OP_CLOSE, READ_OPS };
+
+// Each file is opened, read and closed by one linked chain in direct
+// descriptor slot i, and the whole batch goes out in one submission. A
+// file whose chain falls short is read again on the blocking path.
+static void read_batch_uring(struct uring *ring, struct blob_job **jobs, int count, int *results) {
+    int res[BLOB_IO_BATCH][READ_OPS];
+    for (int i = 0; i < count; i++) {
+        for (int op = 0; op < READ_OPS; op++) res[i][op] = -ECANCELED;
+        struct io_uring_sqe *sqe = uring_sqe(ring);
+        sqe->opcode = IORING_OP_OPENAT;
+        sqe->fd = AT_FDCWD;
+        sqe->addr = (uintptr_t)jobs[i]->filepath;
+        sqe->open_flags = O_RDONLY;
+        sqe->file_index = i + 1;
+        sqe->flags = IOSQE_IO_LINK;
+        sqe->user_data = i * READ_OPS + READ_OP_OPEN;
+
+        // Hard-linked: the slot is closed even after a short read.
+        int fixed = jobs[i]->buffer_slot >= 0 && uring_has_buffers(ring);
+        sqe = uring_sqe(ring);
+        sqe->opcode = fixed ? IORING_OP_READ_FIXED : IORING_OP_READ;
+        sqe->fd = i;
+        sqe->addr = (uintptr_t)(jobs[i]->buffer + BLOB_HEADER_ROOM);
+        sqe->len = jobs[i]->size;
+        sqe->buf_index = fixed ? jobs[i]->buffer_slot : 0;
+        sqe->flags = IOSQE_FIXED_FILE | IOSQE_IO_HARDLINK;
+        sqe->user_data = i * READ_OPS + READ_OP_READ;
+
+        sqe = uring_sqe(ring);
+        sqe->opcode = IORING_OP_CLOSE;
+        sqe->file_index = i + 1;
+        sqe->user_data = i * READ_OPS + READ_OP_CLOSE;
+    }
+
+    int submitted = uring_submit(ring, count * READ_OPS);
+    for (int got = 0; got < submitted; got++) {
+        uint64_t user_data;
+        int result;
+        if (uring_complete(ring, 1, &user_data, &result) != 1) break;
+        res[user_data / READ_OPS][user_data % READ_OPS] = result;
+    }
+    for (int i = 0; i < count; i++) {
+        if (res[i][READ_OP_READ] >= 0 && (size_t)res[i][READ_OP_READ] == jobs[i]->size) {
+            set_blob_header(jobs[i]);
+            results[i] = 0;
+        } else {
+            results[i] = read_blob(jobs[i]);
+        }
+    }
+}
+#endif // VF_HAVE_IO_URING
+
+static void read_batch(struct blob_pipeline *p, struct uring *ring, struct blob_job **jobs, int count, int *results) {
+    int ready = 0;
+    for (int i = 0; i < count; i++) {
+        results[i] = -1;
+        if (shutdown_requested || alloc_read_buffer(p, jobs[i]) != 0) continue;
+        results[i] = 0;
+        ready++;
+    }
+#ifdef VF_HAVE_IO_URING
+    if (ring && ready == count && uring_space(ring) >= (unsigned)count * READ_OPS) {
+        read_batch_uring(ring, jobs, count, results);
+        return;
+    }
+#else
+    (void)ring;
+#endif
+    for (int i = 0; i < count; i++) {
+        if (results[i] == 0) results[i] = read_blob(jobs[i]);
+    }
+}
+
+// Hashes the object; deflates it only if it is not stored yet. Each
+// compressor reuses one deflate stream instead of allocating its state
+// for every object.
+static int deflate_blob(struct blob_pipeline *p, struct blob_job *job, z_stream *strm) {
+    if (hash_object(job->buffer + BLOB_HEADER_ROOM, job->size, "blob", job->sha1) != 0) return -1;
+    if (has_object(job->sha1)) {
+        note_object_skipped();
+        job->stored = 1;
+        return 0;
+    }
+
+    const Bytef *object = (const Bytef *)job->buffer + BLOB_HEADER_ROOM - job->header_len;
+    uLong object_len = job->header_len + job->size;
+    uLong bound = deflateBound(strm, object_len);
+    job->deflated_slot = buffer_get(&p->deflate_pool, bound, (void **)&job->deflated);
+    if (!job->deflated || deflateReset(strm) != Z_OK) return -1;
+    strm->next_in = (Bytef *)object;
+    strm->avail_in = object_len;
+    strm->next_out = job->deflated;
+    strm->avail_out = bound;
+    if (deflate(strm, Z_FINISH) != Z_STREAM_END) return -1;
+    job->deflated_len = strm->total_out;
+    // The contents are no longer needed; don't hold them while the write queue is full.
+    buffer_put(&p->read_pool, job->buffer, job->buffer_slot);
+    job->buffer = NULL;
+    job->buffer_slot = -1;
+    return 0;
+}
+
+static int compare_job_sha1(const void *a, const void *b) {
+    return memcmp((*(struct blob_job **)a)->sha1, (*(struct blob_job **)b)->sha1, SHA_DIGEST_LENGTH);
+}
+
+// A batch is sorted by SHA, so identical files queued together are
+// written once; the rest go to the object store together.
+static void write_batch(struct blob_pipeline *p, struct uring *ring, struct blob_job **jobs, int count) {
+    qsort(jobs, count, sizeof(struct blob_job *), compare_job_sha1);
+    struct object_write objects[BLOB_IO_BATCH];
+    int owner[BLOB_IO_BATCH];
+    int unique = 0;
+    for (int i = 0; i < count; i++) {
+        if (i > 0 && memcmp(jobs[i]->sha1, jobs[i - 1]->sha1, SHA_DIGEST_LENGTH) == 0) continue;
+        struct object_write *o = &objects[unique];
+        o->sha1 = jobs[i]->sha1;
+        o->data = jobs[i]->deflated;
+        o->len = jobs[i]->deflated_len;
+#ifdef VF_HAVE_IO_URING
+        o->buf_index = ring && uring_has_buffers(ring) ? jobs[i]->deflated_slot : -1;
+#else
+        o->buf_index = -1;
+#endif
+        owner[unique++] = i;
+    }
+    write_compressed_objects(ring, objects, unique);
+
+    for (int u = 0; u < unique; u++) {
+        jobs[owner[u]]->result = objects[u].result;
+        if (objects[u].result != 0) fprintf(stderr, "Error storing file %s\n", jobs[owner[u]]->filepath);
+    }
+    for (int i = 1; i < count; i++) {
+        if (memcmp(jobs[i]->sha1, jobs[i - 1]->sha1, SHA_DIGEST_LENGTH) != 0) continue;
+        jobs[i]->result = jobs[i - 1]->result;
+        if (jobs[i]->result == 0) note_object_skipped();
+    }
+    for (int i = 0; i < count; i++) finish_job(p, jobs[i], jobs[i]->result);
+}
+
+static void *stage_thread(void *arg) {
+    struct stage_threads *stage = arg;
+    struct blob_pipeline *p = stage->pipeline;
+    struct blob_queue *in = &p->queues[stage->id];
+    struct blob_queue *out = stage->id + 1 < BLOB_STAGE_COUNT ? &p->queues[stage->id + 1] : NULL;
+    struct uring *ring = NULL;
+#ifdef VF_HAVE_IO_URING
+    if (p->use_uring && stage->id == BLOB_STAGE_READ)
+        ring = uring_create(128, BLOB_IO_BATCH, p->read_pool.iov, p->read_pool.memory ? BLOB_SLOTS : 0);
+    else if (p->use_uring && stage->id == BLOB_STAGE_WRITE)
+        ring = uring_create(256, BLOB_IO_BATCH, p->deflate_pool.iov, p->deflate_pool.memory ? BLOB_SLOTS : 0);
+    if (ring) __atomic_fetch_add(&stage->uring, 1, __ATOMIC_RELAXED);
+#endif
+    int max = stage->id == BLOB_STAGE_COMPRESS || (stage->id == BLOB_STAGE_READ && !ring) ? BLOB_STAGE_BATCH : BLOB_IO_BATCH;
+    struct blob_job *jobs[BLOB_IO_BATCH];
+    int results[BLOB_IO_BATCH];
+    z_stream strm;
+    memset(&strm, 0, sizeof(strm));
+    int have_strm = stage->id == BLOB_STAGE_COMPRESS && deflateInit(&strm, Z_DEFAULT_COMPRESSION) == Z_OK;
+
+    int n;
+    while ((n = queue_pop(in, jobs, max)) > 0) {
+        long start = now_ns();
+        __atomic_fetch_add(&stage->items, n, __ATOMIC_RELAXED);
+        if (stage->id == BLOB_STAGE_WRITE) {
+            write_batch(p, ring, jobs, n);
+            __atomic_fetch_add(&stage->busy_ns, now_ns() - start, __ATOMIC_RELAXED);
+            continue;
+        }
+
+        // Jobs that are done here (failed, or already stored) drop out;
+        // the rest move on together.
+        if (stage->id == BLOB_STAGE_READ) {
+            read_batch(p, ring, jobs, n, results);
+        } else {
+            for (int i = 0; i < n; i++)
+                results[i] = !shutdown_requested && have_strm ? deflate_blob(p, jobs[i], &strm) : -1;
+        }
+        int next = 0;
+        for (int i = 0; i < n; i++) {
+            if (results[i] != 0 || jobs[i]->stored) finish_job(p, jobs[i], results[i]);
+            else jobs[next++] = jobs[i];
+        }
+        __atomic_fetch_add(&stage->busy_ns, now_ns() - start, __ATOMIC_RELAXED);
+        int pushed = next ? queue_push(out, jobs, next, &stage->blocked_ns) : 0;
+        for (int i = pushed; i < next; i++) finish_job(p, jobs[i], -1);
+    }
+    if (have_strm) deflateEnd(&strm);
+#ifdef VF_HAVE_IO_URING
+    uring_destroy(ring);
+#endif
+    return NULL;
+}
+
+// --- Setup ---
+
+static int stage_size(const char *key, int default_threads) {
+    char value[64];
+    if (get_config_value(key, value, sizeof(value)) != 0) return default_threads;
+    char *end;
+    long n = strtol(value, &end, 10);
+    if (end == value || *end != '\0' || n <= 0) {
+        fprintf(stderr, "Warning: ignoring invalid %s=%s\n", key, value);
+        return default_threads;
+    }
+    return n > BLOB_MAX_STAGE_THREADS ? BLOB_MAX_STAGE_THREADS : (int)n;
+}
+
+// Stops the stages in order: each one drains its queue before the next
+// queue is closed, so every job reaches its callback.
+static void stop_stages(struct blob_pipeline *p) {
+    for (int s = 0; s < BLOB_STAGE_COUNT; s++) {
+        queue_close(&p->queues[s]);
+        for (int t = 0; t < p->stages[s].started; t++) pthread_join(p->stages[s].tids[t], NULL);
+    }
+}
+
+static void free_pipeline(struct blob_pipeline *p) {
+    for (int s = 0; s < BLOB_STAGE_COUNT; s++) {
+        queue_destroy(&p->queues[s]);
+        free(p->stages[s].tids);
+    }
+    pool_destroy(&p->read_pool);
+    pool_destroy(&p->deflate_pool);
+    free(p);
+}
+
+struct blob_pipeline *blob_pipeline_start() {
+    struct blob_pipeline *p = calloc(1, sizeof(struct blob_pipeline));
+    if (!p) return NULL;
+    // Reads and file creation overlap even on one CPU; hashing and
+    // deflating want every CPU.
+    int sizes[BLOB_STAGE_COUNT] = {
+        stage_size(BLOB_PIPELINE_READERS_KEY, 2),
+        stage_size(BLOB_PIPELINE_COMPRESSORS_KEY, worker_pool_size()),
+        stage_size(BLOB_PIPELINE_WRITERS_KEY, 2),
+    };
+    p->start_ns = now_ns();
+    pool_init(&p->read_pool);
+    pool_init(&p->deflate_pool);
+    char value[64];
+    p->use_uring = get_config_value(BLOB_PIPELINE_IOURING_KEY, value, sizeof(value)) != 0 ||
+                   (strcmp(value, "false") != 0 && strcmp(value, "0") != 0);
+
+    int err = 0;
+    for (int s = 0; s < BLOB_STAGE_COUNT; s++) {
+        queue_init(&p->queues[s]);
+        struct stage_threads *stage = &p->stages[s];
+        stage->pipeline = p;
+        stage->id = s;
+        stage->threads = sizes[s];
+        stage->tids = malloc(sizeof(pthread_t) * sizes[s]);
+        if (!stage->tids) err = 1;
+    }
+    // Later stages start first, so an early one always has somewhere to push.
+    for (int s = BLOB_STAGE_COUNT - 1; s >= 0 && !err; s--) {
+        struct stage_threads *stage = &p->stages[s];
+        for (; stage->started < stage->threads; stage->started++) {
+            if (pthread_create(&stage->tids[stage->started], NULL, stage_thread, stage) != 0) {
+                err = 1;
+                break;
+            }
+        }
+    }
+    if (err) {
+        fprintf(stderr, "Warning: could not start the blob pipeline; storing files on the worker pool.\n");
+        stop_stages(p);
+        free_pipeline(p);
+        return NULL;
+    }
+    return p;
+}
+
+int blob_pipeline_submit(struct blob_pipeline *p, const char *filepath, size_t size,
+                         blob_done_fn done, void *arg) {
+    struct blob_job *job = calloc(1, sizeof(struct blob_job));
+    if (!job || !(job->filepath = strdup(filepath))) {
+        free(job);
+        return -1;
+    }
+    job->size = size;
+    job->buffer_slot = job->deflated_slot = -1;
+    job->done = done;
+    job->arg = arg;
+    long blocked_ns = 0; // Submitters are not a stage
+    if (queue_push(&p->queues[BLOB_STAGE_READ], &job, 1, &blocked_ns) != 1) {
+        free(job->filepath);
+        free(job);
+        return -1;
+    }
+    return 0;
+}
+
+void blob_pipeline_finish(struct blob_pipeline *p) {
+    if (!p) return;
+    stop_stages(p);
+
+    double wall_ns = now_ns() - p->start_ns;
+    if (wall_ns <= 0) wall_ns = 1;
+    for (int s = 0; s < BLOB_STAGE_COUNT; s++) {
+        struct stage_threads *stage = &p->stages[s];
+        struct blob_stage_stats *st = &last_stats[s];
+        st->name = stage_names[s];
+        st->threads = stage->threads;
+        st->items = stage->items;
+        st->busy = stage->busy_ns / (wall_ns * stage->threads);
+        st->blocked = stage->blocked_ns / (wall_ns * stage->threads);
+        st->uring = stage->uring;
+    }
+    have_last_stats = last_stats[BLOB_STAGE_READ].items > 0;
+    free_pipeline(p);
+}
+
+int blob_pipeline_stats(struct blob_stage_stats out[BLOB_STAGE_COUNT]) {
+    if (!have_last_stats) return 0;
+    memcpy(out, last_stats, sizeof(last_stats));
+    return 1;
+}
@@ -5,93 +5,348 @@
 #include <sys/stat.h>
 #include <unistd.h>
 #include <errno.h>
+#include <fcntl.h>
 
 #include "checkout.h"
 #include "database.h"
+#include "object_view.h"
+#include "index.h"
+#include "tree.h"
+#include "diff.h"
+#include "sparse.h"
+#include "worker_pool.h"
 #include "utils.h"
 
-// Recursively delete a directory's contents, but NOT the dir itself
-static void clean_directory(const char *path) {
-    DIR *d = opendir(path);
-    if (!d) return;
-
-    struct dirent *entry;
-    while ((entry = readdir(d)) != NULL) {
-        if (strcmp(entry->d_name, ".") == 0 || 
-            strcmp(entry->d_name, "..") == 0 ||
-            strcmp(entry->d_name, ".minivcs") == 0 ||
-	    strcmp(entry->d_name, "version_forge") == 0) { // IMPORTANT: Skip .minivcs and version_forge
+// --- Planning ---
+// The checkout is the diff between the HEAD tree and the target tree.
+// Local changes (the diff between HEAD and the working tree) may stay as
+// long as the checkout does not touch the same paths.
+
+struct checkout_change {
+    char change;                // DIFF_ADDED, DIFF_MODIFIED or DIFF_DELETED
+    char *path;
+    unsigned char sha1[SHA_DIGEST_LENGTH]; // Target blob (unset for deletions)
+    int untracked_clash;        // Enters the cone where a file already exists
+    size_t dir_len;             // Length of the parent directory in 'path' (0 at the root)
+    struct stat st;             // Stat data of the written file
+    int written;                // Set by the worker once the file is complete
+};
+
+// Which paths a diff pass covers: those in 'inside' (and in 'also', if
+// set) that are not wholly covered by 'outside' (if set). A NULL cone is
+// the full tree.
+struct cone_filter {
+    const struct sparse_cone *inside;
+    const struct sparse_cone *also;
+    int has_also;
+    const struct sparse_cone *outside;
+    int has_outside;
+};
+
+struct change_list {
+    struct checkout_change *items;
+    int count;
+    int capacity;
+    int failed;
+    const struct cone_filter *filter;
+};
+
+static int cone_covers(const struct sparse_cone *cone, const char *path, int is_dir) {
+    return is_dir ? sparse_match_dir(cone, path) == SPARSE_RECURSIVE : sparse_match_file(cone, path);
+}
+
+static int filter_change(const char *path, int is_dir, void *data) {
+    const struct cone_filter *f = ((struct change_list *)data)->filter;
+    return sparse_match_path(path, is_dir, (void *)f->inside) &&
+           (!f->has_also || sparse_match_path(path, is_dir, (void *)f->also)) &&
+           (!f->has_outside || !cone_covers(f->outside, path, is_dir));
+}
+
+static void collect_change(char change, const char *path, const unsigned char *old_sha1,
+                           const unsigned char *new_sha1, void *data) {
+    (void)old_sha1;
+    struct change_list *list = (struct change_list *)data;
+    if (list->failed) return;
+    if (list->count >= list->capacity) {
+        int new_capacity = list->capacity ? list->capacity * 2 : 64;
+        struct checkout_change *grown = realloc(list->items, sizeof(struct checkout_change) * new_capacity);
+        if (!grown) { list->failed = 1; return; }
+        list->items = grown;
+        list->capacity = new_capacity;
+    }
+    struct checkout_change *c = &list->items[list->count];
+    c->change = change;
+    c->untracked_clash = 0;
+    c->path = strdup(path);
+    if (!c->path) { list->failed = 1; return; }
+    if (new_sha1) memcpy(c->sha1, new_sha1, SHA_DIGEST_LENGTH);
+    list->count++;
+}
+
+static void change_list_free(struct change_list *list) {
+    for (int i = 0; i < list->count; i++) free(list->items[i].path);
+    free(list->items);
+}
+
+static int compare_change_paths(const void *a, const void *b) {
+    return strcmp(((const struct checkout_change *)a)->path, ((const struct checkout_change *)b)->path);
+}
+
+// First local change whose path is >= key (local changes are sorted by path).
+static int local_lower_bound(const struct change_list *local, const char *key) {
+    int lo = 0, hi = local->count;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (strcmp(local->items[mid].path, key) < 0) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+static int has_local_change(const struct change_list *local, const char *path) {
+    int i = local_lower_bound(local, path);
+    return i < local->count && strcmp(local->items[i].path, path) == 0;
+}
+
+// A checkout change collides with a local change at the same path, under
+// it (the path becomes a file where local files exist), or above it (a
+// local file sits where the checkout needs a directory).
+static int conflicts_with_local(const struct change_list *local, const char *path) {
+    if (has_local_change(local, path)) return 1;
+
+    char prefix[1024];
+    size_t len = snprintf(prefix, sizeof(prefix), "%s/", path);
+    if (len < sizeof(prefix)) {
+        int i = local_lower_bound(local, prefix);
+        if (i < local->count && strncmp(local->items[i].path, prefix, len) == 0) return 1;
+    }
+
+    for (const char *slash = strchr(path, '/'); slash; slash = strchr(slash + 1, '/')) {
+        snprintf(prefix, sizeof(prefix), "%.*s", (int)(slash - path), path);
+        if (has_local_change(local, prefix)) return 1;
+    }
+    return 0;
+}
+
+// --- Applying ---
+// A pipeline: the main thread removes what goes away, creates every
+// directory and groups the files to write by directory; workers then
+// inflate the blobs and write them, one batch of a directory at a time,
+// so threads mostly work in different directories. Each worker records
+// the stat data of what it wrote for the index refresh.
+
+// Files per worker task; a huge directory is still split across workers.
+#define CHECKOUT_BATCH 64
+
+struct write_batch {
+    struct checkout_change *items;
+    int count;
+    int *errors;                // Shared failure counter
+};
+
+// Removes the directories above 'path' that the deletion left empty.
+static void remove_empty_parents(const char *path) {
+    char dir[1024];
+    snprintf(dir, sizeof(dir), "%s", path);
+    char *slash;
+    while ((slash = strrchr(dir, '/')) != NULL) {
+        *slash = '\0';
+        if (rmdir(dir) != 0) break; // Not empty (or already gone)
+    }
+}
+
+// mkdir -p, optimistic: one call when only the last component is missing.
+static int make_dirs(const char *dir, size_t len) {
+    char path[1024];
+    if (len == 0) return 0;
+    if (len >= sizeof(path)) return -1;
+    memcpy(path, dir, len);
+    path[len] = '\0';
+    if (mkdir(path, 0755) == 0 || errno == EEXIST) return 0;
+    if (errno != ENOENT) return -1;
+
+    const char *slash = strrchr(path, '/');
+    if (!slash || make_dirs(path, slash - path) != 0) return -1;
+    return mkdir(path, 0755) == 0 || errno == EEXIST ? 0 : -1;
+}
+
+static int write_blob_file(struct checkout_change *c) {
+    char hex[41];
+    sha1_bin_to_hex(c->sha1, hex);
+    // Each blob is written once: read it past the cache, which keeps trees.
+    struct object_view *blob = object_view_read(hex);
+    if (!blob) return -1;
+    if (strcmp(object_view_type(blob), "blob") != 0) {
+        object_view_release(blob);
+        return -1;
+    }
+
+    int fd = open(c->path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        object_view_release(blob);
+        return -1;
+    }
+    const char *data = object_view_data(blob);
+    size_t size = object_view_size(blob);
+    size_t done = 0;
+    while (done < size) {
+        ssize_t n = write(fd, data + done, size - done);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        done += n;
+    }
+    object_view_release(blob);
+    int ok = done == size && fstat(fd, &c->st) == 0;
+    if (close(fd) != 0) ok = 0;
+    return ok ? 0 : -1;
+}
+
+static void write_batch_task(void *arg) {
+    struct write_batch *batch = (struct write_batch *)arg;
+    for (int i = 0; i < batch->count; i++) {
+        struct checkout_change *c = &batch->items[i];
+        if (write_blob_file(c) == 0) {
+            c->written = 1;
+        } else {
+            fprintf(stderr, "Error: could not write %s\n", c->path);
+            __atomic_fetch_add(batch->errors, 1, __ATOMIC_RELAXED);
+        }
+    }
+    free(batch);
+}
+
+// Deletions (ordered first by the sort), then directory groups.
+static int compare_for_apply(const void *a, const void *b) {
+    const struct checkout_change *ca = a;
+    const struct checkout_change *cb = b;
+    int del_a = ca->change == DIFF_DELETED, del_b = cb->change == DIFF_DELETED;
+    if (del_a != del_b) return del_b - del_a;
+    size_t len = ca->dir_len < cb->dir_len ? ca->dir_len : cb->dir_len;
+    int cmp = memcmp(ca->path, cb->path, len);
+    if (cmp != 0) return cmp;
+    if (ca->dir_len != cb->dir_len) return ca->dir_len < cb->dir_len ? -1 : 1;
+    return strcmp(ca->path + ca->dir_len, cb->path + cb->dir_len);
+}
+
+// Deletions go first, so a path that turns from a directory into a file
+// (or back) is free by the time it is written. Writes run on 'group';
+// wait for it before reading 'written' and 'st'.
+static int apply_changes(threadpool_group_t *group, struct change_list *changes, int *write_errors) {
+    int errors = 0;
+    for (int i = 0; i < changes->count; i++) {
+        struct checkout_change *c = &changes->items[i];
+        const char *slash = strrchr(c->path, '/');
+        c->dir_len = slash ? (size_t)(slash - c->path) : 0;
+        c->written = 0;
+    }
+    qsort(changes->items, changes->count, sizeof(struct checkout_change), compare_for_apply);
+
+    int i = 0;
+    for (; i < changes->count && changes->items[i].change == DIFF_DELETED; i++) {
+        struct checkout_change *c = &changes->items[i];
+        if (unlink(c->path) != 0 && errno != ENOENT) {
+            fprintf(stderr, "Error: could not remove %s: %s\n", c->path, strerror(errno));
+            errors++;
             continue;
         }
+        remove_empty_parents(c->path);
+    }
 
-        char full_path[1024];
-        snprintf(full_path, sizeof(full_path), "%s/%s", path, entry->d_name);
-        
-        struct stat s;
-        if (lstat(full_path, &s) != 0) continue; // Use lstat for symlinks, etc.
+    while (i < changes->count) {
+        struct checkout_change *first = &changes->items[i];
+        int end = i + 1;
+        while (end < changes->count && changes->items[end].dir_len == first->dir_len &&
+               memcmp(changes->items[end].path, first->path, first->dir_len) == 0) end++;
 
-        if (S_ISDIR(s.st_mode)) {
-            clean_directory(full_path); // Recurse
-            rmdir(full_path);
-        } else {
-            unlink(full_path); // Delete file
+        if (make_dirs(first->path, first->dir_len) != 0) {
+            fprintf(stderr, "Error: could not create directory for %s\n", first->path);
+            errors += end - i;
+            i = end;
+            continue;
+        }
+        for (; i < end; i += CHECKOUT_BATCH) {
+            struct write_batch *batch = malloc(sizeof(struct write_batch));
+            if (!batch) { errors += end - i; break; }
+            batch->items = &changes->items[i];
+            batch->count = end - i < CHECKOUT_BATCH ? end - i : CHECKOUT_BATCH;
+            batch->errors = write_errors;
+            if (threadpool_group_submit(group, write_batch_task, batch) != 0) write_batch_task(batch);
         }
+        i = end;
     }
-    closedir(d);
+    return errors ? -1 : 0;
 }
 
-// Recursively restore a tree object to the given path
-static int restore_tree(const char *tree_hash, const char *path) {
-    char *type = NULL;
-    char *data = NULL;
-    size_t size = 0;
+// Brings the index refreshed before the checkout up to date with what it
+// changed, so the next status does not rehash the files just written.
+static void refresh_index(struct index *index, const struct change_list *changes) {
+    for (int i = 0; i < changes->count; i++) index_remove_path(index, changes->items[i].path);
+    for (int i = 0; i < changes->count; i++) {
+        const struct checkout_change *c = &changes->items[i];
+        if (c->written) index_add(index, c->path, &c->st, c->sha1, INDEX_ENTRY_STORED);
+    }
+}
+
+// The changes: HEAD -> target inside both cones, plus, when the cone
+// changed, the target's files entering it and HEAD's files leaving it.
+// 'local' gets the working tree's changes inside the applied cone.
+static int plan_checkout(struct index *index, const char *old_tree, const char *new_tree,
+                         const struct sparse_cone *applied, const struct sparse_cone *wanted,
+                         struct change_list *changes, struct change_list *local) {
+    struct cone_filter local_filter = { applied, NULL, 0, NULL, 0 };
+    struct cone_filter both = { applied, wanted, 1, NULL, 0 };
+    struct cone_filter entering = { wanted, NULL, 0, applied, 1 };
+    struct cone_filter leaving = { applied, NULL, 0, wanted, 1 };
+    int sparse = applied || wanted;
+
+    local->filter = &local_filter;
+    if (diff_tree_to_index(old_tree, index, applied ? filter_change : NULL, collect_change, local) != 0) return -1;
+    changes->filter = &both;
+    if (diff_trees(old_tree, new_tree, sparse ? filter_change : NULL, collect_change, changes) != 0) return -1;
+
+    if (!sparse_same_cone(applied, wanted)) {
+        int first_entering = changes->count;
+        changes->filter = &entering;
+        if (diff_trees(NULL, new_tree, filter_change, collect_change, changes) != 0) return -1;
+        // Nothing was checked out there, so anything on disk is untracked.
+        struct stat st;
+        for (int i = first_entering; i < changes->count; i++)
+            changes->items[i].untracked_clash = lstat(changes->items[i].path, &st) == 0;
+        changes->filter = &leaving;
+        if (diff_trees(old_tree, NULL, filter_change, collect_change, changes) != 0) return -1;
+    }
+    return local->failed || changes->failed ? -1 : 0;
+}
 
-    if (read_object(tree_hash, &type, &data, &size) != 0) return -1;
-    if (strcmp(type, "tree") != 0) {
-        free(type); free(data);
+// Reads a commit's tree hash, checking the type first so that a blob hash
+// is rejected without inflating it.
+static int commit_tree_hash(const char *commit_hash, char *out_tree_hash) {
+    char header_type[OBJECT_TYPE_MAX];
+    size_t size = 0;
+    if (read_object_header(commit_hash, header_type, &size) != 0) {
+        fprintf(stderr, "Error: Could not read object %s\n", commit_hash);
+        return -1;
+    }
+    if (strcmp(header_type, "commit") != 0) {
+        fprintf(stderr, "Error: Object %s is not a commit.\n", commit_hash);
         return -1;
     }
 
-    char *ptr = data;
-    while (ptr < data + size) {
-        char *mode = ptr;
-        char *name_start = strchr(ptr, ' ');
-        if (!name_start) break;
-        *name_start = '\0';
-        ptr = name_start + 1;
-
-        char *name = ptr;
-        char *sha1_start = strchr(ptr, '\0');
-        if (!sha1_start) break;
-        ptr = sha1_start + 1 + SHA_DIGEST_LENGTH; // 1 for \0, 20 for hash
-        
-        unsigned char *sha1_bin = (unsigned char*)(sha1_start + 1);
-        char sha1_hex[41];
-        sha1_bin_to_hex(sha1_bin, sha1_hex);
-
-        char full_path[1024];
-        snprintf(full_path, sizeof(full_path), "%s/%s", path, name);
-
-        if (strcmp(mode, "040000") == 0) { // Directory
-            mkdir(full_path, 0755);
-            restore_tree(sha1_hex, full_path);
-        } else { // File
-            char *blob_type = NULL;
-            char *blob_data = NULL;
-            size_t blob_size = 0;
-            if (read_object(sha1_hex, &blob_type, &blob_data, &blob_size) == 0) {
-                FILE *f = fopen(full_path, "wb");
-                if (f) {
-                    fwrite(blob_data, 1, blob_size, f);
-                    fclose(f);
-                }
-                free(blob_type);
-                free(blob_data);
-            }
-        }
+    struct object_view *commit = object_view_open(commit_hash);
+    if (!commit) {
+        fprintf(stderr, "Error: Could not read object %s\n", commit_hash);
+        return -1;
     }
-    free(type);
-    free(data);
+    struct commit_view cv;
+    if (commit_view_parse(commit, &cv) != 0) {
+        fprintf(stderr, "Error: Commit %s has no tree.\n", commit_hash);
+        object_view_release(commit);
+        return -1;
+    }
+    object_slice_copy(cv.tree, out_tree_hash, 41);
+    object_view_release(commit);
     return 0;
 }
 
@@ -113,7 +368,6 @@ int do_checkout(const char *target) {
             fprintf(stderr, "Error: Could not read branch ref %s\n", target);
             return 1;
         }
-        printf("Switched to branch '%s'\n", target);
     } else {
         // Assume it is a commit hash
         if (strlen(target) != 40) {
@@ -121,38 +375,75 @@ int do_checkout(const char *target) {
             return 1;
         }
         strcpy(commit_hash, target);
-        printf("Note: checking out '%s'.\nYou are in 'detached HEAD' state.\n", target);
     }
 
-    // 2. Get tree from commit
-    char *type = NULL;
-    char *data = NULL;
-    size_t size = 0;
-    if (read_object(commit_hash, &type, &data, &size) != 0) {
-        fprintf(stderr, "Error: Could not read object %s\n", commit_hash);
-        return 1;
+    // 2. Trees of the target and of the current HEAD (if any)
+    if (commit_tree_hash(commit_hash, tree_hash) != 0) return 1;
+
+    char head_ref_path[256];
+    char head_commit[41];
+    char head_tree[41];
+    int has_head = resolve_ref("HEAD", head_ref_path) == 0 && read_ref(head_ref_path, head_commit) == 0;
+    if (has_head && commit_tree_hash(head_commit, head_tree) != 0) return 1;
+    const char *old_tree = has_head ? head_tree : NULL;
+
+    // 3. What the checkout changes, and what is changed locally. Refreshing
+    // the index here only rehashes files whose stat data moved.
+    struct sparse_cone *applied = sparse_load(SPARSE_APPLIED_FILE);
+    struct sparse_cone *wanted = sparse_load(SPARSE_CHECKOUT_FILE);
+    int cone_changed = !sparse_same_cone(applied, wanted);
+    struct change_list changes = {0};
+    struct change_list local = {0};
+    struct index *index = index_load();
+    int plan_status = -1;
+    if (index && hash_tree_indexed(get_worker_pool(), index, ".", NULL, NULL) >= 0 &&
+        plan_checkout(index, old_tree, tree_hash, applied, wanted, &changes, &local) == 0) {
+        plan_status = 0;
     }
-    if (strcmp(type, "commit") != 0) {
-        fprintf(stderr, "Error: Object %s is not a commit.\n", commit_hash);
-        free(type); free(data);
+    sparse_free(applied);
+    sparse_free(wanted);
+    if (plan_status != 0) {
+        fprintf(stderr, "Error: could not compare the working tree with %s.\n", target);
+        index_free(index);
+        change_list_free(&changes);
+        change_list_free(&local);
         return 1;
     }
 
-    char *tree_line = strstr(data, "tree ");
-    if (tree_line == NULL) {
-        free(type); free(data);
-        return -1;
+    qsort(local.items, local.count, sizeof(struct checkout_change), compare_change_paths);
+    int conflicts = 0;
+    for (int i = 0; i < changes.count; i++) {
+        if (!conflicts_with_local(&local, changes.items[i].path) && !changes.items[i].untracked_clash) continue;
+        if (conflicts++ == 0)
+            fprintf(stderr, "Error: Your local changes to the following files would be overwritten by checkout:\n");
+        fprintf(stderr, "\t%s\n", changes.items[i].path);
+    }
+    change_list_free(&local);
+    if (conflicts) {
+        fprintf(stderr, "Please commit your changes before you switch branches.\nAborting\n");
+        index_write(index);
+        index_free(index);
+        change_list_free(&changes);
+        return 1;
     }
-    strncpy(tree_hash, tree_line + 5, 40);
-    tree_hash[40] = '\0';
-    free(type);
-    free(data);
-
-    // 3. Clean working directory
-    clean_directory(".");
 
-    // 4. Restore tree
-    if (restore_tree(tree_hash, ".") != 0) {
+    // 4. Touch only the paths that differ between the two trees, then
+    // record the new stat data of every file written.
+    int write_errors = 0;
+    threadpool_group_t *group = threadpool_group_create(get_worker_pool());
+    int restore_status = group ? apply_changes(group, &changes, &write_errors) : -1;
+    if (group) {
+        threadpool_group_wait(group);
+        threadpool_group_destroy(group);
+    }
+    printf("Updated %d path%s\n", changes.count, changes.count == 1 ? "" : "s");
+    refresh_index(index, &changes);
+    index_write(index);
+    index_free(index);
+    change_list_free(&changes);
+    if (cone_changed && restore_status == 0 && !write_errors && sparse_mark_applied() != 0)
+        fprintf(stderr, "Warning: could not record the applied sparse-checkout patterns.\n");
+    if (restore_status != 0 || write_errors) {
         fprintf(stderr, "Error restoring tree.\n");
         return 1;
     }
@@ -170,5 +461,7 @@ int do_checkout(const char *target) {
         fclose(head);
     }
 
+    if (is_branch) printf("Switched to branch '%s'\n", target);
+    else printf("Note: checking out '%s'.\nYou are in 'detached HEAD' state.\n", target);
     return 0;
 }
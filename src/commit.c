@@ -6,57 +6,68 @@
 
 #include "commit.h"
 #include "tree.h"
+#include "blob_pipeline.h"
+#include "index.h"
 #include "utils.h"
 #include "database.h"
-#include "threadpool.h" 
+#include "object_view.h"
+#include "commit_graph.h"
+#include "worker_pool.h"
 #include "config.h" 
 
-#define THREAD_COUNT 8
-#define QUEUE_SIZE 256
-
 int do_commit(const char *message) {
     char root_tree_hex[41];
     unsigned char root_tree_bin[SHA_DIGEST_LENGTH];
 
-    // 1. Initialize Pool
-    printf("Initializing thread pool with %d threads...\n", THREAD_COUNT);
-    threadpool_t *pool = threadpool_create(THREAD_COUNT, QUEUE_SIZE);
-    if (!pool) {
-        fprintf(stderr, "Error creating thread pool.\n");
+    // 1. Shared worker pool (started once per process)
+    threadpool_t *pool = get_worker_pool();
+    printf("Using %d worker thread(s)...\n", worker_pool_size());
+
+    // 2. Build Tree from LIVE DISK (unchanged files come from the stat cache)
+    struct index *index = index_load();
+    int tree_status = write_tree_indexed(pool, index, ".", root_tree_hex, root_tree_bin);
+    if (index) {
+        printf("Index: %ld files rehashed, %ld taken from stat cache\n", index->misses, index->hits);
+        printf("Cache-tree: %ld trees rebuilt, %ld reused\n", index->trees_rebuilt, index->trees_reused);
+        index_write(index);
+        index_free(index);
+    }
+    struct blob_stage_stats stages[BLOB_STAGE_COUNT];
+    if (blob_pipeline_stats(stages)) {
+        // Busy time near 100% marks the bottleneck; 'blocked' means the next stage is behind.
+        printf("Blob pipeline (%ld files):\n", stages[BLOB_STAGE_READ].items);
+        for (int i = 0; i < BLOB_STAGE_COUNT; i++)
+            printf("  %-13s %2d thread(s) %4.0f%% busy %4.0f%% blocked%s\n", stages[i].name, stages[i].threads,
+                   stages[i].busy * 100, stages[i].blocked * 100, stages[i].uring ? " (io_uring)" : "");
+    }
+    if (tree_status == -1) {
+        fprintf(stderr, "Error: could not read or store every file; nothing was committed.\n");
         return -1;
     }
-
-    // 2. Build Tree from LIVE DISK
-    if (write_tree_recursive(pool, ".", root_tree_hex, root_tree_bin) != 0) {
+    if (tree_status != 0) {
         printf("nothing to commit (no files found in repository).\n");
-        threadpool_destroy(pool);
         return 0;
     }
-    threadpool_destroy(pool);
 
     // 3. Check against HEAD (Idempotency Check)
     char current_ref_path[256];
     char head_commit_hash[41];
     
     if (resolve_ref("HEAD", current_ref_path) == 0 && read_ref(current_ref_path, head_commit_hash) == 0) {
-        char *type, *data;
-        size_t sz;
-        if (read_object(head_commit_hash, &type, &data, &sz) == 0) {
-             char *tree_ptr = strstr(data, "tree ");
-             if (tree_ptr) {
-                 char head_tree_hex[41];
-                 strncpy(head_tree_hex, tree_ptr + 5, 40);
-                 head_tree_hex[40] = '\0';
-                 
-                 // If live disk tree matches HEAD tree, abort.
-                 if (strcmp(root_tree_hex, head_tree_hex) == 0) {
-                     printf("On branch main\nnothing to commit, working tree clean\n");
-                     free(type); free(data);
-                     return 0;
-                 }
+        struct object_view *head = object_view_open(head_commit_hash);
+        struct commit_view cv;
+        if (head && commit_view_parse(head, &cv) == 0) {
+             char head_tree_hex[41];
+             object_slice_copy(cv.tree, head_tree_hex, sizeof(head_tree_hex));
+
+             // If live disk tree matches HEAD tree, abort.
+             if (strcmp(root_tree_hex, head_tree_hex) == 0) {
+                 printf("On branch main\nnothing to commit, working tree clean\n");
+                 object_view_release(head);
+                 return 0;
              }
-             free(type); free(data);
         }
+        object_view_release(head);
     }
 
     printf("Root tree: %s\n", root_tree_hex);
@@ -86,10 +97,26 @@ int do_commit(const char *message) {
                    author_str, timestamp, timezone, author_str, timestamp, timezone, message);
     
     char new_commit[41];
-    write_object(content, len, "commit", new_commit, NULL);
+    if (write_object(content, len, "commit", new_commit, NULL) != 0) {
+        fprintf(stderr, "Error writing commit object.\n");
+        free(content);
+        return -1;
+    }
     free(content);
+
+    // The ref must never point at objects that could be lost in a crash.
+    long written, skipped;
+    object_write_stats(&written, &skipped);
+    if (sync_written_objects() != 0) {
+        fprintf(stderr, "Error: could not flush new objects to disk; HEAD not updated.\n");
+        return -1;
+    }
+    printf("Objects: %ld written, %ld already stored\n", written, skipped);
     update_ref(current_ref_path, new_commit);
 
+    // Only the new commit is read; its parent is normally in the graph already.
+    commit_graph_update(new_commit);
+
     printf("[%s] %s\n", current_ref_path, new_commit);
     return 0;
 }
@@ -0,0 +1,595 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <openssl/sha.h>
+
+#include "commit_graph.h"
+#include "object_view.h"
+#include "utils.h"
+
+/*
+ * File layout (all integers big-endian):
+ *
+ *   "VFCG" | u32 version | u32 commit count | u32 extra edge count |
+ *   fanout[256] u32 | records[count] | extra edges[edge count] u32 |
+ *   SHA-1 of the above
+ *
+ *   record:  sha1[20] | tree[20] | u32 parent1 | u32 parent2 |
+ *            u32 generation | u64 commit time
+ *
+ * Records are sorted by SHA-1. Parents are record positions, or
+ * GRAPH_NO_PARENT. A commit with more than two parents has
+ * GRAPH_EXTRA_EDGES set in parent2, whose other bits index the extra edge
+ * list: parents 2.. in order, the last one marked with GRAPH_LAST_EDGE.
+ *
+ * Loading checks the header and the sizes, not the trailing checksum (that
+ * would mean reading the whole file on every command).
+ */
+#define GRAPH_MAGIC "VFCG"
+#define GRAPH_VERSION 1
+#define GRAPH_HEADER_SIZE 16
+#define GRAPH_FANOUT_SIZE (256 * 4)
+#define GRAPH_INFO_DIR ".minivcs/objects/info"
+#define GRAPH_LOCK_FILE COMMIT_GRAPH_FILE ".lock"
+
+#define REC_OFF_TREE 20
+#define REC_OFF_PARENT1 40
+#define REC_OFF_PARENT2 44
+#define REC_OFF_GENERATION 48
+#define REC_OFF_TIME 52
+#define GRAPH_RECORD_SIZE 60
+
+#define GRAPH_NO_PARENT 0x70000000u
+#define GRAPH_EXTRA_EDGES 0x80000000u
+#define GRAPH_LAST_EDGE 0x80000000u
+
+struct commit_graph {
+    unsigned char *map;
+    size_t size;
+    uint32_t count;
+    uint32_t edge_count;
+    const unsigned char *fanout;    // 256 x u32: commits with first byte <= i
+    const unsigned char *records;
+    const unsigned char *edges;
+};
+
+static struct commit_graph *graph = NULL;
+static int graph_loaded = 0;
+
+static void free_graph(struct commit_graph *g) {
+    if (!g) return;
+    if (g->map) munmap(g->map, g->size);
+    free(g);
+}
+
+static struct commit_graph *load_graph() {
+    int fd = open(COMMIT_GRAPH_FILE, O_RDONLY);
+    if (fd < 0) return NULL; // Not written yet
+    struct commit_graph *g = calloc(1, sizeof(struct commit_graph));
+    struct stat st;
+    if (g && fstat(fd, &st) == 0 && st.st_size > 0) {
+        g->map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (g->map == MAP_FAILED) g->map = NULL;
+        else g->size = st.st_size;
+    }
+    close(fd);
+    if (!g || !g->map) goto bad;
+
+    if (g->size < GRAPH_HEADER_SIZE + GRAPH_FANOUT_SIZE + SHA_DIGEST_LENGTH) goto bad;
+    if (memcmp(g->map, GRAPH_MAGIC, 4) != 0 || get_be32(g->map + 4) != GRAPH_VERSION) goto bad;
+    g->count = get_be32(g->map + 8);
+    g->edge_count = get_be32(g->map + 12);
+    g->fanout = g->map + GRAPH_HEADER_SIZE;
+    g->records = g->fanout + GRAPH_FANOUT_SIZE;
+    g->edges = g->records + (size_t)g->count * GRAPH_RECORD_SIZE;
+
+    size_t expected = GRAPH_HEADER_SIZE + GRAPH_FANOUT_SIZE + (size_t)g->count * GRAPH_RECORD_SIZE +
+                      (size_t)g->edge_count * 4 + SHA_DIGEST_LENGTH;
+    if (g->size != expected || get_be32(g->fanout + 255 * 4) != g->count) goto bad;
+    return g;
+
+bad:
+    fprintf(stderr, "Warning: ignoring invalid %s\n", COMMIT_GRAPH_FILE);
+    free_graph(g);
+    return NULL;
+}
+
+struct commit_graph *commit_graph_get() {
+    if (!graph_loaded) {
+        graph_loaded = 1;
+        graph = load_graph();
+    }
+    return graph;
+}
+
+static const unsigned char *record(const struct commit_graph *g, uint32_t pos) {
+    return g->records + (size_t)pos * GRAPH_RECORD_SIZE;
+}
+
+int commit_graph_find(const struct commit_graph *g, const unsigned char *sha1, uint32_t *pos) {
+    uint32_t lo = sha1[0] ? get_be32(g->fanout + (sha1[0] - 1) * 4) : 0;
+    uint32_t hi = get_be32(g->fanout + sha1[0] * 4);
+    if (hi > g->count) hi = g->count;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        int cmp = memcmp(record(g, mid), sha1, SHA_DIGEST_LENGTH);
+        if (cmp == 0) {
+            *pos = mid;
+            return 0;
+        }
+        if (cmp < 0) lo = mid + 1;
+        else hi = mid;
+    }
+    return -1;
+}
+
+int commit_graph_entry(const struct commit_graph *g, uint32_t pos, struct commit_graph_entry *out) {
+    if (pos >= g->count) return -1;
+    const unsigned char *rec = record(g, pos);
+    out->sha1 = rec;
+    out->tree = rec + REC_OFF_TREE;
+    out->generation = get_be32(rec + REC_OFF_GENERATION);
+    out->time = get_be64(rec + REC_OFF_TIME);
+    out->parent_count = 0;
+
+    uint32_t parent1 = get_be32(rec + REC_OFF_PARENT1);
+    uint32_t parent2 = get_be32(rec + REC_OFF_PARENT2);
+    if (parent1 != GRAPH_NO_PARENT) {
+        if (parent1 >= g->count) return -1;
+        out->parents[out->parent_count++] = parent1;
+    }
+    if (parent2 & GRAPH_EXTRA_EDGES) {
+        for (uint32_t i = parent2 & ~GRAPH_EXTRA_EDGES;; i++) {
+            if (i >= g->edge_count) return -1;
+            uint32_t edge = get_be32(g->edges + (size_t)i * 4);
+            uint32_t parent = edge & ~GRAPH_LAST_EDGE;
+            if (parent >= g->count) return -1;
+            if (out->parent_count < COMMIT_GRAPH_MAX_PARENTS) out->parents[out->parent_count++] = parent;
+            if (edge & GRAPH_LAST_EDGE) break;
+        }
+    } else if (parent2 != GRAPH_NO_PARENT) {
+        if (parent2 >= g->count) return -1;
+        out->parents[out->parent_count++] = parent2;
+    }
+    return 0;
+}
+
+const unsigned char *commit_graph_sha1(const struct commit_graph *g, uint32_t pos) {
+    return record(g, pos);
+}
+
+// --- Updating ---
+
+/* A commit that is not in the graph yet */
+struct new_commit {
+    unsigned char sha1[SHA_DIGEST_LENGTH];
+    unsigned char tree[SHA_DIGEST_LENGTH];
+    uint64_t time;
+    uint32_t generation;        // 0 until computed
+    uint32_t pos;               // Position in the new file
+    size_t parent_start;        // Into new_set.parents
+    int parent_count;
+};
+
+struct new_set {
+    struct new_commit *commits;
+    int count, capacity;
+    unsigned char (*parents)[SHA_DIGEST_LENGTH];
+    size_t parent_count, parent_capacity;
+    int *slots;                 // Open addressing over 'commits'; -1 is empty
+    size_t slot_count;          // A power of two
+};
+
+static int new_set_find(const struct new_set *set, const unsigned char *sha1) {
+    if (!set->slot_count) return -1;
+    size_t mask = set->slot_count - 1;
+    for (size_t i = get_be32(sha1) & mask; set->slots[i] >= 0; i = (i + 1) & mask) {
+        if (memcmp(set->commits[set->slots[i]].sha1, sha1, SHA_DIGEST_LENGTH) == 0) return set->slots[i];
+    }
+    return -1;
+}
+
+static void new_set_index(struct new_set *set, int index) {
+    size_t mask = set->slot_count - 1;
+    size_t i = get_be32(set->commits[index].sha1) & mask;
+    while (set->slots[i] >= 0) i = (i + 1) & mask;
+    set->slots[i] = index;
+}
+
+// Appends a commit (its parents follow with new_set_add_parent()).
+static struct new_commit *new_set_add(struct new_set *set, const unsigned char *sha1) {
+    if ((size_t)(set->count + 1) * 2 > set->slot_count) {
+        size_t slot_count = set->slot_count ? set->slot_count * 2 : 256;
+        int *slots = malloc(slot_count * sizeof(int));
+        if (!slots) return NULL;
+        free(set->slots);
+        set->slots = slots;
+        set->slot_count = slot_count;
+        memset(slots, 0xff, slot_count * sizeof(int));
+        for (int i = 0; i < set->count; i++) new_set_index(set, i);
+    }
+    if (set->count == set->capacity) {
+        int capacity = set->capacity ? set->capacity * 2 : 64;
+        struct new_commit *commits = realloc(set->commits, capacity * sizeof(struct new_commit));
+        if (!commits) return NULL;
+        set->commits = commits;
+        set->capacity = capacity;
+    }
+    struct new_commit *c = &set->commits[set->count];
+    memset(c, 0, sizeof(*c));
+    memcpy(c->sha1, sha1, SHA_DIGEST_LENGTH);
+    c->parent_start = set->parent_count;
+    new_set_index(set, set->count++);
+    return c;
+}
+
+static int new_set_add_parent(struct new_set *set, struct new_commit *c, const unsigned char *sha1) {
+    if (set->parent_count == set->parent_capacity) {
+        size_t capacity = set->parent_capacity ? set->parent_capacity * 2 : 64;
+        void *parents = realloc(set->parents, capacity * SHA_DIGEST_LENGTH);
+        if (!parents) return -1;
+        set->parents = parents;
+        set->parent_capacity = capacity;
+    }
+    memcpy(set->parents[set->parent_count++], sha1, SHA_DIGEST_LENGTH);
+    c->parent_count++;
+    return 0;
+}
+
+static void new_set_free(struct new_set *set) {
+    free(set->commits);
+    free(set->parents);
+    free(set->slots);
+}
+
+// The seconds after the committer's "<email>".
+static uint64_t commit_time(struct object_slice committer) {
+    const char *email_end = NULL;
+    for (size_t i = 0; i < committer.len; i++) {
+        if (committer.ptr[i] == '>') email_end = committer.ptr + i;
+    }
+    return email_end ? strtoull(email_end + 1, NULL, 10) : 0;
+}
+
+// Reads 'tip' and every ancestor the graph lacks, stopping at commits it has.
+static int collect_commits(struct new_set *set, const struct commit_graph *g, const unsigned char *tip) {
+    size_t depth = 0, capacity = 64;
+    unsigned char (*stack)[SHA_DIGEST_LENGTH] = malloc(capacity * SHA_DIGEST_LENGTH);
+    if (!stack) return -1;
+    memcpy(stack[depth++], tip, SHA_DIGEST_LENGTH);
+
+    int result = 0;
+    while (depth > 0 && result == 0) {
+        unsigned char sha1[SHA_DIGEST_LENGTH];
+        memcpy(sha1, stack[--depth], SHA_DIGEST_LENGTH);
+        uint32_t pos;
+        if ((g && commit_graph_find(g, sha1, &pos) == 0) || new_set_find(set, sha1) >= 0) continue;
+
+        // Each commit is read once, so it stays out of the object cache.
+        char hex[41];
+        sha1_bin_to_hex(sha1, hex);
+        struct object_view *view = object_view_read(hex);
+        struct commit_view cv;
+        if (!view || commit_view_parse(view, &cv) != 0) {
+            object_view_release(view);
+            result = -1;
+            break;
+        }
+
+        struct new_commit *c = new_set_add(set, sha1);
+        if (!c || sha1_hex_to_bin(object_slice_copy(cv.tree, hex, sizeof(hex)), c->tree) != 0) result = -1;
+        if (c) c->time = commit_time(cv.committer);
+        for (int i = 0; i < cv.parent_count && result == 0; i++) {
+            unsigned char parent[SHA_DIGEST_LENGTH];
+            if (cv.parents[i].len != 40 || sha1_hex_to_bin(object_slice_copy(cv.parents[i], hex, sizeof(hex)), parent) != 0 ||
+                new_set_add_parent(set, c, parent) != 0) {
+                result = -1;
+                break;
+            }
+            if (depth == capacity) {
+                capacity *= 2;
+                void *grown = realloc(stack, capacity * SHA_DIGEST_LENGTH);
+                if (!grown) {
+                    result = -1;
+                    break;
+                }
+                stack = grown;
+            }
+            memcpy(stack[depth++], parent, SHA_DIGEST_LENGTH);
+        }
+        object_view_release(view);
+    }
+    free(stack);
+    return result;
+}
+
+// A parent's generation, or 0 with 'pending' set when it is a new commit
+// whose own generation is not known yet.
+static uint32_t parent_generation(const struct commit_graph *g, const struct new_set *set,
+                                  const unsigned char *sha1, int *pending) {
+    uint32_t pos;
+    struct commit_graph_entry e;
+    if (g && commit_graph_find(g, sha1, &pos) == 0 && commit_graph_entry(g, pos, &e) == 0) return e.generation;
+    int index = new_set_find(set, sha1);
+    if (index < 0) return 0;
+    if (!set->commits[index].generation) *pending = index;
+    return set->commits[index].generation;
+}
+
+// Generations are computed parents first. The stack always holds a chain of
+// commits, each a parent of the one below it, so it never outgrows the set.
+static int compute_generations(const struct commit_graph *g, struct new_set *set) {
+    int *stack = malloc(set->count * sizeof(int));
+    if (!stack) return -1;
+    for (int i = 0; i < set->count; i++) {
+        if (set->commits[i].generation) continue;
+        int depth = 0;
+        stack[depth++] = i;
+        while (depth > 0) {
+            struct new_commit *c = &set->commits[stack[depth - 1]];
+            uint32_t generation = 1;
+            int pending = -1;
+            for (int p = 0; p < c->parent_count && pending < 0; p++) {
+                uint32_t parent = parent_generation(g, set, set->parents[c->parent_start + p], &pending);
+                if (parent + 1 > generation) generation = parent + 1;
+            }
+            if (pending >= 0) {
+                stack[depth++] = pending;
+            } else {
+                c->generation = generation;
+                depth--;
+            }
+        }
+    }
+    free(stack);
+    return 0;
+}
+
+static int compare_commits(const void *a, const void *b) {
+    const struct new_commit *ca = *(const struct new_commit *const *)a;
+    const struct new_commit *cb = *(const struct new_commit *const *)b;
+    return memcmp(ca->sha1, cb->sha1, SHA_DIGEST_LENGTH);
+}
+
+// Position of a parent in the new file.
+static uint32_t new_position(const struct commit_graph *g, const uint32_t *old_to_new,
+                             const struct new_set *set, const unsigned char *sha1) {
+    uint32_t pos;
+    if (g && commit_graph_find(g, sha1, &pos) == 0) return old_to_new[pos];
+    int index = new_set_find(set, sha1);
+    return index >= 0 ? set->commits[index].pos : GRAPH_NO_PARENT;
+}
+
+static int append_edge(uint32_t **edges, uint32_t *count, uint32_t *capacity, uint32_t edge) {
+    if (*count == *capacity) {
+        uint32_t grown = *capacity ? *capacity * 2 : 16;
+        uint32_t *list = realloc(*edges, grown * sizeof(uint32_t));
+        if (!list) return -1;
+        *edges = list;
+        *capacity = grown;
+    }
+    (*edges)[(*count)++] = edge;
+    return 0;
+}
+
+// Fills in one record; parents beyond the first go to the edge list when
+// there are more than two.
+static int put_record(unsigned char *rec, const unsigned char *sha1, const unsigned char *tree,
+                      uint32_t generation, uint64_t time, const uint32_t *parents, int parent_count,
+                      uint32_t **edges, uint32_t *edge_count, uint32_t *edge_capacity) {
+    memcpy(rec, sha1, SHA_DIGEST_LENGTH);
+    memcpy(rec + REC_OFF_TREE, tree, SHA_DIGEST_LENGTH);
+    put_be32(rec + REC_OFF_PARENT1, parent_count > 0 ? parents[0] : GRAPH_NO_PARENT);
+    if (parent_count > 2) {
+        put_be32(rec + REC_OFF_PARENT2, GRAPH_EXTRA_EDGES | *edge_count);
+        for (int i = 1; i < parent_count; i++) {
+            uint32_t edge = parents[i] | (i == parent_count - 1 ? GRAPH_LAST_EDGE : 0);
+            if (append_edge(edges, edge_count, edge_capacity, edge) != 0) return -1;
+        }
+    } else {
+        put_be32(rec + REC_OFF_PARENT2, parent_count > 1 ? parents[1] : GRAPH_NO_PARENT);
+    }
+    put_be32(rec + REC_OFF_GENERATION, generation);
+    put_be64(rec + REC_OFF_TIME, time);
+    return 0;
+}
+
+static int write_file(const unsigned char *buffer, size_t total) {
+    if (mkdir(GRAPH_INFO_DIR, 0755) != 0 && errno != EEXIST) {
+        perror("Error creating " GRAPH_INFO_DIR);
+        return -1;
+    }
+    // Written beside the real file and renamed over it, like the index.
+    int fd = open(GRAPH_LOCK_FILE, O_WRONLY | O_CREAT | O_EXCL, 0644);
+    if (fd < 0) {
+        if (errno == EEXIST) fprintf(stderr, "Warning: %s exists; commit graph not updated.\n", GRAPH_LOCK_FILE);
+        else perror("Error creating commit graph lock file");
+        return -1;
+    }
+    size_t written = 0;
+    while (written < total) {
+        ssize_t n = write(fd, buffer + written, total - written);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        written += n;
+    }
+    if (written != total || fsync(fd) != 0) {
+        perror("Error writing commit graph");
+        close(fd);
+        unlink(GRAPH_LOCK_FILE);
+        return -1;
+    }
+    close(fd);
+    if (rename(GRAPH_LOCK_FILE, COMMIT_GRAPH_FILE) != 0) {
+        perror("Error updating commit graph");
+        unlink(GRAPH_LOCK_FILE);
+        return -1;
+    }
+    return 0;
+}
+
+// Merges the new commits into the old table. Old records are copied with
+// their parent positions renumbered; nothing is read back from objects.
+static int write_graph(const struct commit_graph *g, struct new_set *set) {
+    uint32_t old_count = g ? g->count : 0;
+    uint32_t total = old_count + set->count;
+    struct new_commit **sorted = malloc(set->count * sizeof(struct new_commit *));
+    uint32_t *old_to_new = malloc((old_count ? old_count : 1) * sizeof(uint32_t));
+    size_t records_end = GRAPH_HEADER_SIZE + GRAPH_FANOUT_SIZE + (size_t)total * GRAPH_RECORD_SIZE;
+    unsigned char *buffer = calloc(1, records_end);
+    uint32_t *edges = NULL, edge_count = 0, edge_capacity = 0;
+    int result = -1;
+    if (!sorted || !old_to_new || !buffer) goto out;
+
+    for (int j = 0; j < set->count; j++) sorted[j] = &set->commits[j];
+    qsort(sorted, set->count, sizeof(struct new_commit *), compare_commits);
+
+    // First pass: where every commit goes. Second pass: the records.
+    for (int pass = 0; pass < 2; pass++) {
+        uint32_t i = 0, out = 0;
+        int j = 0;
+        while (i < old_count || j < set->count) {
+            int take_old = j == set->count ||
+                           (i < old_count && memcmp(record(g, i), sorted[j]->sha1, SHA_DIGEST_LENGTH) < 0);
+            unsigned char *rec = buffer + GRAPH_HEADER_SIZE + GRAPH_FANOUT_SIZE + (size_t)out * GRAPH_RECORD_SIZE;
+            uint32_t parents[COMMIT_GRAPH_MAX_PARENTS];
+            if (take_old && pass == 0) {
+                old_to_new[i] = out;
+            } else if (take_old) {
+                struct commit_graph_entry e;
+                if (commit_graph_entry(g, i, &e) != 0) goto out;
+                for (int p = 0; p < e.parent_count; p++) parents[p] = old_to_new[e.parents[p]];
+                if (put_record(rec, e.sha1, e.tree, e.generation, e.time, parents, e.parent_count,
+                               &edges, &edge_count, &edge_capacity) != 0) goto out;
+            } else if (pass == 0) {
+                sorted[j]->pos = out;
+            } else {
+                struct new_commit *c = sorted[j];
+                int count = c->parent_count < COMMIT_GRAPH_MAX_PARENTS ? c->parent_count : COMMIT_GRAPH_MAX_PARENTS;
+                for (int p = 0; p < count; p++) {
+                    parents[p] = new_position(g, old_to_new, set, set->parents[c->parent_start + p]);
+                    if (parents[p] == GRAPH_NO_PARENT) goto out;
+                }
+                if (put_record(rec, c->sha1, c->tree, c->generation, c->time, parents, count,
+                               &edges, &edge_count, &edge_capacity) != 0) goto out;
+            }
+            if (take_old) i++;
+            else j++;
+            out++;
+        }
+    }
+
+    size_t file_size = records_end + (size_t)edge_count * 4 + SHA_DIGEST_LENGTH;
+    unsigned char *grown = realloc(buffer, file_size);
+    if (!grown) goto out;
+    buffer = grown;
+
+    memcpy(buffer, GRAPH_MAGIC, 4);
+    put_be32(buffer + 4, GRAPH_VERSION);
+    put_be32(buffer + 8, total);
+    put_be32(buffer + 12, edge_count);
+    uint32_t counts[256] = {0};
+    for (uint32_t i = 0; i < total; i++) {
+        counts[buffer[GRAPH_HEADER_SIZE + GRAPH_FANOUT_SIZE + (size_t)i * GRAPH_RECORD_SIZE]]++;
+    }
+    uint32_t cumulative = 0;
+    for (int b = 0; b < 256; b++) {
+        cumulative += counts[b];
+        put_be32(buffer + GRAPH_HEADER_SIZE + b * 4, cumulative);
+    }
+    for (uint32_t i = 0; i < edge_count; i++) put_be32(buffer + records_end + (size_t)i * 4, edges[i]);
+    SHA1(buffer, file_size - SHA_DIGEST_LENGTH, buffer + file_size - SHA_DIGEST_LENGTH);
+
+    result = write_file(buffer, file_size);
+
+out:
+    free(sorted);
+    free(old_to_new);
+    free(buffer);
+    free(edges);
+    return result;
+}
+
+int commit_graph_update(const char *tip_hash) {
+    unsigned char tip[SHA_DIGEST_LENGTH];
+    if (sha1_hex_to_bin(tip_hash, tip) != 0) return -1;
+    struct commit_graph *g = commit_graph_get();
+    uint32_t pos;
+    if (g && commit_graph_find(g, tip, &pos) == 0) return 0;
+
+    struct new_set set = {0};
+    int result = collect_commits(&set, g, tip);
+    if (result == 0) result = compute_generations(g, &set);
+    if (result == 0) result = write_graph(g, &set);
+    new_set_free(&set);
+
+    if (result == 0) {
+        // The next commit_graph_get() maps the new file.
+        free_graph(graph);
+        graph = NULL;
+        graph_loaded = 0;
+    }
+    return result;
+}
+
+struct commit_graph *commit_graph_lookup(const char *hash, uint32_t *pos) {
+    unsigned char sha1[SHA_DIGEST_LENGTH];
+    if (sha1_hex_to_bin(hash, sha1) != 0) return NULL;
+    struct commit_graph *g = commit_graph_get();
+    if (g && commit_graph_find(g, sha1, pos) == 0) return g;
+    if (commit_graph_update(hash) != 0) return NULL;
+    g = commit_graph_get();
+    return g && commit_graph_find(g, sha1, pos) == 0 ? g : NULL;
+}
+
+int commit_graph_is_ancestor(const char *ancestor, const char *descendant) {
+    unsigned char a[SHA_DIGEST_LENGTH], d[SHA_DIGEST_LENGTH];
+    if (sha1_hex_to_bin(ancestor, a) != 0 || sha1_hex_to_bin(descendant, d) != 0) return -1;
+    if (commit_graph_update(ancestor) != 0 || commit_graph_update(descendant) != 0) return -1;
+    struct commit_graph *g = commit_graph_get();
+    uint32_t target, start;
+    struct commit_graph_entry e;
+    if (!g || commit_graph_find(g, a, &target) != 0 || commit_graph_find(g, d, &start) != 0) return -1;
+    if (target == start) return 1;
+    if (commit_graph_entry(g, target, &e) != 0) return -1;
+    uint32_t min_generation = e.generation;
+
+    // Each commit is pushed at most once.
+    unsigned char *seen = calloc(g->count, 1);
+    uint32_t *stack = malloc(g->count * sizeof(uint32_t));
+    int result = stack && seen ? 0 : -1;
+    int depth = 0;
+    if (result == 0) {
+        stack[depth++] = start;
+        seen[start] = 1;
+    }
+    while (depth > 0) {
+        uint32_t pos = stack[--depth];
+        if (pos == target) {
+            result = 1;
+            break;
+        }
+        if (commit_graph_entry(g, pos, &e) != 0) {
+            result = -1;
+            break;
+        }
+        // Anything at or below the ancestor's generation (other than the
+        // ancestor itself) cannot lead to it.
+        if (e.generation <= min_generation) continue;
+        for (int p = 0; p < e.parent_count; p++) {
+            if (seen[e.parents[p]]) continue;
+            seen[e.parents[p]] = 1;
+            stack[depth++] = e.parents[p];
+        }
+    }
+    free(seen);
+    free(stack);
+    return result;
+}
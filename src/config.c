@@ -69,3 +69,23 @@ int get_config_value(const char *key, char *buffer, size_t size) {
     fclose(f);
     return found ? 0 : -1;
 }
+
+size_t get_config_size(const char *key, size_t default_value) {
+    char value[256];
+    if (get_config_value(key, value, sizeof(value)) != 0) return default_value;
+
+    char *end;
+    unsigned long long n = strtoull(value, &end, 10);
+    if (end == value) return default_value;
+
+    switch (*end) {
+        case 'k': case 'K': n <<= 10; end++; break;
+        case 'm': case 'M': n <<= 20; end++; break;
+        case 'g': case 'G': n <<= 30; end++; break;
+    }
+    if (*end != '\0') {
+        fprintf(stderr, "Warning: ignoring invalid size '%s' for %s\n", value, key);
+        return default_value;
+    }
+    return (size_t)n;
+}
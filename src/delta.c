@@ -0,0 +1,243 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "delta.h"
+
+#define DELTA_BLOCK 16          // Bytes hashed per index entry
+#define DELTA_MAX_CHAIN 16      // Candidates tried per hash bucket
+#define DELTA_MAX_INSERT 127
+#define DELTA_MAX_COPY 0xffffff
+#define ROLL_BASE 257u
+
+struct delta_out {
+    unsigned char *buf;
+    size_t len;
+    size_t capacity;
+    size_t limit;               // 0 = unlimited
+};
+
+static int out_reserve(struct delta_out *out, size_t extra) {
+    if (out->limit && out->len + extra > out->limit) return -1;
+    if (out->len + extra <= out->capacity) return 0;
+    size_t new_capacity = out->capacity * 2;
+    while (new_capacity < out->len + extra) new_capacity *= 2;
+    unsigned char *grown = realloc(out->buf, new_capacity);
+    if (!grown) return -1;
+    out->buf = grown;
+    out->capacity = new_capacity;
+    return 0;
+}
+
+static int out_varint(struct delta_out *out, size_t value) {
+    if (out_reserve(out, 10) != 0) return -1;
+    do {
+        unsigned char c = value & 0x7f;
+        value >>= 7;
+        if (value) c |= 0x80;
+        out->buf[out->len++] = c;
+    } while (value);
+    return 0;
+}
+
+static int out_insert(struct delta_out *out, const unsigned char *data, size_t len) {
+    while (len > 0) {
+        size_t chunk = len > DELTA_MAX_INSERT ? DELTA_MAX_INSERT : len;
+        if (out_reserve(out, chunk + 1) != 0) return -1;
+        out->buf[out->len++] = (unsigned char)chunk;
+        memcpy(out->buf + out->len, data, chunk);
+        out->len += chunk;
+        data += chunk;
+        len -= chunk;
+    }
+    return 0;
+}
+
+static int out_copy(struct delta_out *out, size_t offset, size_t len) {
+    while (len > 0) {
+        size_t chunk = len > DELTA_MAX_COPY ? DELTA_MAX_COPY : len;
+        if (out_reserve(out, 8) != 0) return -1;
+        size_t op_pos = out->len++;
+        unsigned char op = 0x80;
+        for (int i = 0; i < 4; i++) {
+            unsigned char b = (offset >> (8 * i)) & 0xff;
+            if (b) {
+                op |= 1 << i;
+                out->buf[out->len++] = b;
+            }
+        }
+        if (chunk != 0x10000) {
+            for (int i = 0; i < 3; i++) {
+                unsigned char b = (chunk >> (8 * i)) & 0xff;
+                if (b) {
+                    op |= 1 << (4 + i);
+                    out->buf[out->len++] = b;
+                }
+            }
+        }
+        out->buf[op_pos] = op;
+        offset += chunk;
+        len -= chunk;
+    }
+    return 0;
+}
+
+static uint32_t block_hash(const unsigned char *p) {
+    uint32_t h = 0;
+    for (int i = 0; i < DELTA_BLOCK; i++) h = h * ROLL_BASE + p[i];
+    return h;
+}
+
+void *create_delta(const void *source, size_t source_size,
+                   const void *target, size_t target_size,
+                   size_t max_delta_size, size_t *out_size) {
+    const unsigned char *src = source;
+    const unsigned char *trg = target;
+    if (source_size > UINT32_MAX || target_size > UINT32_MAX) return NULL;
+
+    // Index every aligned block of the source by its hash.
+    size_t block_count = source_size / DELTA_BLOCK;
+    size_t table_size = 1;
+    while (table_size < block_count) table_size <<= 1;
+    uint32_t mask = (uint32_t)table_size - 1;
+    int32_t *heads = malloc(sizeof(int32_t) * table_size);
+    int32_t *chain = malloc(sizeof(int32_t) * (block_count ? block_count : 1));
+    if (!heads || !chain) {
+        free(heads); free(chain);
+        return NULL;
+    }
+    memset(heads, 0xff, sizeof(int32_t) * table_size);
+    for (size_t b = 0; b < block_count; b++) {
+        uint32_t h = block_hash(src + b * DELTA_BLOCK) & mask;
+        chain[b] = heads[h];
+        heads[h] = (int32_t)b;
+    }
+
+    // B^(DELTA_BLOCK-1), to drop the outgoing byte from the rolling hash
+    uint32_t top_power = 1;
+    for (int i = 0; i < DELTA_BLOCK - 1; i++) top_power *= ROLL_BASE;
+
+    struct delta_out out;
+    out.capacity = target_size / 2 + 64;
+    out.buf = malloc(out.capacity);
+    out.len = 0;
+    out.limit = max_delta_size;
+    int failed = !out.buf || out_varint(&out, source_size) != 0 || out_varint(&out, target_size) != 0;
+
+    size_t pos = 0, literal_start = 0;
+    uint32_t h = target_size >= DELTA_BLOCK ? block_hash(trg) : 0;
+    while (!failed && block_count && pos + DELTA_BLOCK <= target_size) {
+        size_t best_len = 0, best_offset = 0;
+        int tries = 0;
+        for (int32_t b = heads[h & mask]; b >= 0 && tries < DELTA_MAX_CHAIN; b = chain[b], tries++) {
+            size_t offset = (size_t)b * DELTA_BLOCK;
+            if (memcmp(src + offset, trg + pos, DELTA_BLOCK) != 0) continue;
+            size_t len = DELTA_BLOCK;
+            while (offset + len < source_size && pos + len < target_size &&
+                   src[offset + len] == trg[pos + len]) len++;
+            if (len > best_len) {
+                best_len = len;
+                best_offset = offset;
+            }
+        }
+
+        if (best_len < DELTA_BLOCK) {
+            if (pos + DELTA_BLOCK < target_size)
+                h = (h - trg[pos] * top_power) * ROLL_BASE + trg[pos + DELTA_BLOCK];
+            pos++;
+            continue;
+        }
+
+        // Grow the match backwards over bytes we were about to insert.
+        while (best_offset > 0 && pos > literal_start && src[best_offset - 1] == trg[pos - 1]) {
+            best_offset--;
+            pos--;
+            best_len++;
+        }
+        if (out_insert(&out, trg + literal_start, pos - literal_start) != 0 ||
+            out_copy(&out, best_offset, best_len) != 0) {
+            failed = 1;
+            break;
+        }
+        pos += best_len;
+        literal_start = pos;
+        if (pos + DELTA_BLOCK <= target_size) h = block_hash(trg + pos);
+    }
+    if (!failed && out_insert(&out, trg + literal_start, target_size - literal_start) != 0) failed = 1;
+
+    free(heads);
+    free(chain);
+    if (failed) {
+        free(out.buf);
+        return NULL;
+    }
+    *out_size = out.len;
+    return out.buf;
+}
+
+static int read_varint(const unsigned char **ptr, const unsigned char *end, size_t *out) {
+    size_t value = 0;
+    int shift = 0;
+    unsigned char c;
+    do {
+        if (*ptr >= end || shift > 63) return -1;
+        c = *(*ptr)++;
+        value |= (size_t)(c & 0x7f) << shift;
+        shift += 7;
+    } while (c & 0x80);
+    *out = value;
+    return 0;
+}
+
+void *apply_delta(const void *source, size_t source_size,
+                  const void *delta, size_t delta_size, size_t *out_size) {
+    const unsigned char *ptr = delta;
+    const unsigned char *end = ptr + delta_size;
+    size_t expected_source, target_size;
+    if (read_varint(&ptr, end, &expected_source) != 0 || expected_source != source_size ||
+        read_varint(&ptr, end, &target_size) != 0) {
+        return NULL;
+    }
+
+    unsigned char *target = malloc(target_size + 1);
+    if (!target) return NULL;
+    size_t pos = 0;
+
+    while (ptr < end) {
+        unsigned char op = *ptr++;
+        if (op & 0x80) {
+            size_t offset = 0, len = 0;
+            for (int i = 0; i < 4; i++) {
+                if (!(op & (1 << i))) continue;
+                if (ptr >= end) goto corrupt;
+                offset |= (size_t)*ptr++ << (8 * i);
+            }
+            for (int i = 0; i < 3; i++) {
+                if (!(op & (1 << (4 + i)))) continue;
+                if (ptr >= end) goto corrupt;
+                len |= (size_t)*ptr++ << (8 * i);
+            }
+            if (len == 0) len = 0x10000;
+            if (offset + len > source_size || pos + len > target_size) goto corrupt;
+            memcpy(target + pos, (const unsigned char *)source + offset, len);
+            pos += len;
+        } else if (op) {
+            if (ptr + op > end || pos + op > target_size) goto corrupt;
+            memcpy(target + pos, ptr, op);
+            ptr += op;
+            pos += op;
+        } else {
+            goto corrupt; // Opcode 0 is reserved
+        }
+    }
+    if (pos != target_size) goto corrupt;
+
+    target[target_size] = '\0';
+    *out_size = target_size;
+    return target;
+
+corrupt:
+    free(target);
+    return NULL;
+}
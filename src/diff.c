@@ -0,0 +1,283 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "diff.h"
+#include "arena.h"
+#include "object_view.h"
+#include "utils.h"
+
+// --- Directory listings ---
+// Each side of a diff lists one directory at a time, as children sorted by
+// name (the order tree objects use). Only directories whose SHAs differ
+// are ever listed.
+//
+// Listings live in the walk's arena. A directory's pair of listings is
+// released when it has been diffed, so memory follows the depth of the
+// walk rather than the size of the trees.
+
+struct diff_entry {
+    char *name;
+    unsigned char sha1[SHA_DIGEST_LENGTH];
+    int is_dir;
+    int known;                  // sha1 is valid (an index directory may have no cache-tree entry)
+};
+
+struct diff_list {
+    struct arena *arena;
+    struct diff_entry *entries;
+    int count;
+    int capacity;
+};
+
+struct diff_side {
+    struct index *index;        // NULL: the side is a stored tree
+};
+
+struct diff_walk {
+    diff_filter filter;
+    diff_callback fn;
+    void *data;
+    struct arena *arena;
+};
+
+#define DIFF_ARENA_SIZE (16 * 1024)
+
+static int list_add(struct diff_list *list, const char *name, size_t name_len,
+                    const unsigned char *sha1, int is_dir) {
+    if (list->count >= list->capacity) {
+        int new_capacity = list->capacity ? list->capacity * 2 : 16;
+        struct diff_entry *grown = arena_grow(list->arena, list->entries, sizeof(struct diff_entry) * list->capacity,
+                                              sizeof(struct diff_entry) * new_capacity);
+        if (!grown) return -1;
+        list->entries = grown;
+        list->capacity = new_capacity;
+    }
+    struct diff_entry *e = &list->entries[list->count];
+    e->name = arena_strndup(list->arena, name, name_len);
+    if (!e->name) return -1;
+    e->is_dir = is_dir;
+    e->known = sha1 != NULL;
+    if (sha1) memcpy(e->sha1, sha1, SHA_DIGEST_LENGTH);
+    list->count++;
+    return 0;
+}
+
+static int list_tree(const unsigned char *sha1, struct diff_list *out) {
+    char hex[41];
+    sha1_bin_to_hex(sha1, hex);
+    struct object_view *tree = object_view_open(hex);
+    if (!tree) return -1;
+    struct tree_iter it;
+    if (tree_iter_init(&it, tree) != 0) {
+        object_view_release(tree);
+        return -1;
+    }
+
+    // Entries are already sorted by name.
+    struct tree_entry_view e;
+    int result;
+    while ((result = tree_iter_next(&it, &e)) == 1) {
+        if (list_add(out, e.name.ptr, e.name.len, e.sha1, e.is_dir) != 0) {
+            result = -1;
+            break;
+        }
+    }
+    object_view_release(tree);
+    return result;
+}
+
+// First entry whose path is >= key.
+static int entry_lower_bound(const struct index *idx, const char *key) {
+    int lo = 0, hi = idx->count;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (strcmp(idx->entries[mid].path, key) < 0) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+static const unsigned char *find_tree_sha1(const struct index *idx, const char *path) {
+    int lo = 0, hi = idx->tree_count - 1;
+    while (lo <= hi) {
+        int mid = lo + (hi - lo) / 2;
+        int cmp = strcmp(path, idx->trees[mid].path);
+        if (cmp == 0) return idx->trees[mid].sha1;
+        if (cmp < 0) hi = mid - 1;
+        else lo = mid + 1;
+    }
+    return NULL;
+}
+
+static int compare_diff_entries(const void *a, const void *b) {
+    return strcmp(((const struct diff_entry *)a)->name, ((const struct diff_entry *)b)->name);
+}
+
+// Lists the direct children of 'dir_path' from the sorted index entries.
+// Everything under a subdirectory is contiguous in path order, so it is
+// stepped over with one binary search.
+static int list_index_dir(const struct index *idx, const char *dir_path, struct diff_list *out) {
+    char prefix[1024];
+    size_t prefix_len = 0;
+    if (dir_path[0]) prefix_len = snprintf(prefix, sizeof(prefix), "%s/", dir_path);
+    else prefix[0] = '\0';
+    if (prefix_len >= sizeof(prefix)) return -1;
+
+    int i = entry_lower_bound(idx, prefix);
+    while (i < idx->count && strncmp(idx->entries[i].path, prefix, prefix_len) == 0) {
+        const struct index_entry *e = &idx->entries[i];
+        const char *name = e->path + prefix_len;
+        const char *slash = strchr(name, '/');
+        if (!slash) {
+            if (list_add(out, name, strlen(name), e->sha1, 0) != 0) return -1;
+            i++;
+            continue;
+        }
+
+        char sub_path[1024];
+        int len = snprintf(sub_path, sizeof(sub_path), "%.*s", (int)(slash - e->path), e->path);
+        if (len < 0 || (size_t)len + 1 >= sizeof(sub_path)) return -1;
+        if (list_add(out, name, slash - name, find_tree_sha1(idx, sub_path), 1) != 0) return -1;
+
+        // '0' sorts right after '/': skip every path under "sub_path/".
+        sub_path[len] = '0';
+        sub_path[len + 1] = '\0';
+        i = entry_lower_bound(idx, sub_path);
+    }
+
+    // Path order puts "a.txt" before "a/x", but tree order puts "a" before "a.txt".
+    qsort(out->entries, out->count, sizeof(struct diff_entry), compare_diff_entries);
+    return 0;
+}
+
+static int list_dir(const struct diff_side *side, const struct diff_entry *dir, const char *path,
+                    struct diff_list *out) {
+    if (!dir) return 0; // Absent: no children
+    if (side->index) return list_index_dir(side->index, path, out);
+    return list_tree(dir->sha1, out);
+}
+
+// --- Lockstep walk ---
+
+static int diff_dirs(struct diff_walk *walk, const struct diff_side *old_side, const struct diff_entry *old_dir,
+                     const struct diff_side *new_side, const struct diff_entry *new_dir, const char *path);
+
+static void child_path(const char *path, const char *name, char *out, size_t size) {
+    if (path[0]) snprintf(out, size, "%s/%s", path, name);
+    else snprintf(out, size, "%s", name);
+}
+
+// Reports one side of a path that exists only there (or changed type).
+static int diff_one_sided(struct diff_walk *walk, const struct diff_side *old_side, const struct diff_entry *old_e,
+                          const struct diff_side *new_side, const struct diff_entry *new_e, const char *path) {
+    const struct diff_entry *e = old_e ? old_e : new_e;
+    if (e->is_dir) return diff_dirs(walk, old_side, old_e, new_side, new_e, path);
+    if (old_e) walk->fn(DIFF_DELETED, path, old_e->sha1, NULL, walk->data);
+    else walk->fn(DIFF_ADDED, path, NULL, new_e->sha1, walk->data);
+    return 0;
+}
+
+static int diff_entries(struct diff_walk *walk, const struct diff_side *old_side, const struct diff_entry *old_e,
+                        const struct diff_side *new_side, const struct diff_entry *new_e, const char *path) {
+    if (!old_e || !new_e) return diff_one_sided(walk, old_side, old_e, new_side, new_e, path);
+
+    if (old_e->is_dir != new_e->is_dir) {
+        // Type change: the file side goes first so output stays in path order.
+        const struct diff_entry *file = old_e->is_dir ? new_e : old_e;
+        int result = diff_one_sided(walk, old_side, file == old_e ? old_e : NULL,
+                                    new_side, file == new_e ? new_e : NULL, path);
+        if (result != 0) return result;
+        return diff_one_sided(walk, old_side, file == old_e ? NULL : old_e,
+                              new_side, file == new_e ? NULL : new_e, path);
+    }
+
+    int same = old_e->known && new_e->known && memcmp(old_e->sha1, new_e->sha1, SHA_DIGEST_LENGTH) == 0;
+    if (same) return 0; // Equal blobs, or an equal subtree that is never read
+    if (old_e->is_dir) return diff_dirs(walk, old_side, old_e, new_side, new_e, path);
+    walk->fn(DIFF_MODIFIED, path, old_e->sha1, new_e->sha1, walk->data);
+    return 0;
+}
+
+static int diff_dirs(struct diff_walk *walk, const struct diff_side *old_side, const struct diff_entry *old_dir,
+                     const struct diff_side *new_side, const struct diff_entry *new_dir, const char *path) {
+    struct arena_mark mark = arena_mark(walk->arena);
+    struct diff_list old_list = { walk->arena }, new_list = { walk->arena };
+    int result = 0;
+    if (list_dir(old_side, old_dir, path, &old_list) != 0 ||
+        list_dir(new_side, new_dir, path, &new_list) != 0) {
+        result = -1;
+        goto out;
+    }
+
+    int i = 0, j = 0;
+    while (result == 0 && (i < old_list.count || j < new_list.count)) {
+        const struct diff_entry *old_e = i < old_list.count ? &old_list.entries[i] : NULL;
+        const struct diff_entry *new_e = j < new_list.count ? &new_list.entries[j] : NULL;
+        int cmp = !old_e ? 1 : !new_e ? -1 : strcmp(old_e->name, new_e->name);
+        if (cmp < 0) new_e = NULL;
+        if (cmp > 0) old_e = NULL;
+
+        if (old_e) i++;
+        if (new_e) j++;
+
+        char sub_path[1024];
+        child_path(path, (old_e ? old_e : new_e)->name, sub_path, sizeof(sub_path));
+        if (walk->filter) {
+            if (old_e && !walk->filter(sub_path, old_e->is_dir, walk->data)) old_e = NULL;
+            if (new_e && !walk->filter(sub_path, new_e->is_dir, walk->data)) new_e = NULL;
+            if (!old_e && !new_e) continue;
+        }
+        result = diff_entries(walk, old_side, old_e, new_side, new_e, sub_path);
+    }
+
+out:
+    arena_reset(walk->arena, mark);
+    return result;
+}
+
+// The root directory of a side: a stored tree, or nothing.
+static int root_entry(const char *tree_hex, struct diff_entry *out) {
+    memset(out, 0, sizeof(*out));
+    out->is_dir = 1;
+    if (!tree_hex) return 0;
+    if (sha1_hex_to_bin(tree_hex, out->sha1) != 0) return -1;
+    out->known = 1;
+    return 0;
+}
+
+int diff_trees(const char *old_tree_hex, const char *new_tree_hex, diff_filter filter,
+               diff_callback fn, void *data) {
+    struct diff_walk walk = { filter, fn, data, NULL };
+    struct diff_side tree_side = { NULL };
+    struct diff_entry old_root, new_root;
+    if (root_entry(old_tree_hex, &old_root) != 0 || root_entry(new_tree_hex, &new_root) != 0) return -1;
+    if (!(walk.arena = arena_create(DIFF_ARENA_SIZE))) return -1;
+    int result = diff_entries(&walk, &tree_side, old_tree_hex ? &old_root : NULL,
+                              &tree_side, new_tree_hex ? &new_root : NULL, "");
+    arena_destroy(walk.arena);
+    return result;
+}
+
+int diff_tree_to_index(const char *tree_hex, struct index *idx, diff_filter filter,
+                       diff_callback fn, void *data) {
+    struct diff_walk walk = { filter, fn, data, NULL };
+    struct diff_side tree_side = { NULL };
+    struct diff_side index_side = { idx };
+    struct diff_entry old_root, new_root;
+    if (root_entry(tree_hex, &old_root) != 0) return -1;
+
+    index_sort(idx);
+    memset(&new_root, 0, sizeof(new_root));
+    new_root.is_dir = 1;
+    const unsigned char *root_sha1 = find_tree_sha1(idx, "");
+    if (root_sha1) {
+        memcpy(new_root.sha1, root_sha1, SHA_DIGEST_LENGTH);
+        new_root.known = 1;
+    }
+    if (!(walk.arena = arena_create(DIFF_ARENA_SIZE))) return -1;
+    int result = diff_entries(&walk, &tree_side, tree_hex ? &old_root : NULL,
+                              &index_side, idx->count ? &new_root : NULL, "");
+    arena_destroy(walk.arena);
+    return result;
+}
@@ -0,0 +1,548 @@
+#define _GNU_SOURCE // For accept4
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <dirent.h>
+#include <poll.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/inotify.h>
+
+#include "fsmonitor.h"
+#include "vf_signals.h"
+
+#define WATCH_MASK (IN_MODIFY | IN_ATTRIB | IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | \
+                    IN_DELETE_SELF | IN_MOVE_SELF)
+#define REQUEST_MAX 256
+#define IO_TIMEOUT_SEC 2
+
+// --- Daemon State ---
+// Every event bumps 'seq' and stamps the changed path with it. The table
+// holds the last stamp per path, so a query for token T returns the paths
+// stamped after T.
+
+struct change_slot {
+    char *path;                 // NULL: free slot
+    uint64_t seq;
+};
+
+struct monitor {
+    int inotify_fd;
+    int listen_fd;
+    char **watch_paths;         // Worktree-relative directory per watch descriptor ("" for the root)
+    int watch_capacity;
+    int watch_count;
+    struct change_slot *slots;  // Open addressing, power-of-two capacity
+    size_t slot_capacity;
+    size_t slot_count;
+    uint64_t seq;
+    uint64_t reset_seq;         // Tokens older than this get a full scan
+    int blind;                  // A watch could not be added: always ask for a full scan
+    char instance[32];
+    int stop;
+};
+
+static uint64_t hash_path(const char *path) {
+    uint64_t h = 1469598103934665603ULL; // FNV-1a
+    for (; *path; path++) h = (h ^ (unsigned char)*path) * 1099511628211ULL;
+    return h;
+}
+
+static void forget_changes(struct monitor *m) {
+    for (size_t i = 0; i < m->slot_capacity; i++) free(m->slots[i].path);
+    memset(m->slots, 0, sizeof(struct change_slot) * m->slot_capacity);
+    m->slot_count = 0;
+    m->reset_seq = m->seq;
+}
+
+static struct change_slot *find_slot(struct change_slot *slots, size_t capacity, const char *path) {
+    size_t i = hash_path(path) & (capacity - 1);
+    while (slots[i].path && strcmp(slots[i].path, path) != 0) i = (i + 1) & (capacity - 1);
+    return &slots[i];
+}
+
+static int grow_slots(struct monitor *m) {
+    size_t capacity = m->slot_capacity ? m->slot_capacity * 2 : 1024;
+    struct change_slot *slots = calloc(capacity, sizeof(struct change_slot));
+    if (!slots) return -1;
+    for (size_t i = 0; i < m->slot_capacity; i++) {
+        if (m->slots[i].path) *find_slot(slots, capacity, m->slots[i].path) = m->slots[i];
+    }
+    free(m->slots);
+    m->slots = slots;
+    m->slot_capacity = capacity;
+    return 0;
+}
+
+static void record_change(struct monitor *m, const char *path) {
+    m->seq++;
+    if (m->slot_count >= FSMONITOR_MAX_CHANGES) forget_changes(m);
+    if (m->slot_count * 2 >= m->slot_capacity && grow_slots(m) != 0) {
+        forget_changes(m);
+        return;
+    }
+    struct change_slot *slot = find_slot(m->slots, m->slot_capacity, path);
+    if (!slot->path) {
+        if (!(slot->path = strdup(path))) {
+            forget_changes(m);
+            return;
+        }
+        m->slot_count++;
+    }
+    slot->seq = m->seq;
+}
+
+// --- Watches ---
+
+static int set_watch_path(struct monitor *m, int wd, const char *path) {
+    if (wd >= m->watch_capacity) {
+        int capacity = m->watch_capacity ? m->watch_capacity : 256;
+        while (capacity <= wd) capacity *= 2;
+        char **grown = realloc(m->watch_paths, sizeof(char *) * capacity);
+        if (!grown) return -1;
+        memset(grown + m->watch_capacity, 0, sizeof(char *) * (capacity - m->watch_capacity));
+        m->watch_paths = grown;
+        m->watch_capacity = capacity;
+    }
+    // Re-adding a watched directory (e.g., after a rename) returns the same descriptor.
+    if (m->watch_paths[wd]) free(m->watch_paths[wd]);
+    else m->watch_count++;
+    m->watch_paths[wd] = strdup(path);
+    return m->watch_paths[wd] ? 0 : -1;
+}
+
+// Watches 'rel_path' and every directory below it, the ones the tree walk visits.
+static int add_watches(struct monitor *m, const char *rel_path) {
+    const char *dir_path = rel_path[0] ? rel_path : ".";
+    int wd = inotify_add_watch(m->inotify_fd, dir_path, WATCH_MASK);
+    if (wd < 0) {
+        if (errno == ENOENT || errno == ENOTDIR) return 0; // Gone again already
+        fprintf(stderr, "fsmonitor: cannot watch '%s': %s\n", dir_path, strerror(errno));
+        if (errno == ENOSPC) fprintf(stderr, "fsmonitor: raise fs.inotify.max_user_watches\n");
+        return -1;
+    }
+    if (set_watch_path(m, wd, rel_path) != 0) return -1;
+
+    DIR *d = opendir(dir_path);
+    if (!d) return 0;
+    int result = 0;
+    struct dirent *entry;
+    while (result == 0 && (entry = readdir(d)) != NULL) {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0 ||
+            strcmp(entry->d_name, ".minivcs") == 0) continue;
+
+        char child[1024];
+        if (rel_path[0]) snprintf(child, sizeof(child), "%s/%s", rel_path, entry->d_name);
+        else snprintf(child, sizeof(child), "%s", entry->d_name);
+        // d_type spares a stat for everything but symlinks and file systems without it.
+        struct stat st;
+        int is_dir = entry->d_type == DT_DIR;
+        if (entry->d_type == DT_UNKNOWN || entry->d_type == DT_LNK)
+            is_dir = stat(child, &st) == 0 && S_ISDIR(st.st_mode);
+        if (is_dir) result = add_watches(m, child);
+    }
+    closedir(d);
+    return result;
+}
+
+static void handle_event(struct monitor *m, const struct inotify_event *ev) {
+    if (ev->mask & IN_Q_OVERFLOW) {
+        // Events were dropped: nothing before this point can be vouched for.
+        m->seq++;
+        forget_changes(m);
+        return;
+    }
+    if (ev->wd < 0 || ev->wd >= m->watch_capacity || !m->watch_paths[ev->wd]) return;
+    const char *dir = m->watch_paths[ev->wd];
+    if (ev->mask & IN_IGNORED) {
+        free(m->watch_paths[ev->wd]);
+        m->watch_paths[ev->wd] = NULL;
+        m->watch_count--;
+        return;
+    }
+    if (!dir[0] && ev->len && strcmp(ev->name, ".minivcs") == 0) return;
+
+    char path[1024];
+    if (!ev->len) snprintf(path, sizeof(path), "%s", dir);
+    else if (dir[0]) snprintf(path, sizeof(path), "%s/%s", dir, ev->name);
+    else snprintf(path, sizeof(path), "%s", ev->name);
+    record_change(m, path);
+
+    // A new directory is reported as a whole; its contents are watched from now on.
+    if ((ev->mask & IN_ISDIR) && (ev->mask & (IN_CREATE | IN_MOVED_TO)) && add_watches(m, path) != 0)
+        m->blind = 1;
+}
+
+// Reads every queued event. Called before each answer, so changes made
+// before a client's query are always part of it.
+static void drain_events(struct monitor *m) {
+    char buffer[64 * 1024] __attribute__((aligned(__alignof__(struct inotify_event))));
+    for (;;) {
+        ssize_t n = read(m->inotify_fd, buffer, sizeof(buffer));
+        if (n <= 0) {
+            if (n < 0 && errno == EINTR) continue;
+            return;
+        }
+        for (char *ptr = buffer; ptr < buffer + n;) {
+            const struct inotify_event *ev = (const struct inotify_event *)ptr;
+            handle_event(m, ev);
+            ptr += sizeof(struct inotify_event) + ev->len;
+        }
+    }
+}
+
+// --- Socket ---
+
+static int socket_address(struct sockaddr_un *addr) {
+    memset(addr, 0, sizeof(*addr));
+    addr->sun_family = AF_UNIX;
+    if (strlen(FSMONITOR_SOCKET) >= sizeof(addr->sun_path)) return -1;
+    strcpy(addr->sun_path, FSMONITOR_SOCKET);
+    return 0;
+}
+
+static void set_timeouts(int fd) {
+    struct timeval tv = { IO_TIMEOUT_SEC, 0 };
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+}
+
+static int write_all(int fd, const char *data, size_t size) {
+    while (size > 0) {
+        ssize_t n = send(fd, data, size, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        data += n;
+        size -= n;
+    }
+    return 0;
+}
+
+struct reply {
+    char *data;
+    size_t size;
+    size_t capacity;
+};
+
+static int reply_add(struct reply *r, const char *field) {
+    size_t len = strlen(field) + 1;
+    if (r->size + len > r->capacity) {
+        size_t capacity = r->capacity ? r->capacity * 2 : 4096;
+        while (capacity < r->size + len) capacity *= 2;
+        char *grown = realloc(r->data, capacity);
+        if (!grown) return -1;
+        r->data = grown;
+        r->capacity = capacity;
+    }
+    memcpy(r->data + r->size, field, len);
+    r->size += len;
+    return 0;
+}
+
+// Reply: token '\0' ("full" | "changes") '\0' { path '\0' }
+static int answer_query(struct monitor *m, int fd, const char *token) {
+    drain_events(m);
+
+    char instance[32];
+    unsigned long long since = 0;
+    int exact = !m->blind && token && sscanf(token, "%31[^:]:%llu", instance, &since) == 2 &&
+                strcmp(instance, m->instance) == 0 && since >= m->reset_seq && since <= m->seq;
+
+    char new_token[64];
+    snprintf(new_token, sizeof(new_token), "%s:%llu", m->instance, (unsigned long long)m->seq);
+    struct reply r = { NULL, 0, 0 };
+    int result = reply_add(&r, new_token) | reply_add(&r, exact ? "changes" : "full");
+    for (size_t i = 0; exact && result == 0 && i < m->slot_capacity; i++) {
+        if (m->slots[i].path && m->slots[i].seq > since) result = reply_add(&r, m->slots[i].path);
+    }
+    if (result == 0) result = write_all(fd, r.data, r.size);
+    free(r.data);
+    return result;
+}
+
+static void handle_client(struct monitor *m, int fd) {
+    set_timeouts(fd);
+    char request[REQUEST_MAX];
+    size_t len = 0;
+    while (len < sizeof(request) - 1) {
+        ssize_t n = recv(fd, request + len, sizeof(request) - 1 - len, 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        len += n;
+        if (memchr(request, '\n', len)) break;
+    }
+    request[len] = '\0';
+    request[strcspn(request, "\n")] = '\0';
+
+    if (strncmp(request, "query", 5) == 0) {
+        answer_query(m, fd, request[5] == ' ' ? request + 6 : NULL);
+    } else if (strcmp(request, "status") == 0) {
+        drain_events(m);
+        char text[256];
+        snprintf(text, sizeof(text), "fsmonitor running (pid %d): %d directories watched, "
+                 "%zu paths changed, token %s:%llu%s\n", (int)getpid(), m->watch_count, m->slot_count,
+                 m->instance, (unsigned long long)m->seq, m->blind ? " (incomplete: full scans only)" : "");
+        write_all(fd, text, strlen(text));
+    } else if (strcmp(request, "stop") == 0) {
+        m->stop = 1;
+        write_all(fd, "ok\n", 3);
+    }
+}
+
+static int monitor_open(struct monitor *m) {
+    memset(m, 0, sizeof(*m));
+    m->listen_fd = -1;
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    snprintf(m->instance, sizeof(m->instance), "%lx%05x", (unsigned long)now.tv_sec,
+             (unsigned)((now.tv_nsec / 1000) ^ getpid()) & 0xfffff);
+
+    m->inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (m->inotify_fd < 0) {
+        perror("fsmonitor: inotify_init1");
+        return -1;
+    }
+    if (add_watches(m, "") != 0) return -1;
+
+    struct sockaddr_un addr;
+    if (socket_address(&addr) != 0) return -1;
+    unlink(FSMONITOR_SOCKET); // Left behind by a daemon that died
+    m->listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (m->listen_fd < 0 || bind(m->listen_fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 ||
+        listen(m->listen_fd, 16) != 0) {
+        perror("fsmonitor: cannot listen on " FSMONITOR_SOCKET);
+        return -1;
+    }
+    return 0;
+}
+
+static void monitor_close(struct monitor *m) {
+    if (m->listen_fd >= 0) {
+        close(m->listen_fd);
+        unlink(FSMONITOR_SOCKET);
+    }
+    if (m->inotify_fd >= 0) close(m->inotify_fd);
+    for (int i = 0; i < m->watch_capacity; i++) free(m->watch_paths[i]);
+    free(m->watch_paths);
+    for (size_t i = 0; i < m->slot_capacity; i++) free(m->slots[i].path);
+    free(m->slots);
+}
+
+static void monitor_run(struct monitor *m) {
+    while (!m->stop && !shutdown_requested) {
+        struct pollfd fds[2] = { { m->inotify_fd, POLLIN, 0 }, { m->listen_fd, POLLIN, 0 } };
+        if (poll(fds, 2, -1) < 0) {
+            if (errno == EINTR) continue;
+            perror("fsmonitor: poll");
+            break;
+        }
+        if (fds[0].revents & POLLIN) drain_events(m);
+        if (fds[1].revents & POLLIN) {
+            int client = accept4(m->listen_fd, NULL, NULL, SOCK_CLOEXEC);
+            if (client >= 0) {
+                handle_client(m, client);
+                close(client);
+            }
+        }
+    }
+}
+
+// --- Client ---
+
+// Sends one request line and reads the reply until the daemon closes.
+static char *monitor_request(const char *request, size_t *out_size) {
+    struct sockaddr_un addr;
+    if (socket_address(&addr) != 0) return NULL;
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) return NULL;
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        close(fd); // No daemon (or a stale socket)
+        return NULL;
+    }
+    set_timeouts(fd);
+
+    char *data = NULL;
+    size_t size = 0, capacity = 0;
+    int ok = write_all(fd, request, strlen(request)) == 0;
+    while (ok) {
+        if (size + 4096 > capacity) {
+            capacity = capacity ? capacity * 2 : 8192;
+            char *grown = realloc(data, capacity + 1);
+            if (!grown) { ok = 0; break; }
+            data = grown;
+        }
+        ssize_t n = recv(fd, data + size, capacity - size, 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) ok = 0;
+        if (n <= 0) break;
+        size += n;
+    }
+    close(fd);
+    if (!ok || size == 0) {
+        free(data);
+        return NULL;
+    }
+    data[size] = '\0';
+    *out_size = size;
+    return data;
+}
+
+static int compare_paths(const void *a, const void *b) {
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+struct fsmonitor_changes *fsmonitor_query(const char *token) {
+    char request[REQUEST_MAX];
+    if (token) snprintf(request, sizeof(request), "query %s\n", token);
+    else snprintf(request, sizeof(request), "query\n");
+    size_t size;
+    char *data = monitor_request(request, &size);
+    if (!data) return NULL;
+
+    struct fsmonitor_changes *changes = calloc(1, sizeof(struct fsmonitor_changes));
+    char *end = data + size;
+    char *mode = memchr(data, '\0', size);
+    if (!changes || !mode || ++mode >= end) goto fail;
+    char *ptr = mode + strlen(mode) + 1;
+
+    changes->data = data;
+    changes->token = data;
+    changes->full_scan = strcmp(mode, "changes") != 0;
+    if (!changes->full_scan) {
+        for (char *p = ptr; p < end; p += strlen(p) + 1) changes->count++;
+        changes->paths = malloc(sizeof(char *) * (changes->count ? changes->count : 1));
+        if (!changes->paths) goto fail;
+        int i = 0;
+        for (char *p = ptr; p < end; p += strlen(p) + 1) {
+            changes->paths[i++] = p;
+            if (!p[0]) changes->full_scan = 1; // The worktree root itself changed
+        }
+        qsort(changes->paths, changes->count, sizeof(char *), compare_paths);
+    }
+    return changes;
+
+fail:
+    free(changes ? changes->paths : NULL);
+    free(changes);
+    free(data);
+    return NULL;
+}
+
+static int find_path(const struct fsmonitor_changes *changes, const char *path, int *out_pos) {
+    int lo = 0, hi = changes->count;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (strcmp(changes->paths[mid], path) < 0) lo = mid + 1;
+        else hi = mid;
+    }
+    if (out_pos) *out_pos = lo;
+    return lo < changes->count && strcmp(changes->paths[lo], path) == 0;
+}
+
+int fsmonitor_is_dirty(const struct fsmonitor_changes *changes, const char *path) {
+    if (!changes || changes->full_scan) return 1;
+    if (!path[0]) return changes->count > 0;
+    if (find_path(changes, path, NULL)) return 1;
+
+    // Below it: "path/..." sorts as one run.
+    char key[1024];
+    int len = snprintf(key, sizeof(key), "%s/", path);
+    if (len < 0 || (size_t)len >= sizeof(key)) return 1;
+    int pos;
+    find_path(changes, key, &pos);
+    if (pos < changes->count && strncmp(changes->paths[pos], key, len) == 0) return 1;
+
+    // Above it: a reported directory covers everything under it.
+    for (char *slash = strchr(key, '/'); slash && slash < key + len - 1; slash = strchr(slash + 1, '/')) {
+        *slash = '\0';
+        int found = find_path(changes, key, NULL);
+        *slash = '/';
+        if (found) return 1;
+    }
+    return 0;
+}
+
+void fsmonitor_free(struct fsmonitor_changes *changes) {
+    if (!changes) return;
+    free(changes->paths);
+    free(changes->data);
+    free(changes);
+}
+
+// --- Command ---
+
+int do_fsmonitor(const char *action) {
+    if (access(".minivcs", F_OK) != 0) {
+        fprintf(stderr, "Error: not a version_forge repository (run from the worktree root).\n");
+        return 1;
+    }
+
+    if (strcmp(action, "status") == 0 || strcmp(action, "stop") == 0) {
+        char request[16];
+        snprintf(request, sizeof(request), "%s\n", action);
+        size_t size;
+        char *reply = monitor_request(request, &size);
+        if (!reply) {
+            printf("fsmonitor is not running\n");
+            return strcmp(action, "stop") == 0 ? 0 : 1;
+        }
+        if (strcmp(action, "status") == 0) printf("%s", reply);
+        else printf("fsmonitor stopped\n");
+        free(reply);
+        return 0;
+    }
+
+    int foreground = strcmp(action, "run") == 0;
+    if (!foreground && strcmp(action, "start") != 0) {
+        fprintf(stderr, "Usage: version_forge fsmonitor start|stop|status|run\n");
+        return 1;
+    }
+    size_t size;
+    char *reply = monitor_request("status\n", &size);
+    if (reply) {
+        printf("%s", reply);
+        free(reply);
+        return 0;
+    }
+
+    // Watch and listen before detaching: once 'start' returns, queries work.
+    struct monitor m;
+    if (monitor_open(&m) != 0) {
+        monitor_close(&m);
+        return 1;
+    }
+    printf("fsmonitor watching %d directories\n", m.watch_count);
+
+    if (!foreground) {
+        fflush(stdout);
+        pid_t pid = fork();
+        if (pid < 0) {
+            perror("fsmonitor: fork");
+            monitor_close(&m);
+            return 1;
+        }
+        if (pid > 0) {
+            printf("fsmonitor started (pid %d)\n", (int)pid);
+            return 0; // The child owns the socket now
+        }
+        setsid();
+        int null_fd = open("/dev/null", O_RDWR);
+        if (null_fd >= 0) {
+            dup2(null_fd, STDIN_FILENO);
+            dup2(null_fd, STDOUT_FILENO);
+            dup2(null_fd, STDERR_FILENO);
+            if (null_fd > STDERR_FILENO) close(null_fd);
+        }
+    }
+    monitor_run(&m);
+    monitor_close(&m);
+    return 0;
+}
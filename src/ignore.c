@@ -0,0 +1,347 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "ignore.h"
+
+// --- Compiled Patterns ---
+// Patterns are numbered in file order and the highest-numbered match wins,
+// so each structure only has to report the best number it matched:
+//   - literal names ("node_modules", "build/") in an open-addressing hash set,
+//   - "*<suffix>" patterns ("*.o", "*~") in a trie over reversed suffixes,
+//   - everything else, tried as globs from the last one down.
+
+struct ignore_pattern {
+    char *glob;                 // Glob patterns only
+    int negate;
+    int dir_only;
+    int anchored;               // Matched against the path below the list's directory
+};
+
+struct literal_slot {
+    char *name;                 // NULL: free slot
+    int any;                    // Best pattern for any path with this name (-1: none)
+    int dir;                    // Best pattern for directories only
+};
+
+struct suffix_node {
+    struct suffix_node *children;
+    int count;
+    unsigned char c;
+    int any;
+    int dir;
+};
+
+struct ignore_list {
+    const struct ignore_list *parent;
+    char *dir;                  // Worktree-relative directory of the .vfignore file
+    size_t dir_len;
+    struct ignore_pattern *patterns;
+    int count;
+    struct literal_slot *literals;
+    size_t literal_capacity;    // Power of two
+    struct suffix_node suffixes;
+    int *globs;                 // Pattern numbers, ascending
+    int glob_count;
+};
+
+static uint32_t hash_name(const char *name) {
+    uint32_t h = 2166136261u; // FNV-1a
+    for (; *name; name++) h = (h ^ (unsigned char)*name) * 16777619u;
+    return h;
+}
+
+static struct literal_slot *find_literal(const struct ignore_list *list, const char *name) {
+    size_t mask = list->literal_capacity - 1;
+    size_t i = hash_name(name) & mask;
+    while (list->literals[i].name && strcmp(list->literals[i].name, name) != 0) i = (i + 1) & mask;
+    return &list->literals[i];
+}
+
+static struct suffix_node *suffix_child(const struct suffix_node *node, unsigned char c) {
+    for (int i = 0; i < node->count; i++) {
+        if (node->children[i].c == c) return &node->children[i];
+    }
+    return NULL;
+}
+
+static struct suffix_node *suffix_add_child(struct suffix_node *node, unsigned char c) {
+    struct suffix_node *child = suffix_child(node, c);
+    if (child) return child;
+    struct suffix_node *grown = realloc(node->children, sizeof(struct suffix_node) * (node->count + 1));
+    if (!grown) return NULL;
+    node->children = grown;
+    child = &node->children[node->count++];
+    memset(child, 0, sizeof(*child));
+    child->c = c;
+    child->any = child->dir = -1;
+    return child;
+}
+
+static void free_suffixes(struct suffix_node *node) {
+    for (int i = 0; i < node->count; i++) free_suffixes(&node->children[i]);
+    free(node->children);
+}
+
+static void note_best(int *any, int *dir, int number, int dir_only) {
+    if (dir_only) *dir = number;
+    else *any = number;
+}
+
+// --- Glob Matching ---
+
+// Matches one character against the class at 'p' ('[' ... ']').
+// Returns the closing ']', or NULL if the class is not closed.
+static const char *match_class(const char *p, char c, int *out_matched) {
+    p++;
+    int negate = *p == '!' || *p == '^';
+    if (negate) p++;
+    int matched = 0;
+    int first = 1; // A ']' right after the '[' is literal
+    while (*p && (*p != ']' || first)) {
+        first = 0;
+        char lo = *p;
+        if (lo == '\\' && p[1]) lo = *++p;
+        char hi = lo;
+        if (p[1] == '-' && p[2] && p[2] != ']') {
+            p += 2;
+            if (*p == '\\' && p[1]) p++;
+            hi = *p;
+        }
+        if (c >= lo && c <= hi) matched = 1;
+        p++;
+    }
+    if (*p != ']') return NULL;
+    *out_matched = matched != negate;
+    return p;
+}
+
+// '*', '?' and classes stop at '/'; '**' does not, and "**/" may match nothing.
+static int wildmatch(const char *p, const char *t) {
+    for (; *p; p++, t++) {
+        switch (*p) {
+        case '?':
+            if (!*t || *t == '/') return 0;
+            break;
+        case '*':
+            if (p[1] == '*') {
+                while (*p == '*') p++;
+                if (!*p) return 1;
+                if (*p == '/' && wildmatch(p + 1, t)) return 1;
+                for (; *t; t++) {
+                    if (wildmatch(p, t)) return 1;
+                }
+                return 0;
+            }
+            p++;
+            if (!*p) return strchr(t, '/') == NULL;
+            for (;; t++) {
+                if (wildmatch(p, t)) return 1;
+                if (!*t || *t == '/') return 0;
+            }
+        case '[': {
+            int matched;
+            const char *end = match_class(p, *t, &matched);
+            if (end) {
+                if (!*t || *t == '/' || !matched) return 0;
+                p = end;
+                break;
+            }
+            if (*t != '[') return 0; // Unclosed: a literal '['
+            break;
+        }
+        case '\\':
+            if (p[1]) p++;
+            // Fall through: the escaped character is literal
+        default:
+            if (*p != *t) return 0;
+        }
+    }
+    return *t == '\0';
+}
+
+// --- Compilation ---
+
+static int has_wildcard(const char *s) {
+    return strpbrk(s, "*?[\\") != NULL;
+}
+
+// Trims one line to its pattern; returns 0 for blank lines and comments.
+static int parse_line(char *line, struct ignore_pattern *out) {
+    size_t len = strlen(line);
+    while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r')) len--;
+    while (len > 0 && (line[len - 1] == ' ' || line[len - 1] == '\t') && !(len > 1 && line[len - 2] == '\\')) len--;
+    line[len] = '\0';
+    if (!len || line[0] == '#') return 0;
+
+    char *p = line;
+    memset(out, 0, sizeof(*out));
+    if (*p == '!') {
+        out->negate = 1;
+        p++;
+    } else if (*p == '\\' && (p[1] == '#' || p[1] == '!')) {
+        p++;
+    }
+    while (len > (size_t)(p - line) && line[len - 1] == '/') {
+        out->dir_only = 1;
+        line[--len] = '\0';
+    }
+    out->anchored = strchr(p, '/') != NULL;
+    while (*p == '/') p++;
+    if (!*p) return 0;
+    memmove(line, p, strlen(p) + 1);
+    return 1;
+}
+
+static int add_pattern(struct ignore_list *list, const char *text, const struct ignore_pattern *pattern) {
+    int number = list->count;
+    struct ignore_pattern *grown = realloc(list->patterns, sizeof(struct ignore_pattern) * (number + 1));
+    if (!grown) return -1;
+    list->patterns = grown;
+    list->patterns[number] = *pattern;
+    list->count++;
+
+    if (!pattern->anchored && !has_wildcard(text)) {
+        struct literal_slot *slot = find_literal(list, text);
+        if (!slot->name && !(slot->name = strdup(text))) return -1;
+        note_best(&slot->any, &slot->dir, number, pattern->dir_only);
+        return 0;
+    }
+    if (!pattern->anchored && text[0] == '*' && text[1] != '*' && !has_wildcard(text + 1)) {
+        struct suffix_node *node = &list->suffixes;
+        for (size_t i = strlen(text + 1); i > 0; i--) {
+            if (!(node = suffix_add_child(node, (unsigned char)text[i]))) return -1;
+        }
+        note_best(&node->any, &node->dir, number, pattern->dir_only);
+        return 0;
+    }
+
+    int *globs = realloc(list->globs, sizeof(int) * (list->glob_count + 1));
+    if (!globs) return -1;
+    list->globs = globs;
+    list->globs[list->glob_count++] = number;
+    return (list->patterns[number].glob = strdup(text)) ? 0 : -1;
+}
+
+struct ignore_list *ignore_compile(const char *text, size_t size, const char *rel_dir,
+                                   const struct ignore_list *parent) {
+    struct ignore_list *list = calloc(1, sizeof(struct ignore_list));
+    if (!list || !(list->dir = strdup(rel_dir))) {
+        free(list);
+        return NULL;
+    }
+    list->parent = parent;
+    list->dir_len = strlen(rel_dir);
+    list->suffixes.any = list->suffixes.dir = -1;
+
+    // Size the hash set for every line being a literal: at most half full.
+    size_t lines = 1;
+    for (size_t i = 0; i < size; i++) lines += text[i] == '\n';
+    list->literal_capacity = 16;
+    while (list->literal_capacity < lines * 2) list->literal_capacity *= 2;
+    list->literals = calloc(list->literal_capacity, sizeof(struct literal_slot));
+    if (!list->literals) goto fail;
+    for (size_t i = 0; i < list->literal_capacity; i++) list->literals[i].any = list->literals[i].dir = -1;
+
+    const char *ptr = text, *end = text + size;
+    while (ptr < end) {
+        const char *newline = memchr(ptr, '\n', end - ptr);
+        size_t len = newline ? (size_t)(newline - ptr) : (size_t)(end - ptr);
+        char line[1024];
+        if (len < sizeof(line)) {
+            memcpy(line, ptr, len);
+            line[len] = '\0';
+            struct ignore_pattern pattern;
+            if (parse_line(line, &pattern) && add_pattern(list, line, &pattern) != 0) goto fail;
+        }
+        ptr += len + 1;
+    }
+    if (list->count == 0) goto fail;
+    return list;
+
+fail:
+    ignore_free(list);
+    return NULL;
+}
+
+struct ignore_list *ignore_load(int dir_fd, const char *rel_dir, const struct ignore_list *parent) {
+    int fd = openat(dir_fd, IGNORE_FILE, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return NULL;
+    struct stat st;
+    char *text = NULL;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && (text = malloc(st.st_size + 1))) {
+        size_t size = 0;
+        ssize_t n;
+        while (size < (size_t)st.st_size && (n = read(fd, text + size, st.st_size - size)) > 0) size += n;
+        text[size] = '\0';
+        st.st_size = size;
+    }
+    close(fd);
+    if (!text) return NULL;
+
+    struct ignore_list *list = ignore_compile(text, st.st_size, rel_dir, parent);
+    if (!list) fprintf(stderr, "Warning: no patterns in %s%s%s\n", rel_dir, rel_dir[0] ? "/" : "", IGNORE_FILE);
+    free(text);
+    return list;
+}
+
+// --- Matching ---
+
+static int best_of(int best, int any, int dir, int is_dir) {
+    if (any > best) best = any;
+    if (is_dir && dir > best) best = dir;
+    return best;
+}
+
+// The highest-numbered pattern of 'list' matching the path, or -1.
+static int best_match(const struct ignore_list *list, const char *sub_path, const char *name, int is_dir) {
+    int best = -1;
+    const struct literal_slot *slot = find_literal(list, name);
+    if (slot->name) best = best_of(best, slot->any, slot->dir, is_dir);
+
+    const struct suffix_node *node = &list->suffixes;
+    best = best_of(best, node->any, node->dir, is_dir); // "*"
+    for (size_t i = strlen(name); i > 0 && node->count; i--) {
+        if (!(node = suffix_child(node, (unsigned char)name[i - 1]))) break;
+        best = best_of(best, node->any, node->dir, is_dir);
+    }
+
+    // Only a later glob can still win.
+    for (int g = list->glob_count - 1; g >= 0 && list->globs[g] > best; g--) {
+        const struct ignore_pattern *p = &list->patterns[list->globs[g]];
+        if (p->dir_only && !is_dir) continue;
+        if (wildmatch(p->glob, p->anchored ? sub_path : name)) return list->globs[g];
+    }
+    return best;
+}
+
+int ignore_match(const struct ignore_list *list, const char *rel_path, int is_dir) {
+    const char *slash = strrchr(rel_path, '/');
+    const char *name = slash ? slash + 1 : rel_path;
+    for (; list; list = list->parent) {
+        const char *sub_path = rel_path;
+        if (list->dir_len) {
+            if (strncmp(rel_path, list->dir, list->dir_len) != 0 || rel_path[list->dir_len] != '/') continue;
+            sub_path = rel_path + list->dir_len + 1;
+        }
+        int best = best_match(list, sub_path, name, is_dir);
+        if (best >= 0) return !list->patterns[best].negate;
+    }
+    return 0;
+}
+
+void ignore_free(struct ignore_list *list) {
+    if (!list) return;
+    for (int i = 0; i < list->count; i++) free(list->patterns[i].glob);
+    free(list->patterns);
+    for (size_t i = 0; i < list->literal_capacity; i++) free(list->literals[i].name);
+    free(list->literals);
+    free_suffixes(&list->suffixes);
+    free(list->globs);
+    free(list->dir);
+    free(list);
+}
@@ -0,0 +1,612 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <openssl/sha.h>
+
+#include "index.h"
+#include "utils.h"
+
+/*
+ * On-disk layout (all integers big-endian):
+ *
+ *   header:  "VFIX" | u32 version | u32 entry count
+ *   entry:   u32 ctime_sec | u32 ctime_nsec | u32 mtime_sec | u32 mtime_nsec |
+ *            u64 ino | u64 size | u32 mode | sha1[20] | u16 flags |
+ *            u16 path_len | path | '\0' | padding to a 4-byte boundary
+ *   extensions (optional, after the entries):
+ *            signature[4] | u32 size | size bytes of data
+ *   trailer: SHA-1 of everything above
+ *
+ * Entries are sorted by path so a loaded index can be binary searched
+ * straight out of the mapping.
+ *
+ * Entry flags: INDEX_ENTRY_STORED (bit 0).
+ *
+ * "TREE" extension (cache-tree), one record per directory, sorted by path:
+ *            u32 entry_count | sha1[20] | path | '\0'
+ *            The top bit of entry_count is set when the tree is stored.
+ * "FSMN" extension: the file system monitor token the entries are valid
+ *            as of (see fsmonitor.h), without a terminating '\0'.
+ * Extensions with an unknown signature are skipped.
+ */
+#define INDEX_MAGIC "VFIX"
+#define INDEX_VERSION 1
+#define INDEX_HEADER_SIZE 12
+#define INDEX_ENTRY_FIXED 60
+
+#define ENTRY_OFF_CTIME 0
+#define ENTRY_OFF_MTIME 8
+#define ENTRY_OFF_INO 16
+#define ENTRY_OFF_SIZE 24
+#define ENTRY_OFF_MODE 32
+#define ENTRY_OFF_SHA1 36
+#define ENTRY_OFF_FLAGS 56
+#define ENTRY_OFF_PATHLEN 58
+
+#define EXT_HEADER_SIZE 8
+#define EXT_CACHE_TREE "TREE"
+#define TREE_REC_FIXED 24
+#define TREE_REC_STORED 0x80000000u
+#define EXT_FSMONITOR "FSMN"
+
+static size_t entry_disk_size(size_t path_len) {
+    return (INDEX_ENTRY_FIXED + path_len + 1 + 3) & ~(size_t)3;
+}
+
+static uint32_t stat_nsec(const struct timespec *ts) {
+    return (uint32_t)ts->tv_nsec;
+}
+
+static int parse_cache_tree(struct index *idx, const unsigned char *data, size_t size) {
+    // Count first, so the pointer array is allocated once.
+    int count = 0;
+    const unsigned char *ptr = data, *end = data + size;
+    while (ptr < end) {
+        if (end - ptr < TREE_REC_FIXED + 1) return -1;
+        const unsigned char *nul = memchr(ptr + TREE_REC_FIXED, '\0', end - ptr - TREE_REC_FIXED);
+        if (!nul) return -1;
+        ptr = nul + 1;
+        count++;
+    }
+
+    idx->tree_records = malloc(sizeof(unsigned char *) * (count ? count : 1));
+    if (!idx->tree_records) return -1;
+    ptr = data;
+    for (int i = 0; i < count; i++) {
+        idx->tree_records[i] = ptr;
+        ptr += TREE_REC_FIXED + strlen((const char *)ptr + TREE_REC_FIXED) + 1;
+    }
+    idx->tree_record_count = count;
+    return 0;
+}
+
+// Validates the mapping and collects a pointer to every record.
+static int parse_map(struct index *idx) {
+    const unsigned char *base = idx->map;
+    size_t size = idx->map_size;
+
+    if (size < INDEX_HEADER_SIZE + SHA_DIGEST_LENGTH) return -1;
+    if (memcmp(base, INDEX_MAGIC, 4) != 0) return -1;
+    if (get_be32(base + 4) != INDEX_VERSION) return -1;
+
+    unsigned char checksum[SHA_DIGEST_LENGTH];
+    SHA1(base, size - SHA_DIGEST_LENGTH, checksum);
+    if (memcmp(checksum, base + size - SHA_DIGEST_LENGTH, SHA_DIGEST_LENGTH) != 0) return -1;
+
+    uint32_t count = get_be32(base + 8);
+    idx->records = malloc(sizeof(unsigned char *) * (count ? count : 1));
+    if (!idx->records) return -1;
+
+    const unsigned char *ptr = base + INDEX_HEADER_SIZE;
+    const unsigned char *end = base + size - SHA_DIGEST_LENGTH;
+    for (uint32_t i = 0; i < count; i++) {
+        if (ptr + INDEX_ENTRY_FIXED > end) return -1;
+        uint16_t path_len = get_be16(ptr + ENTRY_OFF_PATHLEN);
+        size_t len = entry_disk_size(path_len);
+        if (ptr + len > end || ptr[INDEX_ENTRY_FIXED + path_len] != '\0') return -1;
+        idx->records[i] = ptr;
+        ptr += len;
+    }
+    idx->record_count = count;
+
+    while (ptr + EXT_HEADER_SIZE <= end) {
+        uint32_t ext_size = get_be32(ptr + 4);
+        const unsigned char *data = ptr + EXT_HEADER_SIZE;
+        if (ext_size > (size_t)(end - data)) return -1;
+        if (memcmp(ptr, EXT_CACHE_TREE, 4) == 0 && parse_cache_tree(idx, data, ext_size) != 0) return -1;
+        if (memcmp(ptr, EXT_FSMONITOR, 4) == 0) {
+            free(idx->fsmonitor_token);
+            idx->fsmonitor_token = strndup((const char *)data, ext_size);
+        }
+        ptr = data + ext_size;
+    }
+    return 0;
+}
+
+struct index *index_load() {
+    struct index *idx = calloc(1, sizeof(struct index));
+    if (!idx) return NULL;
+    pthread_mutex_init(&idx->lock, NULL);
+    idx->fsmonitor_dirty = -1;
+
+    int fd = open(INDEX_FILE, O_RDONLY);
+    if (fd < 0) return idx; // No index yet: everything is a miss
+
+    struct stat st;
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+        void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map != MAP_FAILED) {
+            idx->map = map;
+            idx->map_size = st.st_size;
+            idx->stamp_sec = (uint32_t)st.st_mtime;
+            idx->stamp_nsec = stat_nsec(&st.st_mtim);
+            if (parse_map(idx) != 0) {
+                fprintf(stderr, "Warning: ignoring corrupt %s\n", INDEX_FILE);
+                munmap(idx->map, idx->map_size);
+                free(idx->records);
+                free(idx->tree_records);
+                idx->map = NULL;
+                idx->records = NULL;
+                idx->record_count = 0;
+                idx->tree_records = NULL;
+                idx->tree_record_count = 0;
+                free(idx->fsmonitor_token);
+                idx->fsmonitor_token = NULL;
+            }
+        }
+    }
+    close(fd);
+    return idx;
+}
+
+static const unsigned char *find_record(const struct index *idx, const char *path) {
+    int lo = 0, hi = idx->record_count - 1;
+    while (lo <= hi) {
+        int mid = lo + (hi - lo) / 2;
+        const unsigned char *rec = idx->records[mid];
+        int cmp = strcmp(path, (const char *)rec + INDEX_ENTRY_FIXED);
+        if (cmp == 0) return rec;
+        if (cmp < 0) hi = mid - 1;
+        else lo = mid + 1;
+    }
+    return NULL;
+}
+
+// First record whose path is >= key.
+static int record_lower_bound(const unsigned char **records, int count, size_t path_offset, const char *key) {
+    int lo = 0, hi = count;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (strcmp((const char *)records[mid] + path_offset, key) < 0) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+static void decode_record(const unsigned char *rec, struct index_entry *e) {
+    e->ctime_sec = get_be32(rec + ENTRY_OFF_CTIME);
+    e->ctime_nsec = get_be32(rec + ENTRY_OFF_CTIME + 4);
+    e->mtime_sec = get_be32(rec + ENTRY_OFF_MTIME);
+    e->mtime_nsec = get_be32(rec + ENTRY_OFF_MTIME + 4);
+    e->ino = get_be64(rec + ENTRY_OFF_INO);
+    e->size = get_be64(rec + ENTRY_OFF_SIZE);
+    e->mode = get_be32(rec + ENTRY_OFF_MODE);
+    e->flags = get_be16(rec + ENTRY_OFF_FLAGS);
+    memcpy(e->sha1, rec + ENTRY_OFF_SHA1, SHA_DIGEST_LENGTH);
+    e->path = NULL;
+}
+
+static int is_racily_clean(const struct index *idx, const struct index_entry *e) {
+    return e->mtime_sec > idx->stamp_sec ||
+           (e->mtime_sec == idx->stamp_sec && e->mtime_nsec >= idx->stamp_nsec);
+}
+
+int index_lookup(struct index *idx, const char *path, const struct stat *st,
+                 struct index_entry *out_entry) {
+    if (!idx) return 0;
+    const unsigned char *rec = find_record(idx, path);
+    if (!rec) return 0;
+
+    struct index_entry e;
+    decode_record(rec, &e);
+
+    if (e.mtime_sec != (uint32_t)st->st_mtime || e.mtime_nsec != stat_nsec(&st->st_mtim) ||
+        e.ctime_sec != (uint32_t)st->st_ctime || e.ctime_nsec != stat_nsec(&st->st_ctim) ||
+        e.size != (uint64_t)st->st_size || e.ino != (uint64_t)st->st_ino ||
+        e.mode != (uint32_t)st->st_mode) {
+        return 0;
+    }
+
+    // "Racily clean": the file was modified in the same tick the index was
+    // written, so a later edit could leave identical stat data. Rehash it.
+    if (is_racily_clean(idx, &e)) return 0;
+
+    if (out_entry) *out_entry = e;
+    return 1;
+}
+
+static int reserve_entries_locked(struct index *idx, int extra) {
+    if (idx->count + extra <= idx->capacity) return 0;
+    int new_capacity = idx->capacity ? idx->capacity : 64;
+    while (new_capacity < idx->count + extra) new_capacity *= 2;
+    struct index_entry *grown = realloc(idx->entries, sizeof(struct index_entry) * new_capacity);
+    if (!grown) return -1;
+    idx->entries = grown;
+    idx->capacity = new_capacity;
+    return 0;
+}
+
+static int reserve_trees_locked(struct index *idx, int extra) {
+    if (idx->tree_count + extra <= idx->tree_capacity) return 0;
+    int new_capacity = idx->tree_capacity ? idx->tree_capacity : 16;
+    while (new_capacity < idx->tree_count + extra) new_capacity *= 2;
+    struct cache_tree_entry *grown = realloc(idx->trees, sizeof(struct cache_tree_entry) * new_capacity);
+    if (!grown) return -1;
+    idx->trees = grown;
+    idx->tree_capacity = new_capacity;
+    return 0;
+}
+
+int index_add(struct index *idx, const char *path, const struct stat *st,
+              const unsigned char *sha1, uint16_t flags) {
+    if (!idx) return 0;
+    if (strlen(path) > UINT16_MAX) return -1;
+
+    char *path_copy = strdup(path);
+    if (!path_copy) return -1;
+
+    pthread_mutex_lock(&idx->lock);
+    if (reserve_entries_locked(idx, 1) != 0) {
+        pthread_mutex_unlock(&idx->lock);
+        free(path_copy);
+        return -1;
+    }
+    struct index_entry *e = &idx->entries[idx->count++];
+    e->ctime_sec = (uint32_t)st->st_ctime;
+    e->ctime_nsec = stat_nsec(&st->st_ctim);
+    e->mtime_sec = (uint32_t)st->st_mtime;
+    e->mtime_nsec = stat_nsec(&st->st_mtim);
+    e->ino = (uint64_t)st->st_ino;
+    e->size = (uint64_t)st->st_size;
+    e->mode = (uint32_t)st->st_mode;
+    e->flags = flags;
+    memcpy(e->sha1, sha1, SHA_DIGEST_LENGTH);
+    e->path = path_copy;
+    idx->sorted = 0;
+    pthread_mutex_unlock(&idx->lock);
+    return 0;
+}
+
+static const unsigned char *find_tree_record(const struct index *idx, const char *path) {
+    int i = record_lower_bound(idx->tree_records, idx->tree_record_count, TREE_REC_FIXED, path);
+    if (i < idx->tree_record_count && strcmp(path, (const char *)idx->tree_records[i] + TREE_REC_FIXED) == 0)
+        return idx->tree_records[i];
+    return NULL;
+}
+
+int cache_tree_lookup(struct index *idx, const char *path, uint32_t entry_count,
+                      unsigned char *out_sha1, int *out_stored) {
+    if (!idx) return 0;
+    const unsigned char *rec = find_tree_record(idx, path);
+    if (!rec) return 0;
+    uint32_t count = get_be32(rec);
+    if ((count & ~TREE_REC_STORED) != entry_count) return 0; // Something was removed
+    memcpy(out_sha1, rec + 4, SHA_DIGEST_LENGTH);
+    *out_stored = (count & TREE_REC_STORED) != 0;
+    return 1;
+}
+
+int cache_tree_peek(struct index *idx, const char *path, unsigned char *out_sha1, int *out_stored) {
+    if (!idx) return 0;
+    const unsigned char *rec = find_tree_record(idx, path);
+    if (!rec) return 0;
+    memcpy(out_sha1, rec + 4, SHA_DIGEST_LENGTH);
+    *out_stored = (get_be32(rec) & TREE_REC_STORED) != 0;
+    return 1;
+}
+
+int cache_tree_add(struct index *idx, const char *path, uint32_t entry_count,
+                   const unsigned char *sha1, int stored) {
+    if (!idx) return 0;
+    char *path_copy = strdup(path);
+    if (!path_copy) return -1;
+
+    pthread_mutex_lock(&idx->lock);
+    if (reserve_trees_locked(idx, 1) != 0) {
+        pthread_mutex_unlock(&idx->lock);
+        free(path_copy);
+        return -1;
+    }
+    struct cache_tree_entry *t = &idx->trees[idx->tree_count++];
+    t->entry_count = entry_count;
+    t->stored = stored;
+    t->removed = 0;
+    memcpy(t->sha1, sha1, SHA_DIGEST_LENGTH);
+    t->path = path_copy;
+    idx->sorted = 0;
+    pthread_mutex_unlock(&idx->lock);
+    return 0;
+}
+
+// The records under "path/" (everything, for the root) form one run in
+// path order; the run is [*out_first, *out_end).
+static void record_range(const unsigned char **records, int count, size_t path_offset, const char *path,
+                         int *out_first, int *out_end) {
+    if (!path[0]) {
+        *out_first = 0;
+        *out_end = count;
+        return;
+    }
+    char key[1024];
+    int len = snprintf(key, sizeof(key), "%s/", path);
+    if (len < 0 || (size_t)len >= sizeof(key)) {
+        *out_first = *out_end = 0;
+        return;
+    }
+    *out_first = record_lower_bound(records, count, path_offset, key);
+    key[len - 1] = '0'; // '0' sorts right after '/'
+    *out_end = record_lower_bound(records, count, path_offset, key);
+}
+
+int index_keep_dir(struct index *idx, const char *path, int stored) {
+    if (!idx) return 0;
+    const unsigned char *dir_rec = find_tree_record(idx, path);
+    if (!dir_rec) return -1;
+
+    int first, end, tree_first, tree_end;
+    record_range(idx->records, idx->record_count, INDEX_ENTRY_FIXED, path, &first, &end);
+    record_range(idx->tree_records, idx->tree_record_count, TREE_REC_FIXED, path, &tree_first, &tree_end);
+    if (!path[0]) tree_first++; // The root's own record sorts first
+
+    pthread_mutex_lock(&idx->lock);
+    int result = -1;
+    if (reserve_entries_locked(idx, end - first) != 0 ||
+        reserve_trees_locked(idx, 1 + tree_end - tree_first) != 0) goto out;
+
+    for (int i = first; i < end; i++) {
+        struct index_entry *e = &idx->entries[idx->count];
+        decode_record(idx->records[i], e);
+        // A racily clean entry loses that status once copied into a newer
+        // index; smudge it so a full scan rehashes it.
+        if (is_racily_clean(idx, e)) e->mtime_sec = 0;
+        if (!(e->path = strdup((const char *)idx->records[i] + INDEX_ENTRY_FIXED))) goto out;
+        idx->count++;
+    }
+    for (int i = tree_first - 1; i < tree_end; i++) {
+        const unsigned char *rec = i < tree_first ? dir_rec : idx->tree_records[i];
+        struct cache_tree_entry *t = &idx->trees[idx->tree_count];
+        uint32_t count = get_be32(rec);
+        t->entry_count = count & ~TREE_REC_STORED;
+        t->stored = (count & TREE_REC_STORED) != 0 || (rec == dir_rec && stored);
+        t->removed = 0;
+        memcpy(t->sha1, rec + 4, SHA_DIGEST_LENGTH);
+        if (!(t->path = strdup((const char *)rec + TREE_REC_FIXED))) goto out;
+        idx->tree_count++;
+    }
+    idx->sorted = 0;
+    __atomic_fetch_add(&idx->hits, end - first, __ATOMIC_RELAXED);
+    result = end - first;
+out:
+    pthread_mutex_unlock(&idx->lock);
+    return result;
+}
+
+int index_set_fsmonitor_token(struct index *idx, const char *token) {
+    if (!idx) return 0;
+    char *copy = NULL;
+    if (token && !(copy = strdup(token))) return -1;
+    free(idx->fsmonitor_next);
+    idx->fsmonitor_next = copy;
+    return 0;
+}
+
+static int compare_cache_trees(const void *a, const void *b) {
+    const struct cache_tree_entry *ta = a;
+    const struct cache_tree_entry *tb = b;
+    return strcmp(ta->path, tb->path);
+}
+
+static int compare_index_entries(const void *a, const void *b) {
+    const struct index_entry *ea = a;
+    const struct index_entry *eb = b;
+    return strcmp(ea->path, eb->path);
+}
+
+static void order_locked(struct index *idx) {
+    if (idx->sorted) return;
+    qsort(idx->entries, idx->count, sizeof(struct index_entry), compare_index_entries);
+    qsort(idx->trees, idx->tree_count, sizeof(struct cache_tree_entry), compare_cache_trees);
+    idx->sorted = 1;
+}
+
+// Sorts and drops what index_remove_path() marked (compaction keeps the order).
+static void sort_locked(struct index *idx) {
+    order_locked(idx);
+    if (!idx->purge) return;
+    idx->purge = 0;
+    int kept = 0;
+    for (int i = 0; i < idx->count; i++) {
+        if (idx->entries[i].flags & INDEX_ENTRY_REMOVED) free(idx->entries[i].path);
+        else idx->entries[kept++] = idx->entries[i];
+    }
+    idx->count = kept;
+    kept = 0;
+    for (int i = 0; i < idx->tree_count; i++) {
+        if (idx->trees[i].removed) free(idx->trees[i].path);
+        else idx->trees[kept++] = idx->trees[i];
+    }
+    idx->tree_count = kept;
+}
+
+void index_sort(struct index *idx) {
+    if (!idx) return;
+    pthread_mutex_lock(&idx->lock);
+    sort_locked(idx);
+    pthread_mutex_unlock(&idx->lock);
+}
+
+static void remove_tree_locked(struct index *idx, const char *path) {
+    int lo = 0, hi = idx->tree_count - 1;
+    while (lo <= hi) {
+        int mid = lo + (hi - lo) / 2;
+        int cmp = strcmp(path, idx->trees[mid].path);
+        if (cmp == 0) {
+            idx->trees[mid].removed = 1;
+            return;
+        }
+        if (cmp < 0) hi = mid - 1;
+        else lo = mid + 1;
+    }
+}
+
+void index_remove_path(struct index *idx, const char *path) {
+    if (!idx) return;
+    pthread_mutex_lock(&idx->lock);
+    order_locked(idx);
+    idx->purge = 1;
+
+    int lo = 0, hi = idx->count - 1;
+    while (lo <= hi) {
+        int mid = lo + (hi - lo) / 2;
+        int cmp = strcmp(path, idx->entries[mid].path);
+        if (cmp == 0) {
+            idx->entries[mid].flags |= INDEX_ENTRY_REMOVED;
+            break;
+        }
+        if (cmp < 0) hi = mid - 1;
+        else lo = mid + 1;
+    }
+
+    // The trees of all enclosing directories no longer describe the worktree.
+    char dir[1024];
+    snprintf(dir, sizeof(dir), "%s", path);
+    char *slash;
+    while ((slash = strrchr(dir, '/')) != NULL) {
+        *slash = '\0';
+        remove_tree_locked(idx, dir);
+    }
+    remove_tree_locked(idx, "");
+    pthread_mutex_unlock(&idx->lock);
+}
+
+int index_write(struct index *idx) {
+    if (!idx) return -1;
+
+    pthread_mutex_lock(&idx->lock);
+    sort_locked(idx);
+
+    size_t total = INDEX_HEADER_SIZE + SHA_DIGEST_LENGTH;
+    for (int i = 0; i < idx->count; i++) total += entry_disk_size(strlen(idx->entries[i].path));
+    size_t tree_ext_size = 0;
+    for (int i = 0; i < idx->tree_count; i++) tree_ext_size += TREE_REC_FIXED + strlen(idx->trees[i].path) + 1;
+    if (idx->tree_count) total += EXT_HEADER_SIZE + tree_ext_size;
+    size_t token_len = idx->fsmonitor_next ? strlen(idx->fsmonitor_next) : 0;
+    if (token_len) total += EXT_HEADER_SIZE + token_len;
+
+    unsigned char *buffer = calloc(1, total);
+    if (!buffer) {
+        pthread_mutex_unlock(&idx->lock);
+        return -1;
+    }
+
+    memcpy(buffer, INDEX_MAGIC, 4);
+    put_be32(buffer + 4, INDEX_VERSION);
+    put_be32(buffer + 8, idx->count);
+    unsigned char *ptr = buffer + INDEX_HEADER_SIZE;
+    for (int i = 0; i < idx->count; i++) {
+        const struct index_entry *e = &idx->entries[i];
+        size_t path_len = strlen(e->path);
+        put_be32(ptr + ENTRY_OFF_CTIME, e->ctime_sec);
+        put_be32(ptr + ENTRY_OFF_CTIME + 4, e->ctime_nsec);
+        put_be32(ptr + ENTRY_OFF_MTIME, e->mtime_sec);
+        put_be32(ptr + ENTRY_OFF_MTIME + 4, e->mtime_nsec);
+        put_be64(ptr + ENTRY_OFF_INO, e->ino);
+        put_be64(ptr + ENTRY_OFF_SIZE, e->size);
+        put_be32(ptr + ENTRY_OFF_MODE, e->mode);
+        memcpy(ptr + ENTRY_OFF_SHA1, e->sha1, SHA_DIGEST_LENGTH);
+        put_be16(ptr + ENTRY_OFF_FLAGS, e->flags);
+        put_be16(ptr + ENTRY_OFF_PATHLEN, (uint16_t)path_len);
+        memcpy(ptr + INDEX_ENTRY_FIXED, e->path, path_len);
+        ptr += entry_disk_size(path_len);
+    }
+    if (idx->tree_count) {
+        memcpy(ptr, EXT_CACHE_TREE, 4);
+        put_be32(ptr + 4, (uint32_t)tree_ext_size);
+        ptr += EXT_HEADER_SIZE;
+        for (int i = 0; i < idx->tree_count; i++) {
+            const struct cache_tree_entry *t = &idx->trees[i];
+            size_t path_len = strlen(t->path);
+            put_be32(ptr, t->entry_count | (t->stored ? TREE_REC_STORED : 0));
+            memcpy(ptr + 4, t->sha1, SHA_DIGEST_LENGTH);
+            memcpy(ptr + TREE_REC_FIXED, t->path, path_len + 1);
+            ptr += TREE_REC_FIXED + path_len + 1;
+        }
+    }
+    if (token_len) {
+        memcpy(ptr, EXT_FSMONITOR, 4);
+        put_be32(ptr + 4, (uint32_t)token_len);
+        memcpy(ptr + EXT_HEADER_SIZE, idx->fsmonitor_next, token_len);
+    }
+    pthread_mutex_unlock(&idx->lock);
+    SHA1(buffer, total - SHA_DIGEST_LENGTH, buffer + total - SHA_DIGEST_LENGTH);
+
+    // Write beside the real file and rename over it, so readers only ever
+    // see the old index or the complete new one.
+    int fd = open(INDEX_LOCK_FILE, O_WRONLY | O_CREAT | O_EXCL, 0644);
+    if (fd < 0) {
+        if (errno == EEXIST) {
+            fprintf(stderr, "Error: %s exists. Another version_forge process may be running;\n"
+                            "remove the file if that is not the case.\n", INDEX_LOCK_FILE);
+        } else {
+            perror("Error creating index lock file");
+        }
+        free(buffer);
+        return -1;
+    }
+
+    size_t written = 0;
+    while (written < total) {
+        ssize_t n = write(fd, buffer + written, total - written);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        written += n;
+    }
+    free(buffer);
+
+    if (written != total || fsync(fd) != 0) {
+        perror("Error writing index");
+        close(fd);
+        unlink(INDEX_LOCK_FILE);
+        return -1;
+    }
+    close(fd);
+
+    if (rename(INDEX_LOCK_FILE, INDEX_FILE) != 0) {
+        perror("Error updating index");
+        unlink(INDEX_LOCK_FILE);
+        return -1;
+    }
+    return 0;
+}
+
+void index_free(struct index *idx) {
+    if (!idx) return;
+    if (idx->map) munmap(idx->map, idx->map_size);
+    free(idx->records);
+    free(idx->tree_records);
+    for (int i = 0; i < idx->count; i++) free(idx->entries[i].path);
+    free(idx->entries);
+    for (int i = 0; i < idx->tree_count; i++) free(idx->trees[i].path);
+    free(idx->trees);
+    free(idx->fsmonitor_token);
+    free(idx->fsmonitor_next);
+    pthread_mutex_destroy(&idx->lock);
+    free(idx);
+}
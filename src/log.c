@@ -4,21 +4,8 @@
 
 #include "log.h"
 #include "utils.h"
-#include "database.h"
-
-// Helper to parse commit data
-// Finds the first "parent <hash>" line and returns the hash
-static int get_parent_hash(const char *commit_data, char *out_parent_hash) {
-    const char *parent_line = strstr(commit_data, "parent ");
-    if (parent_line == NULL) {
-        return -1; // No parent
-    }
-
-    // "parent " is 7 chars. Copy the 40-char hash after it.
-    strncpy(out_parent_hash, parent_line + 7, 40);
-    out_parent_hash[40] = '\0';
-    return 0;
-}
+#include "object_view.h"
+#include "commit_graph.h"
 
 int do_log() {
     char current_hash[41];
@@ -34,52 +21,41 @@ int do_log() {
         return 0;
     }
 
-    // 2. Loop by following parent hashes
+    // 2. Loop by following parent hashes. They come from the commit graph
+    // (built here if it is missing); without one, from each commit object.
+    uint32_t pos;
+    struct commit_graph *graph = commit_graph_lookup(current_hash, &pos);
     while (1) {
-        char *type = NULL;
-        char *commit_data = NULL;
-        size_t commit_size = 0;
-
-        // 3. Read the commit object
-        if (read_object(current_hash, &type, &commit_data, &commit_size) != 0) {
+        // 3. Read the commit; the header is checked first, so a hash that
+        // names some other object is rejected without inflating it.
+        struct object_view *commit = object_view_open_as(current_hash, "commit");
+        struct commit_view cv;
+        if (!commit || commit_view_parse(commit, &cv) != 0) {
             fprintf(stderr, "Error: Could not read commit %s\n", current_hash);
-            break;
-        }
-
-        if (type == NULL || strcmp(type, "commit") != 0) {
-            fprintf(stderr, "Error: Object %s is not a commit.\n", current_hash);
-            free(type);
-            free(commit_data);
+            object_view_release(commit);
             break;
         }
 
         // 4. Print commit info
         printf("commit %s\n", current_hash);
-
-        // Simple parser: find author and message
-        char *author_line = strstr(commit_data, "author ");
-        char *message_start = strstr(commit_data, "\n\n");
-
-        if (author_line) {
-            char *end_of_line = strstr(author_line, "\n");
-            if (end_of_line) {
-                printf("%.*s\n", (int)(end_of_line - author_line), author_line);
+        if (cv.author.ptr) printf("author %.*s\n", (int)cv.author.len, cv.author.ptr);
+        if (cv.message.len) printf("\n%s\n", cv.message.ptr);
+
+        // 5. Follow the first parent
+        int has_parent;
+        struct commit_graph_entry e;
+        if (graph && commit_graph_entry(graph, pos, &e) == 0) {
+            has_parent = e.parent_count > 0;
+            if (has_parent) {
+                pos = e.parents[0];
+                sha1_bin_to_hex(commit_graph_sha1(graph, pos), current_hash);
             }
-        }
-        if (message_start) {
-            printf("\n%s\n", message_start + 2); // +2 to skip the \n\n
-        }
-
-        // 5. Find the parent and continue
-        char parent_hash[41];
-        if (get_parent_hash(commit_data, parent_hash) == 0) {
-            strncpy(current_hash, parent_hash, 41);
         } else {
-            break; // No more parents
+            has_parent = cv.parent_count > 0;
+            if (has_parent) object_slice_copy(cv.parents[0], current_hash, sizeof(current_hash));
         }
-
-        free(type);
-        free(commit_data);
+        object_view_release(commit);
+        if (!has_parent) break; // No more parents
     }
 
     return 0;
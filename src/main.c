@@ -2,6 +2,7 @@
 #include <string.h>
 #include <stdlib.h>
 #include <unistd.h> 
+#include <sys/stat.h>
 
 #include "init.h"
 #include "database.h"
@@ -16,6 +17,8 @@
 #include "merge.h"
 #include "rebase.h" 
 #include "config.h" 
+#include "repack.h"
+#include "fsmonitor.h"
 
 int main(int argc, char *argv[]) {
     // 1. Setup Signal Handling
@@ -35,6 +38,8 @@ int main(int argc, char *argv[]) {
         fprintf(stderr, "  branch <name>\n");
         fprintf(stderr, "  merge <branch>\n");
         fprintf(stderr, "  rebase -i <branch>\n");
+        fprintf(stderr, "  repack\n");
+        fprintf(stderr, "  fsmonitor start|stop|status\n");
         fprintf(stderr, "  push\n");
         fprintf(stderr, "  pull\n");
         fprintf(stderr, "  fork\n");
@@ -65,20 +70,17 @@ int main(int argc, char *argv[]) {
             return 1;
         }
         char *filepath = argv[2];
-        size_t file_size = 0;
-        char *file_content = read_file_to_buffer(filepath, &file_size);
-        if (file_content == NULL) {
+        struct stat s;
+        if (stat(filepath, &s) != 0 || !S_ISREG(s.st_mode)) {
             fprintf(stderr, "Error: Could not read file '%s'\n", filepath);
             return 1;
         }
         char sha1_hex[41];
-        if (write_object(file_content, file_size, "blob", sha1_hex, NULL) != 0) {
+        if (write_object_from_file(filepath, s.st_size, sha1_hex, NULL) != 0) {
             fprintf(stderr, "Error: Could not write blob object for '%s'\n", filepath);
-            free(file_content);
             return 1;
         }
         printf("%s\n", sha1_hex);
-        free(file_content);
     } 
     else if (strcmp(command, "commit") == 0) {
         if (argc < 4 || strcmp(argv[2], "-m") != 0) {
@@ -130,6 +132,16 @@ int main(int argc, char *argv[]) {
         }
         return do_rebase_interactive(argv[3]);
     }
+    else if (strcmp(command, "repack") == 0) {
+        return do_repack();
+    }
+    else if (strcmp(command, "fsmonitor") == 0) {
+        if (argc != 3) {
+            fprintf(stderr, "Usage: %s fsmonitor start|stop|status|run\n", argv[0]);
+            return 1;
+        }
+        return do_fsmonitor(argv[2]);
+    }
     else if (strcmp(command, "test-signals") == 0) {
         printf("Running signal test... (Press Ctrl+C to stop)\n");
         while (!shutdown_requested) {
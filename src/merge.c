@@ -7,62 +7,62 @@
 #include "merge.h"
 #include "utils.h"
 #include "database.h"
+#include "object_view.h"
+#include "commit_graph.h"
+#include "worker_pool.h"
 // We define a local helper instead of depending on checkout's internals
 // to perform the "Overlay" logic without deleting existing files.
 
-static int merge_tree_overlay(const char *tree_hash, const char *path) {
-    char *type = NULL;
-    char *data = NULL;
-    size_t size = 0;
-
-    if (read_object(tree_hash, &type, &data, &size) != 0) return -1;
-    if (strcmp(type, "tree") != 0) { free(type); free(data); return -1; }
-
-    char *ptr = data;
-    while (ptr < data + size) {
-        char *mode = ptr;
-        char *name_start = strchr(ptr, ' ');
-        if (!name_start) break;
-        *name_start = '\0';
-        ptr = name_start + 1;
-
-        char *name = ptr;
-        char *sha1_start = strchr(ptr, '\0');
-        if (!sha1_start) break;
-        ptr = sha1_start + 1 + SHA_DIGEST_LENGTH; 
-        
-        unsigned char *sha1_bin = (unsigned char*)(sha1_start + 1);
+// One file to overwrite or create; runs on the worker pool.
+struct merge_file_args {
+    char sha1_hex[41];
+    char *path;
+};
+
+static void merge_file_task(void *arg) {
+    struct merge_file_args *args = (struct merge_file_args *)arg;
+    struct object_view *blob = object_view_read(args->sha1_hex);
+    if (blob) {
+        FILE *f = fopen(args->path, "wb");
+        if (f) {
+            fwrite(object_view_data(blob), 1, object_view_size(blob), f);
+            fclose(f);
+        }
+        object_view_release(blob);
+    }
+    free(args->path);
+    free(args);
+}
+
+static int merge_tree_overlay(threadpool_group_t *group, const char *tree_hash, const char *path) {
+    struct object_view *tree = object_view_open(tree_hash);
+    if (!tree) return -1;
+    struct tree_iter it;
+    if (tree_iter_init(&it, tree) != 0) { object_view_release(tree); return -1; }
+
+    struct tree_entry_view e;
+    while (tree_iter_next(&it, &e) == 1) {
         char sha1_hex[41];
-        sha1_bin_to_hex(sha1_bin, sha1_hex);
+        sha1_bin_to_hex(e.sha1, sha1_hex);
 
         char full_path[1024];
-        snprintf(full_path, sizeof(full_path), "%s/%s", path, name);
+        snprintf(full_path, sizeof(full_path), "%s/%s", path, e.name.ptr);
 
         // *** LOGIC CHANGE: WE DO NOT DELETE ANYTHING ***
         // We only write what is in the branch we are merging FROM.
 
-        if (strcmp(mode, "040000") == 0) { 
+        if (e.is_dir) { 
             mkdir(full_path, 0755); // Ensure dir exists
-            merge_tree_overlay(sha1_hex, full_path); // Recurse
+            merge_tree_overlay(group, sha1_hex, full_path); // Recurse
         } else { 
             // File: Overwrite content if it exists, or create if new
-            char *blob_type = NULL;
-            char *blob_data = NULL;
-            size_t blob_size = 0;
-            if (read_object(sha1_hex, &blob_type, &blob_data, &blob_size) == 0) {
-                FILE *f = fopen(full_path, "wb");
-                if (f) {
-                    fwrite(blob_data, 1, blob_size, f);
-                    fclose(f);
-                    // printf("Merged file: %s\n", name);
-                }
-                free(blob_type);
-                free(blob_data);
-            }
+            struct merge_file_args *args = malloc(sizeof(struct merge_file_args));
+            strcpy(args->sha1_hex, sha1_hex);
+            args->path = strdup(full_path);
+            if (threadpool_group_submit(group, merge_file_task, args) != 0) merge_file_task(args);
         }
     }
-    free(type);
-    free(data);
+    object_view_release(tree);
     return 0;
 }
 
@@ -92,25 +92,25 @@ int do_merge(const char *branch_name) {
     printf("Current HEAD: %s\n", current_hash);
     printf("Merging Ref:  %s\n", target_hash);
 
-    if (strcmp(current_hash, target_hash) == 0) {
+    // Merging an ancestor of HEAD would only move HEAD back.
+    if (strcmp(current_hash, target_hash) == 0 || commit_graph_is_ancestor(target_hash, current_hash) == 1) {
         printf("Already up to date.\n");
         return 0;
     }
 
     // 3. Get Target Tree Hash
     // We need the tree hash of the branch we are merging IN
-    char *type = NULL, *data = NULL;
-    size_t size;
     char target_tree_hash[41];
-    
-    if (read_object(target_hash, &type, &data, &size) == 0) {
-        char *tree_line = strstr(data, "tree ");
-        if (tree_line) {
-             strncpy(target_tree_hash, tree_line + 5, 40);
-             target_tree_hash[40] = '\0';
-        }
-        free(type); free(data);
-    } else {
+    struct object_view *commit = object_view_open_as(target_hash, "commit");
+    if (!commit) {
+        fprintf(stderr, "Error: %s is not a commit.\n", target_hash);
+        return 1;
+    }
+    struct commit_view cv;
+    int parsed = commit_view_parse(commit, &cv);
+    if (parsed == 0) object_slice_copy(cv.tree, target_tree_hash, sizeof(target_tree_hash));
+    object_view_release(commit);
+    if (parsed != 0) {
         fprintf(stderr, "Error reading target commit.\n");
         return 1;
     }
@@ -118,7 +118,11 @@ int do_merge(const char *branch_name) {
     // 4. Perform Overlay Merge (Union)
     // This adds 'feature' files to 'main' files without deleting 'main' files.
     printf("Performing Union Merge (Appending changes)...\n");
-    if (merge_tree_overlay(target_tree_hash, ".") != 0) {
+    threadpool_group_t *group = threadpool_group_create(get_worker_pool());
+    int merge_status = merge_tree_overlay(group, target_tree_hash, ".");
+    threadpool_group_wait(group);
+    threadpool_group_destroy(group);
+    if (merge_status != 0) {
         fprintf(stderr, "Merge failed.\n");
         return 1;
     }
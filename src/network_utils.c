@@ -8,17 +8,15 @@
 
 #include "network_utils.h"
 #include "utils.h" // For read_file_to_buffer
+#include "database.h"
+#include "pack.h"
 
-void send_object_file(int sock, const char *filepath, const char *filename) {
-    size_t size;
-    char *content = read_file_to_buffer(filepath, &size);
-    if (!content) return;
-
+void send_object_data(int sock, const char *hash, const unsigned char *content, size_t size) {
     char header[256];
     char buffer[1024];
 
     // 1. Send Header
-    snprintf(header, sizeof(header), "OBJ %s %zu", filename, size);
+    snprintf(header, sizeof(header), "OBJ %s %zu", hash, size);
     send(sock, header, strlen(header), 0);
 
     // 2. Wait for ACK
@@ -26,40 +24,95 @@ void send_object_file(int sock, const char *filepath, const char *filename) {
 
     // 3. Send Content
     send(sock, content, size, 0);
-    free(content);
 
     // 4. Wait for Saved Confirmation
     read(sock, buffer, 1024); 
-    printf("Transferred: %s\n", filename);
+    printf("Transferred: %s\n", hash);
+}
+
+void send_object_file(int sock, const char *filepath, const char *hash) {
+    size_t size;
+    char *content = read_file_to_buffer(filepath, &size);
+    if (!content) return;
+    send_object_data(sock, hash, (const unsigned char *)content, size);
+    free(content);
+}
+
+static int send_packed_object(const unsigned char *sha1, void *data) {
+    int sock = *(int *)data;
+    char hash[41];
+    sha1_bin_to_hex(sha1, hash);
+
+    unsigned char *content;
+    size_t size;
+    if (read_object_loose_bytes(hash, &content, &size) != 0) {
+        fprintf(stderr, "Error: could not read packed object %s\n", hash);
+        return 0;
+    }
+    send_object_data(sock, hash, content, size);
+    free(content);
+    return 0;
 }
 
 void scan_and_send(int sock, const char *base_path) {
     DIR *d = opendir(base_path);
     if (!d) return;
 
-    struct dirent *entry;
-    while ((entry = readdir(d)) != NULL) {
-        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) continue;
+    // Loose objects live in the two-hex-char fanout directories; the
+    // "pack" directory is handled below.
+    struct dirent *fanout;
+    while ((fanout = readdir(d)) != NULL) {
+        if (strlen(fanout->d_name) != 2 || strcmp(fanout->d_name, "..") == 0) continue;
 
-        char full_path[1024];
-        snprintf(full_path, sizeof(full_path), "%s/%s", base_path, entry->d_name);
+        char dir_path[1024];
+        snprintf(dir_path, sizeof(dir_path), "%s/%s", base_path, fanout->d_name);
+        DIR *sub = opendir(dir_path);
+        if (!sub) continue;
 
-        struct stat s;
-        stat(full_path, &s);
+        struct dirent *entry;
+        while ((entry = readdir(sub)) != NULL) {
+            if (strlen(entry->d_name) != 38) continue;
 
-        if (S_ISDIR(s.st_mode)) {
-            scan_and_send(sock, full_path);
-        } else {
-            send_object_file(sock, full_path, entry->d_name);
+            char full_path[2048];
+            char hash[41];
+            snprintf(full_path, sizeof(full_path), "%s/%s", dir_path, entry->d_name);
+            snprintf(hash, sizeof(hash), "%.2s%.38s", fanout->d_name, entry->d_name);
+            send_object_file(sock, full_path, hash);
         }
+        closedir(sub);
     }
     closedir(d);
+
+    pack_for_each_object(send_packed_object, &sock);
 }
 
 void receive_object_file(int sock, char *hash, int size) {
     char dir[256];
     char path[256];
-    
+    char tmp_path[256];
+
+    // Always consume the bytes, to keep the protocol in sync
+    char *file_buf = malloc(size);
+    int remaining = size;
+    int received = 0;
+    while (file_buf && remaining > 0) {
+        int r = read(sock, file_buf + received, remaining);
+        if (r <= 0) break;
+        received += r;
+        remaining -= r;
+    }
+    if (!file_buf || received != size) {
+        fprintf(stderr, "Error: short read for object %s\n", hash);
+        free(file_buf);
+        return;
+    }
+
+    unsigned char sha1[SHA_DIGEST_LENGTH];
+    if (sha1_hex_to_bin(hash, sha1) == 0 && has_object(sha1)) {
+        free(file_buf);
+        return; // Already have it
+    }
+
     snprintf(dir, sizeof(dir), ".minivcs/objects/%.2s", hash);
     // Ensure utils.h or sys/stat is included for mkdir
     #ifdef _WIN32
@@ -67,31 +120,28 @@ void receive_object_file(int sock, char *hash, int size) {
     #else
         mkdir(dir, 0755);
     #endif
-    
     snprintf(path, sizeof(path), "%s/%.38s", dir, hash + 2);
-    FILE *f = fopen(path, "wb");
-    
+
+    // Write to a temp file and rename, so a dropped connection or crash
+    // never leaves a truncated object under the real name.
+    snprintf(tmp_path, sizeof(tmp_path), ".minivcs/objects/tmp_obj_XXXXXX");
+    int fd = mkstemp(tmp_path);
+    FILE *f = fd >= 0 ? fdopen(fd, "wb") : NULL;
     if (!f) {
         perror("File write failed");
-        // Consume the bytes anyway to keep protocol in sync
-        char *dump = malloc(size);
-        read(sock, dump, size);
-        free(dump);
+        if (fd >= 0) { close(fd); unlink(tmp_path); }
+        free(file_buf);
         return;
     }
+    fchmod(fd, 0644);
 
-    char *file_buf = malloc(size);
-    int remaining = size;
-    int received = 0;
-    while (remaining > 0) {
-        int r = read(sock, file_buf + received, remaining);
-        if (r <= 0) break;
-        received += r;
-        remaining -= r;
-    }
-    
-    fwrite(file_buf, 1, received, f);
-    fclose(f);
+    int ok = fwrite(file_buf, 1, received, f) == (size_t)received;
+    if (fclose(f) != 0) ok = 0;
     free(file_buf);
+    if (!ok || rename(tmp_path, path) != 0) {
+        perror("File write failed");
+        unlink(tmp_path);
+        return;
+    }
     printf("Saved object: %s\n", hash);
 }
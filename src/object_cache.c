@@ -0,0 +1,185 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "object_cache.h"
+#include "config.h"
+#include "utils.h"
+
+#define OBJECT_CACHE_BUCKETS 4096   // Power of two
+
+static struct cached_object *buckets[OBJECT_CACHE_BUCKETS];
+static struct cached_object *lru_head; // Most recently used
+static struct cached_object *lru_tail; // Next to be evicted
+static size_t cache_bytes;
+static size_t cache_limit;
+static long cache_hits;
+static long cache_misses;
+static pthread_mutex_t cache_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t cache_once = PTHREAD_ONCE_INIT;
+
+static void load_cache_limit() {
+    cache_limit = get_config_size(OBJECT_CACHE_LIMIT_KEY, OBJECT_CACHE_DEFAULT_LIMIT);
+}
+
+static size_t object_charge(const struct cached_object *obj) {
+    return sizeof(*obj) + obj->size + 1;
+}
+
+static unsigned int bucket_of(const unsigned char *sha1) {
+    return (unsigned int)get_be32(sha1) & (OBJECT_CACHE_BUCKETS - 1);
+}
+
+static void free_object(struct cached_object *obj) {
+    free((char *)obj->data);
+    free(obj);
+}
+
+// The following helpers expect cache_lock to be held.
+
+static void lru_unlink(struct cached_object *obj) {
+    if (obj->lru_prev) obj->lru_prev->lru_next = obj->lru_next;
+    else lru_head = obj->lru_next;
+    if (obj->lru_next) obj->lru_next->lru_prev = obj->lru_prev;
+    else lru_tail = obj->lru_prev;
+    obj->lru_prev = obj->lru_next = NULL;
+}
+
+static void lru_push_front(struct cached_object *obj) {
+    obj->lru_prev = NULL;
+    obj->lru_next = lru_head;
+    if (lru_head) lru_head->lru_prev = obj;
+    lru_head = obj;
+    if (!lru_tail) lru_tail = obj;
+}
+
+static struct cached_object *find_locked(const unsigned char *sha1) {
+    for (struct cached_object *obj = buckets[bucket_of(sha1)]; obj; obj = obj->hash_next) {
+        if (memcmp(obj->sha1, sha1, SHA_DIGEST_LENGTH) == 0) return obj;
+    }
+    return NULL;
+}
+
+// Removes an object from the table and LRU. Returns 1 if the caller must free it.
+static int evict_locked(struct cached_object *obj) {
+    struct cached_object **link = &buckets[bucket_of(obj->sha1)];
+    while (*link != obj) link = &(*link)->hash_next;
+    *link = obj->hash_next;
+    lru_unlink(obj);
+    cache_bytes -= object_charge(obj);
+    obj->cached = 0;
+    return --obj->refs == 0;
+}
+
+static void insert_locked(struct cached_object *obj) {
+    size_t charge = object_charge(obj);
+    while (lru_tail && cache_bytes + charge > cache_limit) {
+        struct cached_object *victim = lru_tail;
+        if (evict_locked(victim)) free_object(victim);
+    }
+
+    unsigned int b = bucket_of(obj->sha1);
+    obj->hash_next = buckets[b];
+    buckets[b] = obj;
+    lru_push_front(obj);
+    cache_bytes += charge;
+    obj->cached = 1;
+    obj->refs++;
+}
+
+// Reads an object into a new, unshared entry (one reference, not cached).
+static struct cached_object *read_entry(const char *hash, const unsigned char *sha1) {
+    char *data = NULL;
+    size_t size = 0;
+    struct cached_object *obj = calloc(1, sizeof(struct cached_object));
+    if (!obj) return NULL;
+    if (read_object_typed(hash, obj->type, &data, &size) != 0) {
+        free(obj);
+        return NULL;
+    }
+    memcpy(obj->sha1, sha1, SHA_DIGEST_LENGTH);
+    obj->data = data;
+    obj->size = size;
+    obj->refs = 1;
+    return obj;
+}
+
+struct cached_object *object_cache_get(const char *hash) {
+    unsigned char sha1[SHA_DIGEST_LENGTH];
+    if (sha1_hex_to_bin(hash, sha1) != 0) return NULL;
+    pthread_once(&cache_once, load_cache_limit);
+
+    pthread_mutex_lock(&cache_lock);
+    struct cached_object *obj = find_locked(sha1);
+    if (obj) {
+        obj->refs++;
+        lru_unlink(obj);
+        lru_push_front(obj);
+        cache_hits++;
+        pthread_mutex_unlock(&cache_lock);
+        return obj;
+    }
+    cache_misses++;
+    pthread_mutex_unlock(&cache_lock);
+
+    // Read without holding the lock so other threads keep hitting the cache.
+    obj = read_entry(hash, sha1);
+    if (!obj) return NULL;
+
+    pthread_mutex_lock(&cache_lock);
+    struct cached_object *raced = find_locked(sha1);
+    if (raced) {
+        // Another thread read it first; share its copy.
+        raced->refs++;
+        pthread_mutex_unlock(&cache_lock);
+        free_object(obj);
+        return raced;
+    }
+    // Objects bigger than the whole budget are handed out uncached.
+    if (object_charge(obj) <= cache_limit) insert_locked(obj);
+    pthread_mutex_unlock(&cache_lock);
+    return obj;
+}
+
+struct cached_object *object_cache_peek(const char *hash) {
+    unsigned char sha1[SHA_DIGEST_LENGTH];
+    if (sha1_hex_to_bin(hash, sha1) != 0) return NULL;
+    pthread_mutex_lock(&cache_lock);
+    struct cached_object *obj = find_locked(sha1);
+    if (obj) {
+        obj->refs++;
+        lru_unlink(obj);
+        lru_push_front(obj);
+        cache_hits++;
+    }
+    pthread_mutex_unlock(&cache_lock);
+    return obj;
+}
+
+struct cached_object *object_cache_read(const char *hash) {
+    unsigned char sha1[SHA_DIGEST_LENGTH];
+    if (sha1_hex_to_bin(hash, sha1) != 0) return NULL;
+    return read_entry(hash, sha1);
+}
+
+void object_cache_retain(struct cached_object *obj) {
+    pthread_mutex_lock(&cache_lock);
+    obj->refs++;
+    pthread_mutex_unlock(&cache_lock);
+}
+
+void object_cache_release(struct cached_object *obj) {
+    if (!obj) return;
+    pthread_mutex_lock(&cache_lock);
+    int last = --obj->refs == 0;
+    pthread_mutex_unlock(&cache_lock);
+    if (last) free_object(obj);
+}
+
+void object_cache_stats(long *hits, long *misses) {
+    pthread_mutex_lock(&cache_lock);
+    if (hits) *hits = cache_hits;
+    if (misses) *misses = cache_misses;
+    pthread_mutex_unlock(&cache_lock);
+}
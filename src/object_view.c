@@ -0,0 +1,137 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "object_view.h"
+#include "object_cache.h"
+#include "database.h"
+
+// A view is an object cache entry: the cache already hands out shared,
+// reference-counted, read-only buffers. The handle type only keeps
+// callers to the accessors below.
+
+static struct cached_object *entry(const struct object_view *view) {
+    return (struct cached_object *)view;
+}
+
+struct object_view *object_view_open(const char *hash) {
+    return (struct object_view *)object_cache_get(hash);
+}
+
+struct object_view *object_view_open_as(const char *hash, const char *type) {
+    struct cached_object *obj = object_cache_peek(hash);
+    if (!obj) {
+        char header_type[OBJECT_TYPE_MAX];
+        size_t size;
+        if (read_object_header(hash, header_type, &size) != 0 || strcmp(header_type, type) != 0) return NULL;
+        obj = object_cache_get(hash);
+    }
+    if (obj && strcmp(obj->type, type) != 0) {
+        object_cache_release(obj);
+        return NULL;
+    }
+    return (struct object_view *)obj;
+}
+
+struct object_view *object_view_read(const char *hash) {
+    return (struct object_view *)object_cache_read(hash);
+}
+
+struct object_view *object_view_retain(struct object_view *view) {
+    object_cache_retain(entry(view));
+    return view;
+}
+
+void object_view_release(struct object_view *view) {
+    object_cache_release(entry(view));
+}
+
+const char *object_view_type(const struct object_view *view) {
+    return entry(view)->type;
+}
+
+const unsigned char *object_view_sha1(const struct object_view *view) {
+    return entry(view)->sha1;
+}
+
+const char *object_view_data(const struct object_view *view) {
+    return entry(view)->data;
+}
+
+size_t object_view_size(const struct object_view *view) {
+    return entry(view)->size;
+}
+
+char *object_slice_copy(struct object_slice slice, char *out, size_t size) {
+    snprintf(out, size, "%.*s", (int)slice.len, slice.ptr);
+    return out;
+}
+
+// --- Trees ---
+// Each entry is "<mode> <name>\0<20-byte SHA>".
+
+int tree_iter_init(struct tree_iter *it, const struct object_view *tree) {
+    it->ptr = it->end = NULL;
+    if (strcmp(object_view_type(tree), "tree") != 0) return -1;
+    it->ptr = object_view_data(tree);
+    it->end = it->ptr + object_view_size(tree);
+    return 0;
+}
+
+int tree_iter_next(struct tree_iter *it, struct tree_entry_view *out) {
+    if (it->ptr >= it->end) return 0;
+    const char *space = memchr(it->ptr, ' ', it->end - it->ptr);
+    if (!space) return -1;
+    const char *name = space + 1;
+    const char *nul = memchr(name, '\0', it->end - name);
+    if (!nul || nul + 1 + SHA_DIGEST_LENGTH > it->end) return -1;
+
+    out->mode.ptr = it->ptr;
+    out->mode.len = space - it->ptr;
+    out->name.ptr = name;
+    out->name.len = nul - name;
+    out->sha1 = (const unsigned char *)nul + 1;
+    out->is_dir = out->mode.len == 6 && memcmp(out->mode.ptr, "040000", 6) == 0;
+    it->ptr = nul + 1 + SHA_DIGEST_LENGTH;
+    return 1;
+}
+
+// --- Commits ---
+
+// A line's value, after "<key> ", when the line starts with it.
+static int header_value(const char *line, const char *line_end, const char *key, struct object_slice *out) {
+    size_t key_len = strlen(key);
+    if ((size_t)(line_end - line) <= key_len || memcmp(line, key, key_len) != 0 || line[key_len] != ' ') return 0;
+    out->ptr = line + key_len + 1;
+    out->len = line_end - out->ptr;
+    return 1;
+}
+
+int commit_view_parse(const struct object_view *commit, struct commit_view *out) {
+    memset(out, 0, sizeof(*out));
+    if (strcmp(object_view_type(commit), "commit") != 0) return -1;
+
+    const char *ptr = object_view_data(commit);
+    const char *end = ptr + object_view_size(commit);
+    out->message.ptr = end; // Empty unless there is a blank line
+    while (ptr < end) {
+        const char *line_end = memchr(ptr, '\n', end - ptr);
+        if (!line_end) line_end = end;
+        if (line_end == ptr) {
+            out->message.ptr = ptr + 1;
+            out->message.len = end - out->message.ptr;
+            break;
+        }
+        struct object_slice value;
+        if (!out->tree.ptr && header_value(ptr, line_end, "tree", &value)) {
+            out->tree = value;
+        } else if (header_value(ptr, line_end, "parent", &value)) {
+            if (out->parent_count < COMMIT_VIEW_MAX_PARENTS) out->parents[out->parent_count++] = value;
+        } else if (!out->author.ptr && header_value(ptr, line_end, "author", &value)) {
+            out->author = value;
+        } else if (!out->committer.ptr && header_value(ptr, line_end, "committer", &value)) {
+            out->committer = value;
+        }
+        ptr = line_end + 1;
+    }
+    return out->tree.len == 40 ? 0 : -1;
+}
@@ -0,0 +1,820 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <limits.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <openssl/sha.h>
+#include <openssl/evp.h>
+#include <zlib.h>
+
+#include "pack.h"
+#include "delta.h"
+#include "database.h"
+#include "utils.h"
+
+/*
+ * Pack layout (all integers big-endian):
+ *
+ *   .pack:  "VPAK" | u32 version | u32 object count | entries... | SHA-1 of the above
+ *   entry:  type/size header | zlib stream of the raw object payload
+ *
+ *   The entry header stores the type in bits 4-6 of the first byte and the
+ *   uncompressed size in its low 4 bits, continued 7 bits at a time in the
+ *   following bytes while the top bit is set. OBJ_REF_DELTA entries are
+ *   followed by the 20-byte SHA-1 of their base, then the zlib'd delta (see
+ *   delta.h); the size in their header is the size of the delta.
+ *
+ *   .idx:   "VIDX" | u32 version | fanout[256] u32 | sorted sha1[count] |
+ *           u64 offset[count] | pack checksum | SHA-1 of the above
+ */
+#define PACK_MAGIC "VPAK"
+#define IDX_MAGIC "VIDX"
+#define PACK_VERSION 1
+#define PACK_HEADER_SIZE 12
+#define IDX_HEADER_SIZE 8
+#define FANOUT_SIZE (256 * 4)
+
+#define PACK_DELTA_WINDOW 10                    // Candidate bases tried per object
+#define PACK_DELTA_DEPTH 10                     // Longest delta chain we create
+#define PACK_DELTA_MIN_SIZE 64                  // Smaller blobs are stored whole
+#define PACK_DELTA_MAX_SIZE (64 * 1024 * 1024)  // Larger blobs are stored whole
+#define PACK_MAX_CHAIN_DEPTH 64                 // Longest chain we accept when reading
+#define DELTA_BASE_CACHE_SLOTS 256
+#define DELTA_BASE_CACHE_LIMIT (16 * 1024 * 1024)
+
+static struct pack_file *packs = NULL;
+static int packs_loaded = 0;
+static pthread_mutex_t packs_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Lists dropped by reprepare_packs(). Callers walk the list get_packs()
+ * returned without the lock, so a dropped list stays mapped until exit. */
+struct retired_packs {
+    struct pack_file *list;
+    struct retired_packs *next;
+};
+static struct retired_packs *retired_packs = NULL;
+
+static void delta_base_cache_clear();
+
+const char *object_type_name(int type) {
+    switch (type) {
+        case OBJ_COMMIT: return "commit";
+        case OBJ_TREE: return "tree";
+        case OBJ_BLOB: return "blob";
+        default: return NULL;
+    }
+}
+
+int object_type_from_name(const char *name) {
+    if (strcmp(name, "commit") == 0) return OBJ_COMMIT;
+    if (strcmp(name, "tree") == 0) return OBJ_TREE;
+    if (strcmp(name, "blob") == 0) return OBJ_BLOB;
+    return OBJ_NONE;
+}
+
+static void *map_file(const char *path, size_t *out_size) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return NULL;
+    struct stat st;
+    void *map = NULL;
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+        map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map == MAP_FAILED) map = NULL;
+        else *out_size = st.st_size;
+    }
+    close(fd);
+    return map;
+}
+
+static void free_pack(struct pack_file *p) {
+    if (p->pack_map) munmap(p->pack_map, p->pack_size);
+    if (p->idx_map) munmap(p->idx_map, p->idx_size);
+    free(p);
+}
+
+// Maps one .idx and its .pack and checks that they belong together.
+static struct pack_file *open_pack(const char *idx_path) {
+    struct pack_file *p = calloc(1, sizeof(struct pack_file));
+    if (!p) return NULL;
+
+    size_t len = strlen(idx_path);
+    snprintf(p->pack_path, sizeof(p->pack_path), "%.*s.pack", (int)(len - 4), idx_path);
+
+    p->idx_map = map_file(idx_path, &p->idx_size);
+    p->pack_map = map_file(p->pack_path, &p->pack_size);
+    if (!p->idx_map || !p->pack_map) goto bad;
+
+    if (p->idx_size < IDX_HEADER_SIZE + FANOUT_SIZE + 2 * SHA_DIGEST_LENGTH) goto bad;
+    if (memcmp(p->idx_map, IDX_MAGIC, 4) != 0 || get_be32(p->idx_map + 4) != PACK_VERSION) goto bad;
+    if (p->pack_size < PACK_HEADER_SIZE + SHA_DIGEST_LENGTH) goto bad;
+    if (memcmp(p->pack_map, PACK_MAGIC, 4) != 0 || get_be32(p->pack_map + 4) != PACK_VERSION) goto bad;
+
+    p->fanout = p->idx_map + IDX_HEADER_SIZE;
+    p->count = get_be32(p->fanout + 255 * 4);
+    p->sha1s = p->fanout + FANOUT_SIZE;
+    p->offsets = p->sha1s + (size_t)p->count * SHA_DIGEST_LENGTH;
+
+    size_t expected = IDX_HEADER_SIZE + FANOUT_SIZE + (size_t)p->count * (SHA_DIGEST_LENGTH + 8) +
+                      2 * SHA_DIGEST_LENGTH;
+    if (p->idx_size != expected || get_be32(p->pack_map + 8) != p->count) goto bad;
+
+    // The idx records the checksum of the pack it was written for.
+    const unsigned char *pack_checksum = p->pack_map + p->pack_size - SHA_DIGEST_LENGTH;
+    if (memcmp(pack_checksum, p->idx_map + p->idx_size - 2 * SHA_DIGEST_LENGTH, SHA_DIGEST_LENGTH) != 0) goto bad;
+
+    return p;
+
+bad:
+    fprintf(stderr, "Warning: ignoring invalid pack index %s\n", idx_path);
+    free_pack(p);
+    return NULL;
+}
+
+struct pack_file *get_packs() {
+    pthread_mutex_lock(&packs_lock);
+    if (!packs_loaded) {
+        packs_loaded = 1;
+        DIR *d = opendir(PACK_DIR);
+        if (d) {
+            struct dirent *entry;
+            while ((entry = readdir(d)) != NULL) {
+                size_t len = strlen(entry->d_name);
+                if (len < 5 || strncmp(entry->d_name, "pack-", 5) != 0 ||
+                    strcmp(entry->d_name + len - 4, ".idx") != 0) continue;
+
+                char idx_path[512];
+                snprintf(idx_path, sizeof(idx_path), "%s/%s", PACK_DIR, entry->d_name);
+                struct pack_file *p = open_pack(idx_path);
+                if (p) {
+                    p->next = packs;
+                    packs = p;
+                }
+            }
+            closedir(d);
+        }
+    }
+    struct pack_file *result = packs;
+    pthread_mutex_unlock(&packs_lock);
+    return result;
+}
+
+void reprepare_packs() {
+    delta_base_cache_clear();
+    struct retired_packs *retired = malloc(sizeof(struct retired_packs));
+    pthread_mutex_lock(&packs_lock);
+    // Should the node not be allocated, the old list leaks instead.
+    if (retired && packs) {
+        retired->list = packs;
+        retired->next = retired_packs;
+        retired_packs = retired;
+        retired = NULL;
+    }
+    packs = NULL;
+    packs_loaded = 0;
+    pthread_mutex_unlock(&packs_lock);
+    free(retired);
+}
+
+// Binary search within the fanout bucket. Returns the position or -1.
+static long find_pack_entry(const struct pack_file *p, const unsigned char *sha1) {
+    uint32_t lo = sha1[0] ? get_be32(p->fanout + (sha1[0] - 1) * 4) : 0;
+    uint32_t hi = get_be32(p->fanout + sha1[0] * 4);
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        int cmp = memcmp(sha1, p->sha1s + (size_t)mid * SHA_DIGEST_LENGTH, SHA_DIGEST_LENGTH);
+        if (cmp == 0) return mid;
+        if (cmp < 0) hi = mid;
+        else lo = mid + 1;
+    }
+    return -1;
+}
+
+int pack_has_object(const unsigned char *sha1) {
+    for (struct pack_file *p = get_packs(); p; p = p->next) {
+        if (find_pack_entry(p, sha1) >= 0) return 1;
+    }
+    return 0;
+}
+
+// Decodes an entry header. Returns its length in bytes, or 0 if malformed.
+static size_t decode_entry_header(const unsigned char *ptr, size_t avail, int *out_type, uint64_t *out_size) {
+    if (avail == 0) return 0;
+    size_t used = 0;
+    unsigned char c = ptr[used++];
+    *out_type = (c >> 4) & 7;
+    uint64_t size = c & 15;
+    int shift = 4;
+    while (c & 0x80) {
+        if (used >= avail || shift > 57) return 0;
+        c = ptr[used++];
+        size |= (uint64_t)(c & 0x7f) << shift;
+        shift += 7;
+    }
+    *out_size = size;
+    return used;
+}
+
+static size_t encode_entry_header(unsigned char *out, int type, uint64_t size) {
+    size_t used = 0;
+    unsigned char c = (type << 4) | (size & 15);
+    size >>= 4;
+    while (size) {
+        out[used++] = c | 0x80;
+        c = size & 0x7f;
+        size >>= 7;
+    }
+    out[used++] = c;
+    return used;
+}
+
+// zlib counts bytes in uInt: buffers of 4 GiB and more go in slices.
+static uInt zlib_slice(size_t len) {
+    return len > UINT_MAX ? UINT_MAX : (uInt)len;
+}
+
+// Inflates exactly 'size' bytes starting at 'ptr' into a new NUL-terminated buffer.
+static char *inflate_exact(const unsigned char *ptr, size_t avail, size_t size) {
+    char *out = malloc(size + 1);
+    if (!out) return NULL;
+
+    z_stream strm;
+    memset(&strm, 0, sizeof(strm));
+    if (inflateInit(&strm) != Z_OK) {
+        free(out);
+        return NULL;
+    }
+    strm.next_in = (Bytef *)ptr;
+    strm.next_out = (Bytef *)out;
+    size_t in_left = avail, out_left = size;
+    int ret;
+    do {
+        if (strm.avail_in == 0 && in_left) {
+            strm.avail_in = zlib_slice(in_left);
+            in_left -= strm.avail_in;
+        }
+        if (strm.avail_out == 0 && out_left) {
+            strm.avail_out = zlib_slice(out_left);
+            out_left -= strm.avail_out;
+        }
+        ret = inflate(&strm, Z_NO_FLUSH);
+    } while (ret == Z_OK);
+    size_t produced = size - out_left - strm.avail_out;
+    inflateEnd(&strm);
+    if (ret != Z_STREAM_END || produced != size) {
+        free(out);
+        return NULL;
+    }
+    out[size] = '\0';
+    return out;
+}
+
+static int find_object_in_packs(const unsigned char *sha1, struct pack_file **out_pack, uint64_t *out_offset) {
+    for (struct pack_file *p = get_packs(); p; p = p->next) {
+        long pos = find_pack_entry(p, sha1);
+        if (pos < 0) continue;
+        *out_pack = p;
+        *out_offset = get_be64(p->offsets + (size_t)pos * 8);
+        return 0;
+    }
+    return -1;
+}
+
+// --- Delta base cache ---
+// Direct-mapped by (pack, offset), bounded in bytes with LRU eviction. Holds
+// reconstructed delta bases so walking a chain of versions does not rebuild
+// every base from scratch.
+
+struct delta_base_slot {
+    struct pack_file *pack;
+    uint64_t offset;
+    int type;
+    char *data;
+    size_t size;
+    unsigned long last_used;
+};
+
+static struct delta_base_slot delta_base_cache[DELTA_BASE_CACHE_SLOTS];
+static size_t delta_base_cached_bytes = 0;
+static unsigned long delta_base_tick = 0;
+static pthread_mutex_t delta_base_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static struct delta_base_slot *delta_base_slot_for(struct pack_file *p, uint64_t offset) {
+    uintptr_t key = (uintptr_t)p ^ (uintptr_t)(offset * 2654435761u);
+    return &delta_base_cache[(key ^ (key >> 8)) % DELTA_BASE_CACHE_SLOTS];
+}
+
+static void delta_base_evict(struct delta_base_slot *slot) {
+    if (!slot->data) return;
+    delta_base_cached_bytes -= slot->size;
+    free(slot->data);
+    slot->data = NULL;
+    slot->pack = NULL;
+}
+
+static void delta_base_cache_clear() {
+    pthread_mutex_lock(&delta_base_lock);
+    for (int i = 0; i < DELTA_BASE_CACHE_SLOTS; i++) delta_base_evict(&delta_base_cache[i]);
+    pthread_mutex_unlock(&delta_base_lock);
+}
+
+// Returns a private copy of a cached base, or NULL on a miss.
+static char *delta_base_cache_get(struct pack_file *p, uint64_t offset, int *out_type, size_t *out_size) {
+    char *copy = NULL;
+    pthread_mutex_lock(&delta_base_lock);
+    struct delta_base_slot *slot = delta_base_slot_for(p, offset);
+    if (slot->data && slot->pack == p && slot->offset == offset) {
+        copy = malloc(slot->size + 1);
+        if (copy) {
+            memcpy(copy, slot->data, slot->size + 1);
+            *out_type = slot->type;
+            *out_size = slot->size;
+            slot->last_used = ++delta_base_tick;
+        }
+    }
+    pthread_mutex_unlock(&delta_base_lock);
+    return copy;
+}
+
+static void delta_base_cache_put(struct pack_file *p, uint64_t offset, int type, const char *data, size_t size) {
+    if (size > DELTA_BASE_CACHE_LIMIT / 4) return;
+    char *copy = malloc(size + 1);
+    if (!copy) return;
+    memcpy(copy, data, size + 1);
+
+    pthread_mutex_lock(&delta_base_lock);
+    struct delta_base_slot *slot = delta_base_slot_for(p, offset);
+    delta_base_evict(slot);
+    while (delta_base_cached_bytes + size > DELTA_BASE_CACHE_LIMIT) {
+        struct delta_base_slot *oldest = NULL;
+        for (int i = 0; i < DELTA_BASE_CACHE_SLOTS; i++) {
+            struct delta_base_slot *s = &delta_base_cache[i];
+            if (s->data && (!oldest || s->last_used < oldest->last_used)) oldest = s;
+        }
+        if (!oldest) break;
+        delta_base_evict(oldest);
+    }
+    slot->pack = p;
+    slot->offset = offset;
+    slot->type = type;
+    slot->data = copy;
+    slot->size = size;
+    slot->last_used = ++delta_base_tick;
+    delta_base_cached_bytes += size;
+    pthread_mutex_unlock(&delta_base_lock);
+}
+
+// Reconstructs the object stored at 'offset', following delta chains.
+static int unpack_entry(struct pack_file *p, uint64_t offset, int depth,
+                        int *out_type, char **out_data, size_t *out_size) {
+    size_t data_end = p->pack_size - SHA_DIGEST_LENGTH;
+    if (depth > PACK_MAX_CHAIN_DEPTH || offset < PACK_HEADER_SIZE || offset >= data_end) return -1;
+
+    int type;
+    uint64_t size;
+    const unsigned char *ptr = p->pack_map + offset;
+    size_t header_len = decode_entry_header(ptr, data_end - offset, &type, &size);
+    if (header_len == 0) return -1;
+    ptr += header_len;
+
+    if (type != OBJ_REF_DELTA) {
+        if (!object_type_name(type)) return -1;
+        char *data = inflate_exact(ptr, p->pack_map + data_end - ptr, size);
+        if (!data) return -1;
+        *out_type = type;
+        *out_data = data;
+        *out_size = size;
+        return 0;
+    }
+
+    if (ptr + SHA_DIGEST_LENGTH > p->pack_map + data_end) return -1;
+    const unsigned char *base_sha1 = ptr;
+    ptr += SHA_DIGEST_LENGTH;
+    char *delta = inflate_exact(ptr, p->pack_map + data_end - ptr, size);
+    if (!delta) return -1;
+
+    struct pack_file *base_pack;
+    uint64_t base_offset;
+    int base_type;
+    size_t base_size;
+    char *base = NULL;
+    if (find_object_in_packs(base_sha1, &base_pack, &base_offset) == 0) {
+        base = delta_base_cache_get(base_pack, base_offset, &base_type, &base_size);
+        if (!base && unpack_entry(base_pack, base_offset, depth + 1, &base_type, &base, &base_size) == 0) {
+            delta_base_cache_put(base_pack, base_offset, base_type, base, base_size);
+        }
+    }
+    if (!base) {
+        free(delta);
+        return -1;
+    }
+
+    size_t result_size;
+    char *result = apply_delta(base, base_size, delta, size, &result_size);
+    free(base);
+    free(delta);
+    if (!result) return -1;
+
+    *out_type = base_type;
+    *out_data = result;
+    *out_size = result_size;
+    return 0;
+}
+
+int pack_read_object_typed(const unsigned char *sha1, char *out_type, char **out_data, size_t *out_size) {
+    struct pack_file *p;
+    uint64_t offset;
+    if (find_object_in_packs(sha1, &p, &offset) != 0) return -1;
+
+    int type;
+    if (unpack_entry(p, offset, 0, &type, out_data, out_size) != 0) return -1;
+    strcpy(out_type, object_type_name(type));
+    return 0;
+}
+
+int pack_read_object(const unsigned char *sha1, char **out_type, char **out_data, size_t *out_size) {
+    char type[OBJECT_TYPE_MAX];
+    if (pack_read_object_typed(sha1, type, out_data, out_size) != 0) return -1;
+    *out_type = strdup(type);
+    if (!*out_type) {
+        free(*out_data);
+        return -1;
+    }
+    return 0;
+}
+
+// Reads the start of a delta to learn the size of the object it produces.
+static int delta_target_size(const unsigned char *ptr, size_t avail, size_t *out_size) {
+    unsigned char head[20];
+    z_stream strm;
+    memset(&strm, 0, sizeof(strm));
+    if (inflateInit(&strm) != Z_OK) return -1;
+    strm.next_in = (Bytef *)ptr;
+    strm.avail_in = zlib_slice(avail); // Only the first bytes are needed
+    strm.next_out = head;
+    strm.avail_out = sizeof(head);
+    int ret = inflate(&strm, Z_SYNC_FLUSH);
+    size_t len = sizeof(head) - strm.avail_out;
+    inflateEnd(&strm);
+    if (ret != Z_OK && ret != Z_STREAM_END) return -1;
+
+    // Skip the source size varint, then decode the target size varint.
+    size_t pos = 0;
+    while (pos < len && (head[pos] & 0x80)) pos++;
+    pos++;
+    size_t size = 0;
+    int shift = 0;
+    while (pos < len) {
+        size |= (size_t)(head[pos] & 0x7f) << shift;
+        shift += 7;
+        if (!(head[pos++] & 0x80)) {
+            *out_size = size;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+int pack_read_object_header(const unsigned char *sha1, char *out_type, size_t *out_size) {
+    struct pack_file *p;
+    uint64_t offset;
+    if (find_object_in_packs(sha1, &p, &offset) != 0) return -1;
+
+    // The size comes from the first entry; for a delta that is the target
+    // size recorded in the delta itself. The type comes from the chain's base.
+    int have_size = 0;
+    for (int depth = 0; depth <= PACK_MAX_CHAIN_DEPTH; depth++) {
+        size_t data_end = p->pack_size - SHA_DIGEST_LENGTH;
+        if (offset < PACK_HEADER_SIZE || offset >= data_end) return -1;
+
+        int type;
+        uint64_t size;
+        const unsigned char *ptr = p->pack_map + offset;
+        size_t header_len = decode_entry_header(ptr, data_end - offset, &type, &size);
+        if (header_len == 0) return -1;
+        ptr += header_len;
+
+        if (type != OBJ_REF_DELTA) {
+            const char *name = object_type_name(type);
+            if (!name) return -1;
+            strcpy(out_type, name);
+            if (!have_size) *out_size = size;
+            return 0;
+        }
+
+        if (ptr + SHA_DIGEST_LENGTH > p->pack_map + data_end) return -1;
+        if (!have_size) {
+            const unsigned char *delta = ptr + SHA_DIGEST_LENGTH;
+            if (delta_target_size(delta, p->pack_map + data_end - delta, out_size) != 0) return -1;
+            have_size = 1;
+        }
+        if (find_object_in_packs(ptr, &p, &offset) != 0) return -1;
+    }
+    return -1;
+}
+
+int pack_for_each_object(int (*fn)(const unsigned char *sha1, void *data), void *data) {
+    for (struct pack_file *p = get_packs(); p; p = p->next) {
+        for (uint32_t i = 0; i < p->count; i++) {
+            int ret = fn(p->sha1s + (size_t)i * SHA_DIGEST_LENGTH, data);
+            if (ret) return ret;
+        }
+    }
+    return 0;
+}
+
+// --- Writing ---
+
+struct pack_writer {
+    FILE *f;
+    EVP_MD_CTX *ctx;    // Running checksum of everything written
+    uint64_t offset;
+};
+
+static int pack_write_bytes(struct pack_writer *w, const void *buf, size_t len) {
+    if (fwrite(buf, 1, len, w->f) != len) return -1;
+    EVP_DigestUpdate(w->ctx, buf, len);
+    w->offset += len;
+    return 0;
+}
+
+static int pack_write_deflated(struct pack_writer *w, const void *data, size_t len) {
+    unsigned char out[16384];
+    z_stream strm;
+    memset(&strm, 0, sizeof(strm));
+    if (deflateInit(&strm, Z_DEFAULT_COMPRESSION) != Z_OK) return -1;
+    strm.next_in = (Bytef *)data;
+    size_t in_left = len;
+
+    int ret;
+    do {
+        if (strm.avail_in == 0 && in_left) {
+            strm.avail_in = zlib_slice(in_left);
+            in_left -= strm.avail_in;
+        }
+        strm.next_out = out;
+        strm.avail_out = sizeof(out);
+        ret = deflate(&strm, in_left ? Z_NO_FLUSH : Z_FINISH);
+        if (ret == Z_STREAM_ERROR ||
+            pack_write_bytes(w, out, sizeof(out) - strm.avail_out) != 0) {
+            deflateEnd(&strm);
+            return -1;
+        }
+    } while (ret != Z_STREAM_END);
+    deflateEnd(&strm);
+    return 0;
+}
+
+struct pack_index_entry {
+    unsigned char sha1[SHA_DIGEST_LENGTH];
+    uint64_t offset;
+};
+
+static int compare_pack_index_entries(const void *a, const void *b) {
+    return memcmp(((const struct pack_index_entry *)a)->sha1,
+                  ((const struct pack_index_entry *)b)->sha1, SHA_DIGEST_LENGTH);
+}
+
+static int write_pack_index(const char *path, struct pack_index_entry *entries, int count,
+                            const unsigned char *pack_checksum) {
+    FILE *f = fopen(path, "wb");
+    if (!f) return -1;
+
+    EVP_MD_CTX *ctx = EVP_MD_CTX_new();
+    EVP_DigestInit_ex(ctx, EVP_sha1(), NULL);
+    unsigned char buf[FANOUT_SIZE];
+
+    memcpy(buf, IDX_MAGIC, 4);
+    put_be32(buf + 4, PACK_VERSION);
+    fwrite(buf, 1, IDX_HEADER_SIZE, f);
+    EVP_DigestUpdate(ctx, buf, IDX_HEADER_SIZE);
+
+    int pos = 0;
+    for (int i = 0; i < 256; i++) {
+        while (pos < count && entries[pos].sha1[0] == i) pos++;
+        put_be32(buf + i * 4, pos);
+    }
+    fwrite(buf, 1, FANOUT_SIZE, f);
+    EVP_DigestUpdate(ctx, buf, FANOUT_SIZE);
+
+    for (int i = 0; i < count; i++) {
+        fwrite(entries[i].sha1, 1, SHA_DIGEST_LENGTH, f);
+        EVP_DigestUpdate(ctx, entries[i].sha1, SHA_DIGEST_LENGTH);
+    }
+    for (int i = 0; i < count; i++) {
+        put_be64(buf, entries[i].offset);
+        fwrite(buf, 1, 8, f);
+        EVP_DigestUpdate(ctx, buf, 8);
+    }
+    fwrite(pack_checksum, 1, SHA_DIGEST_LENGTH, f);
+    EVP_DigestUpdate(ctx, pack_checksum, SHA_DIGEST_LENGTH);
+
+    unsigned char checksum[SHA_DIGEST_LENGTH];
+    EVP_DigestFinal_ex(ctx, checksum, NULL);
+    EVP_MD_CTX_free(ctx);
+    fwrite(checksum, 1, SHA_DIGEST_LENGTH, f);
+
+    int err = ferror(f) || fflush(f) != 0 || fsync(fileno(f)) != 0;
+    fclose(f);
+    return err ? -1 : 0;
+}
+
+struct pack_object {
+    const char *hash;
+    const char *name;       // Path hint used to group versions of one file
+    int type;
+    size_t size;
+    int depth;              // Length of the delta chain below this object
+    uint64_t offset;
+};
+
+// Groups objects by type, then by path, largest first, so each object's
+// window holds earlier versions of the same file.
+static int compare_pack_objects(const void *a, const void *b) {
+    const struct pack_object *oa = a;
+    const struct pack_object *ob = b;
+    if (oa->type != ob->type) return oa->type - ob->type;
+    if (!oa->name != !ob->name) return oa->name ? -1 : 1;
+    if (oa->name && ob->name) {
+        int cmp = strcmp(oa->name, ob->name);
+        if (cmp) return cmp;
+    }
+    if (oa->size != ob->size) return oa->size > ob->size ? -1 : 1;
+    return strcmp(oa->hash, ob->hash);
+}
+
+struct window_slot {
+    struct pack_object *obj;
+    char *data;
+};
+
+int write_pack(char **hashes, char **names, int count, char *out_pack_hex, struct pack_stats *stats) {
+    if (mkdir(PACK_DIR, 0755) != 0 && errno != EEXIST) {
+        perror("Error creating pack directory");
+        return -1;
+    }
+
+    struct pack_stats local_stats;
+    if (!stats) stats = &local_stats;
+    memset(stats, 0, sizeof(*stats));
+
+    struct pack_object *objects = calloc(count ? count : 1, sizeof(struct pack_object));
+    if (!objects) return -1;
+
+    // Pass 1: learn every object's type and size so the list can be sorted.
+    for (int i = 0; i < count; i++) {
+        char type[OBJECT_TYPE_MAX];
+        size_t size = 0;
+        if (read_object_header(hashes[i], type, &size) != 0) {
+            fprintf(stderr, "Error: could not read object %s\n", hashes[i]);
+            free(objects);
+            return -1;
+        }
+        objects[i].hash = hashes[i];
+        objects[i].name = names ? names[i] : NULL;
+        objects[i].type = object_type_from_name(type);
+        objects[i].size = size;
+        stats->raw_bytes += size;
+    }
+    qsort(objects, count, sizeof(struct pack_object), compare_pack_objects);
+
+    char tmp_pack[256], tmp_idx[256];
+    snprintf(tmp_pack, sizeof(tmp_pack), "%s/tmp_pack_%d", PACK_DIR, (int)getpid());
+    snprintf(tmp_idx, sizeof(tmp_idx), "%s/tmp_idx_%d", PACK_DIR, (int)getpid());
+
+    struct pack_writer w;
+    w.f = fopen(tmp_pack, "wb");
+    w.offset = 0;
+    if (!w.f) {
+        perror("Error creating pack file");
+        free(objects);
+        return -1;
+    }
+    w.ctx = EVP_MD_CTX_new();
+    EVP_DigestInit_ex(w.ctx, EVP_sha1(), NULL);
+
+    unsigned char header[PACK_HEADER_SIZE];
+    memcpy(header, PACK_MAGIC, 4);
+    put_be32(header + 4, PACK_VERSION);
+    put_be32(header + 8, count);
+    int err = pack_write_bytes(&w, header, PACK_HEADER_SIZE);
+
+    // Pass 2: write each object, as a delta against the best of the
+    // previous PACK_DELTA_WINDOW objects when that is smaller.
+    struct window_slot window[PACK_DELTA_WINDOW];
+    memset(window, 0, sizeof(window));
+    int window_pos = 0;
+
+    for (int i = 0; i < count && !err; i++) {
+        struct pack_object *obj = &objects[i];
+        char *type = NULL, *data = NULL;
+        size_t size = 0;
+        if (read_object(obj->hash, &type, &data, &size) != 0) {
+            fprintf(stderr, "Error: could not read object %s\n", obj->hash);
+            err = 1;
+            break;
+        }
+        free(type);
+
+        void *best_delta = NULL;
+        size_t best_size = 0;
+        struct window_slot *best_base = NULL;
+        if (obj->type == OBJ_BLOB && size >= PACK_DELTA_MIN_SIZE && size <= PACK_DELTA_MAX_SIZE) {
+            for (int j = 0; j < PACK_DELTA_WINDOW; j++) {
+                struct window_slot *slot = &window[j];
+                if (!slot->obj || slot->obj->type != OBJ_BLOB || slot->obj->depth >= PACK_DELTA_DEPTH) continue;
+
+                size_t limit = best_delta ? best_size : size / 2;
+                size_t delta_size;
+                void *delta = create_delta(slot->data, slot->obj->size, data, size, limit, &delta_size);
+                if (!delta) continue;
+                if (delta_size < limit) {
+                    free(best_delta);
+                    best_delta = delta;
+                    best_size = delta_size;
+                    best_base = slot;
+                } else {
+                    free(delta);
+                }
+            }
+        }
+
+        obj->offset = w.offset;
+        unsigned char entry_header[16];
+        if (best_delta) {
+            unsigned char base_sha1[SHA_DIGEST_LENGTH];
+            sha1_hex_to_bin(best_base->obj->hash, base_sha1);
+            obj->depth = best_base->obj->depth + 1;
+            size_t header_len = encode_entry_header(entry_header, OBJ_REF_DELTA, best_size);
+            if (pack_write_bytes(&w, entry_header, header_len) != 0 ||
+                pack_write_bytes(&w, base_sha1, SHA_DIGEST_LENGTH) != 0 ||
+                pack_write_deflated(&w, best_delta, best_size) != 0) {
+                err = 1;
+            }
+            stats->deltas++;
+            free(best_delta);
+        } else {
+            size_t header_len = encode_entry_header(entry_header, obj->type, size);
+            if (pack_write_bytes(&w, entry_header, header_len) != 0 ||
+                pack_write_deflated(&w, data, size) != 0) {
+                err = 1;
+            }
+        }
+        stats->objects++;
+
+        // The object becomes a delta candidate for the ones after it.
+        struct window_slot *slot = &window[window_pos];
+        free(slot->data);
+        slot->obj = obj;
+        slot->data = data;
+        window_pos = (window_pos + 1) % PACK_DELTA_WINDOW;
+    }
+    for (int j = 0; j < PACK_DELTA_WINDOW; j++) free(window[j].data);
+
+    unsigned char checksum[SHA_DIGEST_LENGTH];
+    EVP_DigestFinal_ex(w.ctx, checksum, NULL);
+    EVP_MD_CTX_free(w.ctx);
+    if (!err && fwrite(checksum, 1, SHA_DIGEST_LENGTH, w.f) != SHA_DIGEST_LENGTH) err = 1;
+    if (!err && (fflush(w.f) != 0 || fsync(fileno(w.f)) != 0)) err = 1;
+    stats->pack_bytes = w.offset + SHA_DIGEST_LENGTH;
+    fclose(w.f);
+
+    if (!err) {
+        struct pack_index_entry *entries = malloc(sizeof(struct pack_index_entry) * (count ? count : 1));
+        if (!entries) {
+            err = 1;
+        } else {
+            for (int i = 0; i < count; i++) {
+                sha1_hex_to_bin(objects[i].hash, entries[i].sha1);
+                entries[i].offset = objects[i].offset;
+            }
+            qsort(entries, count, sizeof(struct pack_index_entry), compare_pack_index_entries);
+            err = write_pack_index(tmp_idx, entries, count, checksum) != 0;
+            free(entries);
+        }
+    }
+    free(objects);
+
+    char pack_hex[41];
+    sha1_bin_to_hex(checksum, pack_hex);
+    char final_pack[256], final_idx[256];
+    snprintf(final_pack, sizeof(final_pack), "%s/pack-%s.pack", PACK_DIR, pack_hex);
+    snprintf(final_idx, sizeof(final_idx), "%s/pack-%s.idx", PACK_DIR, pack_hex);
+
+    // The .idx is what readers look for, so it goes into place last.
+    if (err || rename(tmp_pack, final_pack) != 0 || rename(tmp_idx, final_idx) != 0) {
+        fprintf(stderr, "Error: failed to write pack\n");
+        unlink(tmp_pack);
+        unlink(tmp_idx);
+        return -1;
+    }
+
+    if (out_pack_hex) strcpy(out_pack_hex, pack_hex);
+    reprepare_packs();
+    return 0;
+}
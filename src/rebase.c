@@ -7,7 +7,7 @@
 
 #include "rebase.h"
 #include "utils.h"  // For resolve_ref, read_ref
-#include "database.h" // For read_object
+#include "object_view.h"
 
 // Actions available in interactive rebase
 typedef enum {
@@ -87,26 +87,20 @@ static int spawn_editor_shell(const char *commit_sha) {
 
 // Helper to fetch simple commit message (first line)
 void get_commit_message(const char *hash, char *buffer, size_t size) {
-    char *type, *data;
-    size_t len;
-    if (read_object(hash, &type, &data, &len) == 0) {
-        if (strcmp(type, "commit") == 0) {
-            // Find double newline (end of headers)
-            char *msg_start = strstr(data, "\n\n");
-            if (msg_start) {
-                msg_start += 2; // Skip \n\n
-                // Copy until next newline or end
-                size_t i = 0;
-                while (i < size - 1 && msg_start[i] != '\n' && msg_start[i] != '\0') {
-                    buffer[i] = msg_start[i];
-                    i++;
-                }
-                buffer[i] = '\0';
+    struct object_view *commit = object_view_open(hash);
+    if (commit) {
+        struct commit_view cv;
+        if (commit_view_parse(commit, &cv) == 0) {
+            if (cv.message.len) {
+                // First line only
+                const char *eol = memchr(cv.message.ptr, '\n', cv.message.len);
+                struct object_slice line = { cv.message.ptr, eol ? (size_t)(eol - cv.message.ptr) : cv.message.len };
+                object_slice_copy(line, buffer, size);
             } else {
                 snprintf(buffer, size, "<no message>");
             }
         }
-        free(type); free(data);
+        object_view_release(commit);
     } else {
         snprintf(buffer, size, "<error reading commit>");
     }
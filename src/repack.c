@@ -0,0 +1,340 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "repack.h"
+#include "pack.h"
+#include "database.h"
+#include "object_view.h"
+#include "commit_graph.h"
+#include "utils.h"
+#include "worker_pool.h"
+
+#define OBJECTS_DIR ".minivcs/objects"
+
+struct loose_list {
+    char **hashes;
+    int count;
+    int capacity;
+    long total_bytes;
+};
+
+static int is_hex_name(const char *name, size_t len) {
+    if (strlen(name) != len) return 0;
+    for (size_t i = 0; i < len; i++) {
+        char c = name[i];
+        if (!((c >= '0' && c <= '9') || (c >= 'a' && c <= 'f'))) return 0;
+    }
+    return 1;
+}
+
+// Collects the hex names of all loose objects (.minivcs/objects/xx/yyyy...).
+static int collect_loose_objects(struct loose_list *list) {
+    DIR *objects = opendir(OBJECTS_DIR);
+    if (!objects) {
+        fprintf(stderr, "Error: not a Version Forge repository (no %s)\n", OBJECTS_DIR);
+        return -1;
+    }
+
+    struct dirent *fanout;
+    while ((fanout = readdir(objects)) != NULL) {
+        if (!is_hex_name(fanout->d_name, 2)) continue;
+
+        char dir_path[512];
+        snprintf(dir_path, sizeof(dir_path), "%s/%s", OBJECTS_DIR, fanout->d_name);
+        DIR *d = opendir(dir_path);
+        if (!d) continue;
+
+        struct dirent *entry;
+        while ((entry = readdir(d)) != NULL) {
+            if (!is_hex_name(entry->d_name, 38)) continue;
+
+            char file_path[1024];
+            snprintf(file_path, sizeof(file_path), "%s/%s", dir_path, entry->d_name);
+            struct stat s;
+            if (stat(file_path, &s) == 0) list->total_bytes += s.st_size;
+
+            if (list->count >= list->capacity) {
+                list->capacity = list->capacity ? list->capacity * 2 : 256;
+                list->hashes = realloc(list->hashes, sizeof(char *) * list->capacity);
+            }
+            char *hash = malloc(41);
+            snprintf(hash, 41, "%.2s%.38s", fanout->d_name, entry->d_name);
+            list->hashes[list->count++] = hash;
+        }
+        closedir(d);
+    }
+    closedir(objects);
+    return 0;
+}
+
+static int compare_hashes(const void *a, const void *b) {
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+// --- Path hints ---
+// Blobs reachable from the branches are labelled with the path they appear
+// under, so write_pack() can try earlier versions of the same file as bases.
+
+struct sha_set {
+    unsigned char *slots;   // capacity x 20 bytes, all-zero = empty
+    int capacity;
+    int count;
+};
+
+static int sha_set_insert(struct sha_set *set, const unsigned char *sha1) {
+    static const unsigned char empty[SHA_DIGEST_LENGTH];
+    if ((set->count + 1) * 2 > set->capacity) {
+        struct sha_set grown = {0};
+        grown.capacity = set->capacity ? set->capacity * 2 : 1024;
+        grown.slots = calloc(grown.capacity, SHA_DIGEST_LENGTH);
+        if (!grown.slots) return -1;
+        for (int i = 0; i < set->capacity; i++) {
+            const unsigned char *old = set->slots + (size_t)i * SHA_DIGEST_LENGTH;
+            if (memcmp(old, empty, SHA_DIGEST_LENGTH) != 0) sha_set_insert(&grown, old);
+        }
+        free(set->slots);
+        *set = grown;
+    }
+    unsigned int pos = get_be32(sha1) % set->capacity;
+    while (1) {
+        unsigned char *slot = set->slots + (size_t)pos * SHA_DIGEST_LENGTH;
+        if (memcmp(slot, sha1, SHA_DIGEST_LENGTH) == 0) return 0; // Already present
+        if (memcmp(slot, empty, SHA_DIGEST_LENGTH) == 0) {
+            memcpy(slot, sha1, SHA_DIGEST_LENGTH);
+            set->count++;
+            return 1;
+        }
+        pos = (pos + 1) % set->capacity;
+    }
+}
+
+struct name_walk {
+    struct loose_list *list;    // Sorted, so it can be binary searched
+    char **names;
+    struct sha_set seen;
+};
+
+static void name_object(struct name_walk *walk, const char *hash, const char *path) {
+    const char *key = hash;
+    char **found = bsearch(&key, walk->list->hashes, walk->list->count, sizeof(char *), compare_hashes);
+    if (found) {
+        int pos = found - walk->list->hashes;
+        if (!walk->names[pos]) walk->names[pos] = strdup(path);
+    }
+}
+
+static void walk_tree_names(struct name_walk *walk, const char *tree_hash, const char *prefix) {
+    unsigned char sha1[SHA_DIGEST_LENGTH];
+    if (sha1_hex_to_bin(tree_hash, sha1) != 0 || sha_set_insert(&walk->seen, sha1) != 1) return;
+
+    // Every tree is read once: keep them out of the cache.
+    struct object_view *tree = object_view_read(tree_hash);
+    if (!tree) return;
+    struct tree_iter it;
+    struct tree_entry_view e;
+    if (tree_iter_init(&it, tree) == 0) {
+        while (tree_iter_next(&it, &e) == 1) {
+            char entry_hash[41];
+            sha1_bin_to_hex(e.sha1, entry_hash);
+            char path[1024];
+            if (prefix[0]) snprintf(path, sizeof(path), "%s/%s", prefix, e.name.ptr);
+            else snprintf(path, sizeof(path), "%s", e.name.ptr);
+
+            if (e.is_dir) walk_tree_names(walk, entry_hash, path);
+            else name_object(walk, entry_hash, path);
+        }
+    }
+    object_view_release(tree);
+}
+
+static void walk_commit_names(struct name_walk *walk, const char *commit_hash) {
+    // The commit graph has each commit's tree and parents: no commit objects
+    // need to be inflated.
+    uint32_t pos;
+    struct commit_graph *graph = commit_graph_lookup(commit_hash, &pos);
+    struct commit_graph_entry e;
+    while (graph && commit_graph_entry(graph, pos, &e) == 0) {
+        if (sha_set_insert(&walk->seen, e.sha1) != 1) return;
+        char tree_hash[41];
+        sha1_bin_to_hex(e.tree, tree_hash);
+        walk_tree_names(walk, tree_hash, "");
+        if (e.parent_count == 0) return;
+        pos = e.parents[0];
+    }
+    if (graph) return;
+
+    char hash[41];
+    snprintf(hash, sizeof(hash), "%s", commit_hash);
+    while (1) {
+        unsigned char sha1[SHA_DIGEST_LENGTH];
+        if (sha1_hex_to_bin(hash, sha1) != 0 || sha_set_insert(&walk->seen, sha1) != 1) return;
+
+        struct object_view *commit = object_view_read(hash);
+        struct commit_view cv;
+        if (!commit || commit_view_parse(commit, &cv) != 0) {
+            object_view_release(commit);
+            return;
+        }
+        char tree_hash[41];
+        walk_tree_names(walk, object_slice_copy(cv.tree, tree_hash, sizeof(tree_hash)), "");
+        int has_parent = cv.parent_count > 0;
+        if (has_parent) object_slice_copy(cv.parents[0], hash, sizeof(hash));
+        object_view_release(commit);
+        if (!has_parent) return;
+    }
+}
+
+static void collect_path_hints(struct name_walk *walk) {
+    char hash[41];
+    DIR *d = opendir(".minivcs/refs/heads");
+    if (d) {
+        struct dirent *entry;
+        while ((entry = readdir(d)) != NULL) {
+            if (entry->d_name[0] == '.') continue;
+            char ref_path[512];
+            snprintf(ref_path, sizeof(ref_path), "refs/heads/%s", entry->d_name);
+            if (read_ref(ref_path, hash) == 0) walk_commit_names(walk, hash);
+        }
+        closedir(d);
+    }
+    if (read_ref("HEAD", hash) == 0) walk_commit_names(walk, hash); // Detached HEAD
+}
+
+#define VERIFY_BATCH 64          // Objects checked per pool task
+
+struct verify_batch {
+    char **hashes;
+    int count;
+    uint64_t *bytes;            // Shared totals, updated atomically
+    int *bad;
+};
+
+static void verify_batch_task(void *arg) {
+    struct verify_batch *batch = (struct verify_batch *)arg;
+    uint64_t bytes = 0;
+    int bad = 0;
+    for (int i = 0; i < batch->count; i++) {
+        unsigned char sha1[SHA_DIGEST_LENGTH], actual[SHA_DIGEST_LENGTH];
+        char *type = NULL, *data = NULL;
+        size_t size = 0;
+        sha1_hex_to_bin(batch->hashes[i], sha1);
+        if (pack_read_object(sha1, &type, &data, &size) != 0 ||
+            hash_object(data, size, type, actual) != 0 ||
+            memcmp(sha1, actual, SHA_DIGEST_LENGTH) != 0) {
+            fprintf(stderr, "Error: packed object %s does not verify\n", batch->hashes[i]);
+            bad++;
+        }
+        bytes += size;
+        free(type);
+        free(data);
+    }
+    __atomic_fetch_add(batch->bytes, bytes, __ATOMIC_RELAXED);
+    __atomic_fetch_add(batch->bad, bad, __ATOMIC_RELAXED);
+    free(batch);
+}
+
+// Reads every packed object back, checks its hash, and reports how fast
+// objects (including delta chains) are reconstructed. Batches of objects
+// are checked in parallel on the worker pool.
+static int verify_packed_objects(char **hashes, int count) {
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    uint64_t bytes = 0;
+    int bad = 0;
+    threadpool_group_t *group = threadpool_group_create(get_worker_pool());
+    for (int i = 0; i < count; i += VERIFY_BATCH) {
+        struct verify_batch *batch = malloc(sizeof(struct verify_batch));
+        batch->hashes = hashes + i;
+        batch->count = count - i < VERIFY_BATCH ? count - i : VERIFY_BATCH;
+        batch->bytes = &bytes;
+        batch->bad = &bad;
+        if (threadpool_group_submit(group, verify_batch_task, batch) != 0) verify_batch_task(batch);
+    }
+    threadpool_group_wait(group);
+    threadpool_group_destroy(group);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    if (seconds <= 0) seconds = 1e-9;
+    printf("Verified %d objects: %.1f KB reconstructed in %.3f s (%.1f MB/s, %.0f objects/s)\n",
+           count, bytes / 1024.0, seconds, bytes / seconds / (1024.0 * 1024.0), count / seconds);
+    return bad ? -1 : 0;
+}
+
+static void remove_loose_object(const char *hash) {
+    char path[256];
+    snprintf(path, sizeof(path), "%s/%.2s/%.38s", OBJECTS_DIR, hash, hash + 2);
+    unlink(path);
+    snprintf(path, sizeof(path), "%s/%.2s", OBJECTS_DIR, hash);
+    rmdir(path); // Only succeeds once the fanout directory is empty
+}
+
+int do_repack() {
+    struct loose_list list = {0};
+    if (collect_loose_objects(&list) != 0) return 1;
+
+    if (list.count == 0) {
+        printf("Nothing to pack.\n");
+        return 0;
+    }
+    qsort(list.hashes, list.count, sizeof(char *), compare_hashes);
+
+    struct name_walk walk = {0};
+    walk.list = &list;
+    walk.names = calloc(list.count, sizeof(char *));
+    collect_path_hints(&walk);
+    free(walk.seen.slots);
+
+    // Objects some pack already holds only need their loose copy removed.
+    char **to_pack = malloc(sizeof(char *) * list.count);
+    char **to_pack_names = malloc(sizeof(char *) * list.count);
+    int pack_count = 0;
+    for (int i = 0; i < list.count; i++) {
+        unsigned char sha1[SHA_DIGEST_LENGTH];
+        sha1_hex_to_bin(list.hashes[i], sha1);
+        if (pack_has_object(sha1)) continue;
+        to_pack_names[pack_count] = walk.names[i];
+        to_pack[pack_count++] = list.hashes[i];
+    }
+
+    int ret = 0;
+    if (pack_count > 0) {
+        char pack_hex[41];
+        struct pack_stats stats;
+        if (write_pack(to_pack, to_pack_names, pack_count, pack_hex, &stats) != 0) {
+            ret = 1;
+        } else {
+            printf("Packed %d objects into pack-%s.pack (%d as deltas)\n", stats.objects, pack_hex, stats.deltas);
+            printf("Size: %llu bytes raw, %ld bytes as loose objects, %llu bytes packed (%.2fx compression)\n",
+                   (unsigned long long)stats.raw_bytes, list.total_bytes, (unsigned long long)stats.pack_bytes,
+                   stats.pack_bytes ? (double)stats.raw_bytes / stats.pack_bytes : 0.0);
+            if (verify_packed_objects(to_pack, pack_count) != 0) ret = 1;
+        }
+    }
+
+    if (ret == 0) {
+        int removed = 0;
+        for (int i = 0; i < list.count; i++) {
+            unsigned char sha1[SHA_DIGEST_LENGTH];
+            sha1_hex_to_bin(list.hashes[i], sha1);
+            if (!pack_has_object(sha1)) continue; // Never drop the only copy
+            remove_loose_object(list.hashes[i]);
+            removed++;
+        }
+        printf("Removed %d loose objects.\n", removed);
+    }
+
+    for (int i = 0; i < list.count; i++) {
+        free(list.hashes[i]);
+        free(walk.names[i]);
+    }
+    free(list.hashes);
+    free(walk.names);
+    free(to_pack);
+    free(to_pack_names);
+    return ret;
+}
@@ -0,0 +1,205 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+
+#include "sparse.h"
+#include "utils.h"
+
+// One path component. Children are kept sorted by name and binary searched.
+struct sparse_node {
+    char *name;
+    int recursive;              // A listed directory: everything below is included
+    struct sparse_node **children;
+    int count;
+    int capacity;
+};
+
+struct sparse_cone {
+    struct sparse_node root;
+    int dir_count;              // Directories listed in the file
+};
+
+static struct sparse_node *find_child(const struct sparse_node *node, const char *name, size_t len, int *out_pos) {
+    int lo = 0, hi = node->count - 1;
+    while (lo <= hi) {
+        int mid = lo + (hi - lo) / 2;
+        const char *child = node->children[mid]->name;
+        int cmp = strncmp(name, child, len);
+        if (cmp == 0 && child[len] != '\0') cmp = -1; // 'name' is a proper prefix of 'child'
+        if (cmp == 0) return node->children[mid];
+        if (cmp < 0) hi = mid - 1;
+        else lo = mid + 1;
+    }
+    if (out_pos) *out_pos = lo;
+    return NULL;
+}
+
+static struct sparse_node *add_child(struct sparse_node *node, const char *name, size_t len) {
+    int pos;
+    struct sparse_node *child = find_child(node, name, len, &pos);
+    if (child) return child;
+
+    if (node->count >= node->capacity) {
+        int new_capacity = node->capacity ? node->capacity * 2 : 4;
+        struct sparse_node **grown = realloc(node->children, sizeof(struct sparse_node *) * new_capacity);
+        if (!grown) return NULL;
+        node->children = grown;
+        node->capacity = new_capacity;
+    }
+    child = calloc(1, sizeof(struct sparse_node));
+    if (!child || !(child->name = strndup(name, len))) {
+        free(child);
+        return NULL;
+    }
+    memmove(&node->children[pos + 1], &node->children[pos], sizeof(struct sparse_node *) * (node->count - pos));
+    node->children[pos] = child;
+    node->count++;
+    return child;
+}
+
+static void free_node(struct sparse_node *node) {
+    for (int i = 0; i < node->count; i++) {
+        free_node(node->children[i]);
+        free(node->children[i]);
+    }
+    free(node->children);
+    free(node->name);
+}
+
+static int insert_dir(struct sparse_cone *cone, const char *dir) {
+    struct sparse_node *node = &cone->root;
+    const char *p = dir;
+    while (*p) {
+        const char *slash = strchr(p, '/');
+        size_t len = slash ? (size_t)(slash - p) : strlen(p);
+        node = add_child(node, p, len);
+        if (!node) return -1;
+        p += len;
+        if (*p == '/') p++;
+    }
+    node->recursive = 1;
+    return 0;
+}
+
+// Trims a pattern line to "a/b" form. Returns 0 if the line lists no directory.
+static int normalize_line(char *line) {
+    char *hash = strchr(line, '#');
+    if (hash) *hash = '\0';
+    char *start = line;
+    while (*start == ' ' || *start == '\t' || *start == '/') start++;
+    size_t len = strlen(start);
+    while (len > 0 && (start[len - 1] == '\n' || start[len - 1] == '\r' || start[len - 1] == ' ' ||
+                       start[len - 1] == '\t' || start[len - 1] == '/')) len--;
+    memmove(line, start, len);
+    line[len] = '\0';
+    return len > 0;
+}
+
+struct sparse_cone *sparse_load(const char *patterns_file) {
+    FILE *f = fopen(patterns_file, "r");
+    if (!f) return NULL;
+
+    struct sparse_cone *cone = calloc(1, sizeof(struct sparse_cone));
+    if (!cone) {
+        fclose(f);
+        return NULL;
+    }
+    char line[1024];
+    while (fgets(line, sizeof(line), f)) {
+        if (!normalize_line(line)) continue;
+        if (strchr(line, '*') || strchr(line, '?') || line[0] == '!') {
+            fprintf(stderr, "Warning: ignoring non-cone pattern '%s' in %s\n", line, patterns_file);
+            continue;
+        }
+        if (insert_dir(cone, line) != 0) break;
+        cone->dir_count++;
+    }
+    fclose(f);
+
+    if (cone->dir_count == 0) {
+        sparse_free(cone);
+        return NULL;
+    }
+    return cone;
+}
+
+int sparse_match_dir(const struct sparse_cone *cone, const char *dir_path) {
+    if (!cone) return SPARSE_RECURSIVE;
+    const struct sparse_node *node = &cone->root;
+    const char *p = dir_path;
+    while (*p) {
+        if (node->recursive) return SPARSE_RECURSIVE;
+        const char *slash = strchr(p, '/');
+        size_t len = slash ? (size_t)(slash - p) : strlen(p);
+        node = find_child(node, p, len, NULL);
+        if (!node) return SPARSE_EXCLUDED;
+        p += len;
+        if (*p == '/') p++;
+    }
+    return node->recursive ? SPARSE_RECURSIVE : SPARSE_PARENT;
+}
+
+int sparse_match_file(const struct sparse_cone *cone, const char *path) {
+    if (!cone) return 1;
+    const char *slash = strrchr(path, '/');
+    if (!slash) return 1; // Files in the root are always checked out
+
+    char dir[1024];
+    if ((size_t)(slash - path) >= sizeof(dir)) return 0;
+    memcpy(dir, path, slash - path);
+    dir[slash - path] = '\0';
+    return sparse_match_dir(cone, dir) != SPARSE_EXCLUDED;
+}
+
+int sparse_match_path(const char *path, int is_dir, void *cone) {
+    if (is_dir) return sparse_match_dir(cone, path) != SPARSE_EXCLUDED;
+    return sparse_match_file(cone, path);
+}
+
+static int same_node(const struct sparse_node *a, const struct sparse_node *b) {
+    // Below a listed directory, further patterns change nothing.
+    if (a->recursive || b->recursive) return a->recursive == b->recursive;
+    if (a->count != b->count) return 0;
+    for (int i = 0; i < a->count; i++) {
+        if (strcmp(a->children[i]->name, b->children[i]->name) != 0) return 0;
+        if (!same_node(a->children[i], b->children[i])) return 0;
+    }
+    return 1;
+}
+
+int sparse_same_cone(const struct sparse_cone *a, const struct sparse_cone *b) {
+    if (!a || !b) return a == b;
+    return same_node(&a->root, &b->root);
+}
+
+int sparse_mark_applied() {
+    size_t size;
+    char *content = read_file_to_buffer(SPARSE_CHECKOUT_FILE, &size);
+    if (!content) {
+        if (unlink(SPARSE_APPLIED_FILE) != 0 && errno != ENOENT) return -1;
+        return 0;
+    }
+
+    char tmp_path[256];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", SPARSE_APPLIED_FILE);
+    FILE *f = fopen(tmp_path, "wb");
+    if (!f) {
+        free(content);
+        return -1;
+    }
+    size_t written = fwrite(content, 1, size, f);
+    free(content);
+    if (fclose(f) != 0 || written != size || rename(tmp_path, SPARSE_APPLIED_FILE) != 0) {
+        unlink(tmp_path);
+        return -1;
+    }
+    return 0;
+}
+
+void sparse_free(struct sparse_cone *cone) {
+    if (!cone) return;
+    free_node(&cone->root);
+    free(cone);
+}
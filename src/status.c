@@ -6,8 +6,12 @@
 #include "status.h"
 #include "utils.h"
 #include "database.h"
+#include "object_view.h"
 #include "tree.h" 
-#include "threadpool.h" 
+#include "index.h"
+#include "diff.h"
+#include "sparse.h"
+#include "worker_pool.h"
 
 void print_current_branch() {
     FILE *f = fopen(".minivcs/HEAD", "r");
@@ -25,16 +29,21 @@ void print_current_branch() {
     fclose(f);
 }
 
+static void print_change(char change, const char *path, const unsigned char *old_sha1,
+                         const unsigned char *new_sha1, void *data) {
+    (void)old_sha1; (void)new_sha1; (void)data;
+    const char *label = change == DIFF_ADDED ? "new file:" : change == DIFF_DELETED ? "deleted:" : "modified:";
+    printf("\t%-10s  %s\n", label, path);
+}
+
 static int get_tree_hash_from_commit(const char *commit_hash, char *out_tree_hash) {
-    char *type, *data;
-    size_t size;
-    if (read_object(commit_hash, &type, &data, &size) != 0) return -1;
-    char *tree_line = strstr(data, "tree ");
-    if (!tree_line) { free(type); free(data); return -1; }
-    strncpy(out_tree_hash, tree_line + 5, 40);
-    out_tree_hash[40] = '\0';
-    free(type); free(data);
-    return 0;
+    struct object_view *commit = object_view_open(commit_hash);
+    if (!commit) return -1;
+    struct commit_view cv;
+    int result = commit_view_parse(commit, &cv);
+    if (result == 0) object_slice_copy(cv.tree, out_tree_hash, 41);
+    object_view_release(commit);
+    return result;
 }
 
 int do_status() {
@@ -53,28 +62,44 @@ int do_status() {
         printf("No commits yet\n");
     }
 
-    // Initialize Pool
-    threadpool_t *pool = threadpool_create(8, 256);
+    threadpool_t *pool = get_worker_pool();
 
-    // Calculate Live Disk Tree Hash
-    if (write_tree_recursive(pool, ".", current_tree_hash, NULL) != 0) {
-        if (!has_head) {
-             printf("\nnothing to commit, working tree clean\n");
-             return 0;
-        }
+    // Calculate Live Disk Tree Hash (unchanged files come from the stat cache)
+    struct index *index = index_load();
+    // Hash only: status never writes to the object store.
+    int tree_status = hash_tree_indexed(pool, index, ".", current_tree_hash, NULL);
+    if (index) {
+        printf("Index: %ld files rehashed, %ld taken from stat cache\n", index->misses, index->hits);
+        printf("Cache-tree: %ld trees rebuilt, %ld reused\n", index->trees_rebuilt, index->trees_reused);
+        if (index->fsmonitor_dirty >= 0)
+            printf("fsmonitor: %ld path(s) changed since the last scan\n", index->fsmonitor_dirty);
+        index_write(index);
+    }
+    if (tree_status == 1 && !has_head) {
+        printf("\nnothing to commit, working tree clean\n");
+        index_free(index);
+        return 0;
     }
-    threadpool_destroy(pool);
 
     // --- COMPARISON LOGIC ---
     // Compare Live Disk vs HEAD Commit
     
-    if (has_head && strcmp(head_tree_hash, current_tree_hash) == 0) {
+    if (has_head && tree_status == 0 && strcmp(head_tree_hash, current_tree_hash) == 0) {
         printf("\nnothing to commit, working tree clean\n");
     } else {
-        // Universal "dirty" message
         printf("\nChanges not committed:\n");
-        printf("\tmodified/new: (use \"version_forge commit -m ...\" to record changes)\n");
+        printf("  (use \"version_forge commit -m ...\" to record changes)\n");
+        // Walk HEAD against the refreshed index; unchanged subtrees are skipped.
+        // Paths outside a sparse-checkout cone are not on disk, not deleted.
+        const char *old_tree = head_tree_hash[0] ? head_tree_hash : NULL;
+        struct sparse_cone *cone = sparse_load(SPARSE_APPLIED_FILE);
+        if (tree_status == -1 || !index ||
+            diff_tree_to_index(old_tree, index, cone ? sparse_match_path : NULL, print_change, cone) != 0) {
+            printf("\tmodified/new: (could not list individual paths)\n");
+        }
+        sparse_free(cone);
     }
 
+    index_free(index);
     return 0;
 }
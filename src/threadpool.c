@@ -1,45 +1,228 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <pthread.h>
 #include <unistd.h>
+#include <limits.h>
+#include <sched.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <time.h>
 
 #include "threadpool.h"
 
-// The worker thread function (Consumer)
-static void *threadpool_thread(void *threadpool) {
-    threadpool_t *pool = (threadpool_t *)threadpool;
-    threadpool_task_t task;
+// The worker (if any) running on this thread, so threadpool_add can push
+// to its own deque instead of the shared inject queue.
+static __thread threadpool_worker_t *current_worker;
+
+// --- Chase-Lev deque ---
+// Follows "Correct and Efficient Work-Stealing for Weak Memory Models"
+// (Le, Pop, Cohen, Zappa Nardelli), with a fixed-size ring: a full deque
+// makes threadpool_add fail and the caller runs the task itself.
+
+static int deque_init(threadpool_deque_t *dq, int size) {
+    int64_t capacity = 1;
+    while (capacity < size) capacity <<= 1;
+    dq->buffer = malloc(sizeof(threadpool_task_t) * capacity);
+    if (!dq->buffer) return -1;
+    dq->mask = capacity - 1;
+    dq->top = dq->bottom = 0;
+    return 0;
+}
 
-    while (1) {
-        // 1. Lock the mutex to access the queue safely
-        pthread_mutex_lock(&(pool->lock));
+// Owner only.
+static int deque_push(threadpool_deque_t *dq, threadpool_task_t task) {
+    int64_t b = __atomic_load_n(&dq->bottom, __ATOMIC_RELAXED);
+    int64_t t = __atomic_load_n(&dq->top, __ATOMIC_ACQUIRE);
+    if (b - t > dq->mask) return -1;
+    threadpool_task_t *slot = &dq->buffer[b & dq->mask];
+    __atomic_store_n(&slot->function, task.function, __ATOMIC_RELAXED);
+    __atomic_store_n(&slot->argument, task.argument, __ATOMIC_RELAXED);
+    __atomic_store_n(&dq->bottom, b + 1, __ATOMIC_RELEASE);
+    return 0;
+}
 
-        // 2. Wait while the queue is empty AND we are not shutting down
-        while ((pool->count == 0) && (!pool->shutdown)) {
-            // pthread_cond_wait automatically unlocks mutex and waits for signal
-            pthread_cond_wait(&(pool->notify), &(pool->lock));
-        }
+// Owner only. Takes the most recently pushed task (LIFO keeps caches warm).
+static int deque_take(threadpool_deque_t *dq, threadpool_task_t *out) {
+    int64_t b = __atomic_load_n(&dq->bottom, __ATOMIC_RELAXED) - 1;
+    __atomic_store_n(&dq->bottom, b, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    int64_t t = __atomic_load_n(&dq->top, __ATOMIC_RELAXED);
 
-        // 3. Check if we are shutting down
-        if ((pool->shutdown) && (pool->count == 0)) {
-            pthread_mutex_unlock(&(pool->lock));
-            pthread_exit(NULL);
-        }
+    if (t > b) {
+        __atomic_store_n(&dq->bottom, b + 1, __ATOMIC_RELAXED);
+        return -1; // Empty
+    }
+    threadpool_task_t *slot = &dq->buffer[b & dq->mask];
+    out->function = __atomic_load_n(&slot->function, __ATOMIC_RELAXED);
+    out->argument = __atomic_load_n(&slot->argument, __ATOMIC_RELAXED);
+    if (t == b) {
+        // Last task: race the thieves for it.
+        int won = __atomic_compare_exchange_n(&dq->top, &t, t + 1, 0,
+                                              __ATOMIC_SEQ_CST, __ATOMIC_RELAXED);
+        __atomic_store_n(&dq->bottom, b + 1, __ATOMIC_RELAXED);
+        return won ? 0 : -1;
+    }
+    return 0;
+}
 
-        // 4. Grab a task from the queue
-        task.function = pool->queue[pool->head].function;
-        task.argument = pool->queue[pool->head].argument;
-        
-        pool->head = (pool->head + 1) % pool->queue_size;
-        pool->count--;
+// Any thread. Takes the oldest task.
+static int deque_steal(threadpool_deque_t *dq, threadpool_task_t *out) {
+    int64_t t = __atomic_load_n(&dq->top, __ATOMIC_ACQUIRE);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    int64_t b = __atomic_load_n(&dq->bottom, __ATOMIC_ACQUIRE);
+    if (t >= b) return -1;
+
+    threadpool_task_t *slot = &dq->buffer[t & dq->mask];
+    out->function = __atomic_load_n(&slot->function, __ATOMIC_RELAXED);
+    out->argument = __atomic_load_n(&slot->argument, __ATOMIC_RELAXED);
+    if (!__atomic_compare_exchange_n(&dq->top, &t, t + 1, 0, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED))
+        return -1; // Lost the race; the caller moves on to another victim
+    return 0;
+}
 
-        // 5. Unlock the mutex
+static int deque_empty(threadpool_deque_t *dq) {
+    return __atomic_load_n(&dq->top, __ATOMIC_ACQUIRE) >= __atomic_load_n(&dq->bottom, __ATOMIC_ACQUIRE);
+}
+
+// --- Inject queue (tasks from outside the pool) ---
+
+#define INJECT_BATCH 64         // Most tasks a worker moves to its deque per lock
+
+// Returns one task. A worker ('self' not NULL) also moves a fair share of
+// the rest into its own deque, where others can steal them without the lock.
+static int inject_pop(threadpool_t *pool, threadpool_worker_t *self, threadpool_task_t *out) {
+    if (__atomic_load_n(&pool->count, __ATOMIC_ACQUIRE) == 0) return -1;
+    pthread_mutex_lock(&(pool->lock));
+    if (pool->count == 0) {
         pthread_mutex_unlock(&(pool->lock));
+        return -1;
+    }
+    int batch = 1;
+    if (self) batch = pool->count / pool->thread_count + 1;
+    if (batch > INJECT_BATCH) batch = INJECT_BATCH;
+
+    int taken = 0;
+    while (taken < batch && pool->count - taken > 0) {
+        threadpool_task_t task = pool->queue[pool->head];
+        if (taken > 0 && deque_push(&self->deque, task) != 0) break;
+        if (taken == 0) *out = task;
+        pool->head = (pool->head + 1) % pool->queue_size;
+        taken++;
+    }
+    __atomic_store_n(&pool->count, pool->count - taken, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&(pool->lock));
+    return 0;
+}
+
+// --- Parking ---
+// A worker announces itself as a sleeper, reads the epoch, checks for work
+// once more and only then sleeps on the epoch. Producers publish work
+// before checking for sleepers, so one of the two always sees the other.
+//
+// Producers skip the wakeup while some worker is searching (stealing):
+// that worker will find the task, and when it does it wakes a replacement
+// searcher. This keeps a burst of pushes from waking every sleeper.
+
+static void futex_wait(uint32_t *addr, uint32_t expected) {
+    syscall(SYS_futex, addr, FUTEX_WAIT_PRIVATE, expected, NULL, NULL, 0);
+}
+
+static void futex_wake(uint32_t *addr, int count) {
+    syscall(SYS_futex, addr, FUTEX_WAKE_PRIVATE, count, NULL, NULL, 0);
+}
+
+static void wake_workers(threadpool_t *pool, int count) {
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&pool->searching, __ATOMIC_RELAXED) > 0) return;
+    if (__atomic_load_n(&pool->sleepers, __ATOMIC_RELAXED) == 0) return;
+    __atomic_fetch_add(&pool->epoch, 1, __ATOMIC_SEQ_CST);
+    futex_wake(&pool->epoch, count);
+}
+
+#define PARK_YIELDS 2            // Extra search rounds before a worker parks
+
+static uint32_t next_random(threadpool_worker_t *self) {
+    uint32_t x = self->rng;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return self->rng = x;
+}
+
+// 'self' is NULL when a thread outside the pool helps.
+static int steal_task(threadpool_t *pool, threadpool_worker_t *self, threadpool_task_t *out) {
+    // Steal from random victims, then fall back to the inject queue.
+    int n = pool->thread_count;
+    int start = self ? next_random(self) % n : 0;
+    for (int i = 0; i < n; i++) {
+        threadpool_worker_t *victim = &pool->workers[(start + i) % n];
+        if (victim != self && deque_steal(&victim->deque, out) == 0) return 0;
+    }
+    return inject_pop(pool, self, out);
+}
+
+static int find_task(threadpool_worker_t *self, threadpool_task_t *out) {
+    threadpool_t *pool = self->pool;
+    if (deque_take(&self->deque, out) == 0) return 0;
+
+    __atomic_fetch_add(&pool->searching, 1, __ATOMIC_SEQ_CST);
+    int found = steal_task(pool, self, out) == 0;
+    int last_searcher = __atomic_sub_fetch(&pool->searching, 1, __ATOMIC_SEQ_CST) == 0;
+    // There may be more where that came from: hand the search on.
+    if (found && last_searcher) wake_workers(pool, 1);
+    return found ? 0 : -1;
+}
+
+static int work_available(threadpool_t *pool) {
+    if (__atomic_load_n(&pool->count, __ATOMIC_ACQUIRE) > 0) return 1;
+    for (int i = 0; i < pool->thread_count; i++) {
+        if (!deque_empty(&pool->workers[i].deque)) return 1;
+    }
+    return 0;
+}
+
+// The worker thread function (Consumer)
+static void *threadpool_thread(void *arg) {
+    threadpool_worker_t *self = (threadpool_worker_t *)arg;
+    threadpool_t *pool = self->pool;
+    threadpool_task_t task = { NULL, NULL };
+    current_worker = self;
+
+    while (1) {
+        if (find_task(self, &task) == 0) {
+            (*(task.function))(task.argument);
+            continue;
+        }
+
+        // Give running workers a chance to produce before paying for a
+        // park/unpark round trip.
+        int found = 0;
+        for (int i = 0; i < PARK_YIELDS && !found; i++) {
+            sched_yield();
+            found = find_task(self, &task) == 0;
+        }
+        if (found) {
+            (*(task.function))(task.argument);
+            continue;
+        }
 
-        // 6. Execute the task (Work happens here!)
-        (*(task.function))(task.argument);
+        // Nothing found: park until a producer bumps the epoch.
+        __atomic_fetch_add(&pool->sleepers, 1, __ATOMIC_SEQ_CST);
+        uint32_t epoch = __atomic_load_n(&pool->epoch, __ATOMIC_SEQ_CST);
+        if (work_available(pool)) {
+            __atomic_fetch_sub(&pool->sleepers, 1, __ATOMIC_SEQ_CST);
+            continue;
+        }
+        if (__atomic_load_n(&pool->shutdown, __ATOMIC_ACQUIRE)) {
+            __atomic_fetch_sub(&pool->sleepers, 1, __ATOMIC_SEQ_CST);
+            break;
+        }
+        futex_wait(&pool->epoch, epoch);
+        __atomic_fetch_sub(&pool->sleepers, 1, __ATOMIC_SEQ_CST);
     }
 
+    current_worker = NULL;
     return NULL;
 }
 
@@ -51,46 +234,42 @@ threadpool_t *threadpool_create(int thread_count, int queue_size) {
         return NULL;
     }
 
-    // Allocate memory for the pool struct
-    if ((pool = (threadpool_t *)malloc(sizeof(threadpool_t))) == NULL) {
+    if ((pool = (threadpool_t *)calloc(1, sizeof(threadpool_t))) == NULL) {
         return NULL;
     }
-
-    // Initialize simple fields
-    pool->thread_count = 0;
     pool->queue_size = queue_size;
-    pool->head = pool->tail = pool->count = 0;
-    pool->shutdown = 0;
-    pool->started = 0;
-
-    // Allocate memory for threads and queue
-    pool->threads = (pthread_t *)malloc(sizeof(pthread_t) * thread_count);
-    pool->queue = (threadpool_task_t *)malloc(sizeof(threadpool_task_t) * queue_size);
-
-    if ((pool->threads == NULL) || (pool->queue == NULL)) {
-        // Cleanup if malloc failed
-        if (pool->threads) free(pool->threads);
-        if (pool->queue) free(pool->queue);
+    pool->workers = calloc(thread_count, sizeof(threadpool_worker_t));
+    pool->queue = malloc(sizeof(threadpool_task_t) * queue_size);
+    if (pool->workers == NULL || pool->queue == NULL ||
+        pthread_mutex_init(&(pool->lock), NULL) != 0) {
+        free(pool->workers);
+        free(pool->queue);
         free(pool);
         return NULL;
     }
 
-    // Initialize Mutex and Condition Variable
-    if ((pthread_mutex_init(&(pool->lock), NULL) != 0) ||
-        (pthread_cond_init(&(pool->notify), NULL) != 0)) {
-        if (pool->threads) free(pool->threads);
-        if (pool->queue) free(pool->queue);
-        free(pool);
-        return NULL;
+    for (i = 0; i < thread_count; i++) {
+        threadpool_worker_t *w = &pool->workers[i];
+        w->pool = pool;
+        w->rng = 0x9e3779b9u * (i + 1);
+        if (deque_init(&w->deque, queue_size) != 0) {
+            while (--i >= 0) free(pool->workers[i].deque.buffer);
+            pthread_mutex_destroy(&(pool->lock));
+            free(pool->workers);
+            free(pool->queue);
+            free(pool);
+            return NULL;
+        }
     }
+    // Thieves index 'workers' by thread_count, so publish it before any starts.
+    pool->thread_count = thread_count;
 
     // Create the worker threads
     for (i = 0; i < thread_count; i++) {
-        if (pthread_create(&(pool->threads[i]), NULL, threadpool_thread, (void *)pool) != 0) {
+        if (pthread_create(&(pool->workers[i].thread), NULL, threadpool_thread, &pool->workers[i]) != 0) {
             threadpool_destroy(pool);
             return NULL;
         }
-        pool->thread_count++;
         pool->started++;
     }
 
@@ -98,86 +277,171 @@ threadpool_t *threadpool_create(int thread_count, int queue_size) {
 }
 
 int threadpool_add(threadpool_t *pool, void (*function)(void *), void *argument) {
-    int err = 0;
-    int next_tail;
-
-    if (pool == NULL || function == NULL) {
+    if (pool == NULL || function == NULL || __atomic_load_n(&pool->shutdown, __ATOMIC_ACQUIRE)) {
         return -1;
     }
+    threadpool_task_t task = { function, argument };
 
-    // Lock the queue
-    if (pthread_mutex_lock(&(pool->lock)) != 0) {
+    threadpool_worker_t *self = current_worker;
+    if (self && self->pool == pool) {
+        if (deque_push(&self->deque, task) != 0) return -1;
+        wake_workers(pool, 1);
+        return 0;
+    }
+
+    pthread_mutex_lock(&(pool->lock));
+    if (pool->count == pool->queue_size) {
+        pthread_mutex_unlock(&(pool->lock));
         return -1;
     }
+    pool->queue[pool->tail] = task;
+    pool->tail = (pool->tail + 1) % pool->queue_size;
+    __atomic_store_n(&pool->count, pool->count + 1, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&(pool->lock));
+
+    wake_workers(pool, 1);
+    return 0;
+}
 
-    // Calculate next tail position
-    next_tail = (pool->tail + 1) % pool->queue_size;
+// --- Backpressure and task groups ---
 
-    // Check if queue is full
-    if (pool->count == pool->queue_size) {
-        err = -1;
-    } 
-    // Check if we are shutting down
-    else if (pool->shutdown) {
-        err = -1;
-    } 
-    else {
-        // Add task to the queue
-        pool->queue[pool->tail].function = function;
-        pool->queue[pool->tail].argument = argument;
-        pool->tail = next_tail;
-        pool->count++;
-
-        // Signal a waiting thread that work is available!
-        pthread_cond_signal(&(pool->notify));
+#define MAX_HELP_DEPTH 16       // Nested helping before a full submit runs inline
+
+static __thread int help_depth;
+
+static void futex_wait_briefly(int *addr, int expected) {
+    struct timespec timeout = { 0, 1000000 };
+    syscall(SYS_futex, addr, FUTEX_WAIT_PRIVATE, expected, &timeout, NULL, 0);
+}
+
+// Runs one queued task on the calling thread. Returns 1 if it ran one.
+static int help_run_one(threadpool_t *pool) {
+    threadpool_worker_t *self = current_worker;
+    if (self && self->pool != pool) self = NULL;
+
+    threadpool_task_t task;
+    int found = self ? find_task(self, &task) == 0 : steal_task(pool, NULL, &task) == 0;
+    if (!found) return 0;
+    help_depth++;
+    (*(task.function))(task.argument);
+    help_depth--;
+    return 1;
+}
+
+int threadpool_submit(threadpool_t *pool, void (*function)(void *), void *argument) {
+    if (pool == NULL || function == NULL) return -1;
+
+    while (threadpool_add(pool, function, argument) != 0) {
+        if (__atomic_load_n(&pool->shutdown, __ATOMIC_ACQUIRE)) return -1;
+
+        // A worker's own deque is full of work only it pops from the
+        // bottom, so running the new task now is the fastest way to drain
+        // it. Deep helping chains do the same, to bound the stack.
+        threadpool_worker_t *self = current_worker;
+        if ((self && self->pool == pool) || help_depth >= MAX_HELP_DEPTH) {
+            (*function)(argument);
+            return 0;
+        }
+        if (!help_run_one(pool)) sched_yield();
     }
+    return 0;
+}
 
-    pthread_mutex_unlock(&(pool->lock));
+struct group_task {
+    threadpool_group_t *group;
+    void (*function)(void *);
+    void *argument;
+};
+
+static void group_task_run(void *arg) {
+    struct group_task *gt = (struct group_task *)arg;
+    threadpool_group_t *group = gt->group;
+    (*(gt->function))(gt->argument);
+    free(gt);
+    // Once 'pending' reaches 0 the waiter may return and destroy the group,
+    // while the futex_wake below still needs it. Registering first, before
+    // the decrement can be seen, makes threadpool_group_destroy() wait.
+    __atomic_add_fetch(&group->finishing, 1, __ATOMIC_RELAXED);
+    if (__atomic_sub_fetch(&group->pending, 1, __ATOMIC_ACQ_REL) == 0)
+        futex_wake((uint32_t *)&group->pending, INT_MAX);
+    __atomic_sub_fetch(&group->finishing, 1, __ATOMIC_RELEASE);
+}
 
-    return err;
+threadpool_group_t *threadpool_group_create(threadpool_t *pool) {
+    threadpool_group_t *group = malloc(sizeof(threadpool_group_t));
+    if (!group) return NULL;
+    group->pool = pool;
+    group->pending = 0;
+    group->finishing = 0;
+    return group;
 }
 
-int threadpool_destroy(threadpool_t *pool) {
-    int i, err = 0;
+int threadpool_group_submit(threadpool_group_t *group, void (*function)(void *), void *argument) {
+    if (group == NULL || function == NULL) return -1;
+    if (group->pool == NULL) {
+        (*function)(argument);
+        return 0;
+    }
 
-    if (pool == NULL) {
+    struct group_task *gt = malloc(sizeof(struct group_task));
+    if (!gt) return -1;
+    gt->group = group;
+    gt->function = function;
+    gt->argument = argument;
+    __atomic_add_fetch(&group->pending, 1, __ATOMIC_RELAXED);
+    if (threadpool_submit(group->pool, group_task_run, gt) != 0) {
+        __atomic_sub_fetch(&group->pending, 1, __ATOMIC_RELAXED);
+        free(gt);
         return -1;
     }
+    return 0;
+}
+
+void threadpool_group_wait(threadpool_group_t *group) {
+    if (group == NULL || group->pool == NULL) return;
+    int pending;
+    while ((pending = __atomic_load_n(&group->pending, __ATOMIC_ACQUIRE)) > 0) {
+        if (help_run_one(group->pool)) continue;
+        // Tasks are running elsewhere. Sleep until the last one finishes,
+        // but look for work to help with again every millisecond.
+        futex_wait_briefly(&group->pending, pending);
+    }
+}
+
+void threadpool_group_destroy(threadpool_group_t *group) {
+    if (group == NULL) return;
+    // At most a futex_wake away
+    while (__atomic_load_n(&group->finishing, __ATOMIC_ACQUIRE) > 0) sched_yield();
+    free(group);
+}
 
-    // Lock
-    if (pthread_mutex_lock(&(pool->lock)) != 0) {
+int threadpool_destroy(threadpool_t *pool) {
+    int i, err = 0;
+
+    if (pool == NULL) {
         return -1;
     }
 
     // Set shutdown flag
-    // This tells threads: "Finish what you are doing, then exit."
-    if (pool->shutdown) {
+    // This tells threads: "Finish what is queued, then exit."
+    if (__atomic_exchange_n(&pool->shutdown, 1, __ATOMIC_SEQ_CST)) {
         err = -1; // Already shutting down
     }
-    pool->shutdown = 1;
-
-    // Broadcast to wake up ALL threads so they can see the shutdown flag
-    if ((pthread_cond_broadcast(&(pool->notify)) != 0) ||
-        (pthread_mutex_unlock(&(pool->lock)) != 0)) {
-        err = -1;
-    }
+    __atomic_fetch_add(&pool->epoch, 1, __ATOMIC_SEQ_CST);
+    futex_wake(&pool->epoch, INT_MAX);
 
     // Wait for threads to finish (Join)
-    for (i = 0; i < pool->thread_count; i++) {
-        if (pthread_join(pool->threads[i], NULL) != 0) {
+    for (i = 0; i < pool->started; i++) {
+        if (pthread_join(pool->workers[i].thread, NULL) != 0) {
             err = -1;
         }
     }
 
     // Clean up resources
-    threadpool_task_t *old_queue = pool->queue; // Keep pointer to free later
-    pool->queue = NULL; // Prevent use-after-free
-    
+    for (i = 0; i < pool->thread_count; i++) free(pool->workers[i].deque.buffer);
     pthread_mutex_destroy(&(pool->lock));
-    pthread_cond_destroy(&(pool->notify));
-    
-    free(pool->threads);
-    free(old_queue);
+    free(pool->workers);
+    free(pool->queue);
     free(pool);
 
     return err;
@@ -1,71 +1,191 @@
+#define _GNU_SOURCE // For syscall
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
 #include <sys/stat.h>
+#include <sys/syscall.h>
 #include <dirent.h>
+#include <fcntl.h>
 #include <errno.h>
 #include <pthread.h>
 #include <unistd.h> 
 
 #include "tree.h"
+#include "arena.h"
+#include "blob_pipeline.h"
+#include "index.h"
 #include "database.h"
+#include "fsmonitor.h"
+#include "ignore.h"
+#include "object_view.h"
+#include "sparse.h"
 #include "utils.h"
 #include "vf_signals.h" 
 
-// --- Synchronization Structures ---
+// --- Walk Structures ---
+// Every directory is a task. Scanning it queues a task per changed file and
+// per subdirectory; the last of those to finish (or the scan itself) builds
+// the directory's tree and reports it to the parent, so trees are assembled
+// bottom-up and no thread ever waits on its own children.
+//
+// A hash-only walk (status) computes the same SHAs without touching the
+// object store: no deflate, no directories, no files. What it learns goes
+// into the index unmarked as stored, so a later commit knows which of the
+// cached SHAs it still has to write.
+//
+// A writing walk (commit) hands the small files it has to store to the
+// blob pipeline, whose stages read, deflate and write them on their own
+// threads; large files are streamed by a worker as before.
+//
+// Paths matched by .vfignore rules are left out of the tree; an ignored
+// directory is pruned before it is opened.
+//
+// With a file system monitor running, a directory it saw no change in is
+// not even opened: its cache-tree and index entries are carried over.
+//
+// Directories are read through file descriptors: a parent opens each
+// subdirectory relative to its own fd, lists it with getdents64 into a
+// large buffer and stats entries with fstatat, so the kernel never resolves
+// a full path again. d_type tells directories apart without a stat at all;
+// the index keeps nothing about them.
+//
+// Under a sparse checkout, directories outside the cone are not on disk
+// (or are stale); their entries are taken from the HEAD tree instead, so
+// they count as unchanged rather than deleted.
+//
+// Everything a directory needs until its tree is written (the task itself,
+// its entries and their names, its file tasks, the serialized tree) comes
+// from the directory's own arena, and goes with it in one free. Only the
+// directory's scan allocates from it, so it takes no lock.
+
 struct tree_entry {
     char mode[7];
     char *name;
     unsigned char sha1[SHA_DIGEST_LENGTH];
+    int skip;           // Leave out of the tree (empty or unreadable subdirectory, failed file)
+    int reused;         // Subdirectory whose SHA came from the cache-tree
 };
 
-struct dir_context {
-    struct tree_entry **entries; 
+struct tree_walk {
+    threadpool_group_t *group;  // Every scan and file task of the walk
+    struct index *index;
+    int hash_only;              // Compute SHAs only; store nothing
+    struct sparse_cone *cone;   // Applied sparse-checkout cone, or NULL
+    struct fsmonitor_changes *changes; // Paths changed since the index's token, or NULL
+    int open_dirs;              // Subdirectory fds opened but not scanned yet
+    struct blob_pipeline *blobs; // Stores small files for a writing walk, or NULL
+    int result;                 // build result for the root: 0, 1 (empty) or -1
+    unsigned char sha1[SHA_DIGEST_LENGTH];
+};
+
+struct dir_task {
+    struct arena *arena;        // Holds this task and everything below
+    char *path;
+    int fd;                     // Opened by the parent, or -1 to open 'path' when scanned
+    char *rel_path;             // Relative to the worktree root ("" for the root itself)
+    struct tree_walk *walk;
+    struct dir_task *parent;
+    struct tree_entry *slot;    // Entry in the parent that receives this tree
+    struct tree_entry **entries;
     int capacity;
     int count;
-    int tasks_remaining;
-    pthread_mutex_t lock;
-    pthread_cond_t done;
-    int error_occurred; // Correct member name
+    int pending;                // The scan itself plus unfinished file and subdirectory tasks
+    int unreadable;
+    int clean;                  // Every file was a stat cache hit
+    int error_occurred;         // A path at or below here was left out: a failed file or
+                                // subdirectory, or an interrupted scan
+    int sparse;                 // SPARSE_PARENT or SPARSE_RECURSIVE
+    struct ignore_list *ignore; // This directory's .vfignore, or NULL
+    const struct ignore_list *ignore_chain; // Rules in effect here (own or inherited)
+    int rescan;                 // A .vfignore above changed: carry nothing over below
+    int has_base;               // base_sha1 holds this directory's tree in HEAD
+    unsigned char base_sha1[SHA_DIGEST_LENGTH];
 };
 
 struct worker_args {
     char *filepath;
+    char *index_path;         // Worktree-relative key for the stat cache
+    struct stat st;           // Stat data captured before the file was read
+    struct index *index;
     struct tree_entry *entry; 
-    struct dir_context *ctx;  
+    struct dir_task *dir;
 };
 
-// --- Worker Function ---
-void process_file_task(void *arg) {
-    struct worker_args *args = (struct worker_args *)arg;
-    
-    if (shutdown_requested) {
-        pthread_mutex_lock(&args->ctx->lock); args->ctx->error_occurred = 1; args->ctx->tasks_remaining--;
-        if (args->ctx->tasks_remaining == 0) pthread_cond_signal(&args->ctx->done);
-        pthread_mutex_unlock(&args->ctx->lock); free(args->filepath); free(args);
-        return;
-    }
+static void dir_task_release(struct dir_task *dir);
+static void scan_dir_task(void *arg);
+
+// First block of a directory's arena; a few dozen changed files fit.
+#define DIR_ARENA_SIZE (8 * 1024)
+
+// Files at least this large are streamed into the object store in
+// OBJECT_STREAM_CHUNK pieces instead of being read into memory whole.
+#define STREAM_THRESHOLD (1024 * 1024)
+
+static int store_file_blob(const char *filepath, const struct stat *st, unsigned char *out_sha1) {
+    char blob_hex[41];
+    if (st->st_size >= STREAM_THRESHOLD)
+        return write_object_from_file(filepath, st->st_size, blob_hex, out_sha1);
 
     size_t file_size;
-    char *content = read_file_to_buffer(args->filepath, &file_size);
-    int result = -1;
+    char *content = read_file_to_buffer(filepath, &file_size);
+    if (!content) return -1;
+    int result = write_object(content, file_size, "blob", blob_hex, out_sha1);
+    free(content);
+    return result;
+}
 
-    if (content) {
-        char blob_hex[41];
-        result = write_object(content, file_size, "blob", blob_hex, args->entry->sha1);
-        free(content);
-    }
+// Subdirectory fds waiting in the queue are capped, so a wide tree cannot
+// run out of descriptors; past the cap a directory is opened by path.
+#define MAX_QUEUED_DIR_FDS 256
 
-    pthread_mutex_lock(&args->ctx->lock);
+// Initial getdents64 buffer: one call lists a few thousand entries. It
+// grows until the whole directory fits.
+#define DIRENT_BUFFER_SIZE (64 * 1024)
+#define DIRENT_MIN_SPACE 4096   // Room for the longest entry
+
+struct linux_dirent64 {
+    uint64_t d_ino;
+    int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+};
+
+static void finish_file_task(struct worker_args *args, int result) {
+    struct dir_task *dir = args->dir;
     if (result != 0) {
-        args->ctx->error_occurred = 1; // Corrected usage
-        fprintf(stderr, "Error hashing file: %s\n", args->filepath);
+        args->entry->skip = 1;
+        __atomic_store_n(&dir->error_occurred, 1, __ATOMIC_RELAXED);
+    }
+    dir_task_release(dir);
+}
+
+// Called by the blob pipeline once the file is stored.
+static void blob_stored(void *arg, int result, const unsigned char *sha1) {
+    struct worker_args *args = (struct worker_args *)arg;
+    if (result == 0) {
+        memcpy(args->entry->sha1, sha1, SHA_DIGEST_LENGTH);
+        index_add(args->index, args->index_path, &args->st, args->entry->sha1, INDEX_ENTRY_STORED);
     }
-    args->ctx->tasks_remaining--;
-    if (args->ctx->tasks_remaining == 0) pthread_cond_signal(&args->ctx->done);
-    pthread_mutex_unlock(&args->ctx->lock);
+    finish_file_task(args, result);
+}
+
+// --- Worker Function ---
+void process_file_task(void *arg) {
+    struct worker_args *args = (struct worker_args *)arg;
+    struct dir_task *dir = args->dir;
 
-    free(args->filepath); free(args);
+    int result = -1;
+    if (!shutdown_requested) {
+        int hash_only = dir->walk->hash_only;
+        if (hash_only) result = hash_object_from_file(args->filepath, args->st.st_size, args->entry->sha1);
+        else result = store_file_blob(args->filepath, &args->st, args->entry->sha1);
+        if (result == 0) index_add(args->index, args->index_path, &args->st, args->entry->sha1,
+                                   hash_only ? 0 : INDEX_ENTRY_STORED);
+        else fprintf(stderr, "Error hashing file: %s\n", args->filepath);
+    }
+    finish_file_task(args, result);
 }
 
 int compare_entries(const void *a, const void *b) {
@@ -74,101 +194,485 @@ int compare_entries(const void *a, const void *b) {
     return strcmp(entry_a->name, entry_b->name);
 }
 
-// --- Main Recursive Function (Stable Signature) ---
-int write_tree_recursive(threadpool_t *pool, const char *path, char *out_sha1_hex, unsigned char *out_sha1_binary) {
-    DIR *d = opendir(path);
-    if (!d) return -1;
-
-    struct dirent *dir_entry;
-    struct dir_context ctx;
-    ctx.capacity = 10;
-    ctx.count = 0;
-    ctx.tasks_remaining = 0;
-    ctx.error_occurred = 0;
-    ctx.entries = malloc(sizeof(struct tree_entry*) * ctx.capacity);
-    pthread_mutex_init(&ctx.lock, NULL);
-    pthread_cond_init(&ctx.done, NULL);
-
-    while ((dir_entry = readdir(d)) != NULL) {
-        if (shutdown_requested) { ctx.error_occurred = 1; break; }
-
-        if (strcmp(dir_entry->d_name, ".") == 0 || 
-            strcmp(dir_entry->d_name, "..") == 0 || 
-            strcmp(dir_entry->d_name, ".minivcs") == 0 ||
-            strcmp(dir_entry->d_name, "version_forge") == 0) continue;
-
-        char full_path[1024];
-        snprintf(full_path, sizeof(full_path), "%s/%s", path, dir_entry->d_name);
-
-        struct stat s;
-        if (stat(full_path, &s) != 0) continue;
-
-        if (ctx.count >= ctx.capacity) {
-            ctx.capacity *= 2;
-            ctx.entries = realloc(ctx.entries, sizeof(struct tree_entry*) * ctx.capacity);
-        }
-
-        struct tree_entry *te = malloc(sizeof(struct tree_entry));
-        te->name = strdup(dir_entry->d_name);
-        int should_add = 0;
+static struct dir_task *dir_task_new(struct tree_walk *walk, struct dir_task *parent, struct tree_entry *slot,
+                                     const char *path, const char *rel_path) {
+    struct arena *arena = arena_create(DIR_ARENA_SIZE);
+    if (!arena) return NULL;
+    struct dir_task *dir = arena_calloc(arena, sizeof(struct dir_task));
+    dir->arena = arena;
+    dir->path = arena_strdup(arena, path);
+    dir->fd = -1;
+    dir->rel_path = arena_strdup(arena, rel_path);
+    dir->walk = walk;
+    dir->parent = parent;
+    dir->slot = slot;
+    dir->capacity = 16;
+    dir->entries = arena_alloc(arena, sizeof(struct tree_entry*) * dir->capacity);
+    dir->pending = 1; // Released when the scan finishes
+    dir->clean = walk->index != NULL;
+    dir->sparse = SPARSE_RECURSIVE;
+    if (parent) {
+        dir->ignore_chain = parent->ignore_chain;
+        dir->rescan = parent->rescan;
+    }
+    return dir;
+}
 
-        if (S_ISDIR(s.st_mode)) {
-            strcpy(te->mode, "040000");
-            char sub_hex[41];
-            if (write_tree_recursive(pool, full_path, sub_hex, te->sha1) == 0) {
-                should_add = 1;
-            } else {
-                free(te->name); free(te);
-            }
-        } else {
-            // File: Always hash the live content from disk (Commit All Logic)
-            strcpy(te->mode, "100644");
-            
-            if (pool) {
-                struct worker_args *args = malloc(sizeof(struct worker_args));
-                args->filepath = strdup(full_path); args->entry = te; args->ctx = &ctx;
-                pthread_mutex_lock(&ctx.lock); ctx.tasks_remaining++; pthread_mutex_unlock(&ctx.lock);
-                threadpool_add(pool, process_file_task, args);
-                should_add = 1;
-            } else {
-                size_t sz; char *c = read_file_to_buffer(full_path, &sz);
-                if (c) {
-                    write_object(c, sz, "blob", NULL, te->sha1);
-                    free(c); should_add = 1;
-                } else {
-                    free(te->name); free(te);
-                }
-            }
-        }
+// Builds (or reuses) the tree of a directory whose tasks have all finished.
+// Returns 0 with the SHA in 'out_sha1', 1 if the directory is empty, -1 on failure.
+static int finish_tree(struct dir_task *dir, unsigned char *out_sha1, int *out_reused) {
+    struct index *index = dir->walk->index;
+    int hash_only = dir->walk->hash_only;
+    *out_reused = 0;
+    if (dir->unreadable) return -1;
 
-        if (should_add) ctx.entries[ctx.count++] = te;
+    // A directory missing a path must never be recorded as this
+    // directory's tree; the flag covers the whole subtree, as children pass
+    // it up before their parent finishes.
+    int failed = __atomic_load_n(&dir->error_occurred, __ATOMIC_ACQUIRE);
+    int kept = 0;
+    int clean = dir->clean && !failed;
+    for (int i = 0; i < dir->count; i++) {
+        struct tree_entry *e = dir->entries[i];
+        if (e->skip) continue;
+        if (strcmp(e->mode, "040000") == 0 && !e->reused) clean = 0;
+        dir->entries[kept++] = e;
     }
-    closedir(d);
+    dir->count = kept;
+    if (dir->count == 0) return 1;
 
-    pthread_mutex_lock(&ctx.lock);
-    while (ctx.tasks_remaining > 0) pthread_cond_wait(&ctx.done, &ctx.lock);
-    pthread_mutex_unlock(&ctx.lock);
-
-    if (ctx.count == 0) {
-        free(ctx.entries); return 1;
+    // Nothing beneath this directory changed: reuse its tree from the
+    // cache-tree instead of serializing, hashing and storing it again. A
+    // tree recorded by a hash-only walk is only reused for writing once the
+    // object turns out to exist (its subtrees were stored before it).
+    int stored;
+    if (clean && cache_tree_lookup(index, dir->rel_path, dir->count, out_sha1, &stored) &&
+        (stored || hash_only || (stored = has_object(out_sha1)))) {
+        cache_tree_add(index, dir->rel_path, dir->count, out_sha1, stored);
+        __atomic_fetch_add(&index->trees_reused, 1, __ATOMIC_RELAXED);
+        *out_reused = 1;
+        return 0;
     }
-    
-    qsort(ctx.entries, ctx.count, sizeof(struct tree_entry*), compare_entries);
+
+    qsort(dir->entries, dir->count, sizeof(struct tree_entry*), compare_entries);
     size_t total_size = 0;
-    for (int i = 0; i < ctx.count; i++) 
-        total_size += strlen(ctx.entries[i]->mode) + 1 + strlen(ctx.entries[i]->name) + 1 + SHA_DIGEST_LENGTH;
+    for (int i = 0; i < dir->count; i++) 
+        total_size += strlen(dir->entries[i]->mode) + 1 + strlen(dir->entries[i]->name) + 1 + SHA_DIGEST_LENGTH;
 
-    char *buffer = malloc(total_size);
+    char *buffer = arena_alloc(dir->arena, total_size);
+    if (!buffer) return -1;
     char *ptr = buffer;
-    for (int i = 0; i < ctx.count; i++) {
-        struct tree_entry *e = ctx.entries[i];
+    for (int i = 0; i < dir->count; i++) {
+        struct tree_entry *e = dir->entries[i];
         ptr += sprintf(ptr, "%s %s", e->mode, e->name) + 1;
         memcpy(ptr, e->sha1, SHA_DIGEST_LENGTH);
         ptr += SHA_DIGEST_LENGTH;
-        free(e->name); free(e);
     }
-    write_object(buffer, total_size, "tree", out_sha1_hex, out_sha1_binary);
-    free(buffer); free(ctx.entries);
-    
+    int result = hash_only ? hash_object(buffer, total_size, "tree", out_sha1)
+                           : write_object(buffer, total_size, "tree", NULL, out_sha1);
+    if (result != 0) return -1;
+
+    if (index) {
+        __atomic_fetch_add(&index->trees_rebuilt, 1, __ATOMIC_RELAXED);
+        if (!failed) cache_tree_add(index, dir->rel_path, dir->count, out_sha1, !hash_only);
+    }
     return 0;
 }
+
+// Hands a finished directory's tree to its parent (or to the walk, for the root).
+static void finish_dir(struct dir_task *dir) {
+    unsigned char sha1[SHA_DIGEST_LENGTH];
+    int reused;
+    int result = finish_tree(dir, sha1, &reused);
+
+    if (dir->parent) {
+        if (result == 0) {
+            memcpy(dir->slot->sha1, sha1, SHA_DIGEST_LENGTH);
+            dir->slot->reused = reused;
+        } else {
+            dir->slot->skip = 1;
+        }
+        // Empty and unreadable directories are left out on purpose; a tree
+        // that could not be built is a failure of every ancestor.
+        if (dir->error_occurred || (result == -1 && !dir->unreadable))
+            __atomic_store_n(&dir->parent->error_occurred, 1, __ATOMIC_RELAXED);
+    } else {
+        // Read by build_tree once the group has drained. A root tree
+        // missing paths is never handed out.
+        dir->walk->result = dir->error_occurred ? -1 : result;
+        memcpy(dir->walk->sha1, sha1, SHA_DIGEST_LENGTH);
+    }
+
+    ignore_free(dir->ignore);
+    arena_destroy(dir->arena);
+}
+
+// Drops one pending task; whoever finishes a directory's last task builds
+// its tree, which may in turn finish the parent.
+static void dir_task_release(struct dir_task *dir) {
+    while (dir && __atomic_sub_fetch(&dir->pending, 1, __ATOMIC_ACQ_REL) == 0) {
+        struct dir_task *parent = dir->parent;
+        finish_dir(dir);
+        dir = parent;
+    }
+}
+
+// A directory the monitor reports untouched keeps its tree and everything
+// below it from the previous index. Like finish_tree, a tree only hashed
+// by status is reused for writing once the object turns out to exist.
+static int keep_unchanged_dir(struct tree_walk *walk, const char *rel_path, unsigned char *out_sha1) {
+    if (!walk->changes || fsmonitor_is_dirty(walk->changes, rel_path)) return 0;
+    int stored;
+    if (!cache_tree_peek(walk->index, rel_path, out_sha1, &stored)) return 0;
+    if (!stored && !walk->hash_only && !(stored = has_object(out_sha1))) return 0;
+    if (index_keep_dir(walk->index, rel_path, stored) < 0) return 0;
+    __atomic_fetch_add(&walk->index->trees_reused, 1, __ATOMIC_RELAXED);
+    return 1;
+}
+
+// --- Sparse Checkout ---
+// Only directories on the path to a cone directory (SPARSE_PARENT) need
+// their HEAD tree: it supplies the subdirectories outside the cone.
+
+struct base_child {
+    const char *name;           // Points into the tree's view
+    const unsigned char *sha1;
+    int is_dir;
+    int seen;                   // Present on disk
+};
+
+static struct base_child *load_base_children(struct arena *arena, const unsigned char *sha1,
+                                             struct object_view **out_tree, int *out_count) {
+    char hex[41];
+    sha1_bin_to_hex(sha1, hex);
+    struct object_view *tree = object_view_open(hex);
+    *out_count = 0;
+    *out_tree = tree;
+    struct tree_iter it;
+    if (!tree || tree_iter_init(&it, tree) != 0) return NULL;
+
+    int capacity = 16;
+    struct base_child *children = arena_alloc(arena, sizeof(struct base_child) * capacity);
+    struct tree_entry_view e;
+    while (children && tree_iter_next(&it, &e) == 1) {
+        if (*out_count >= capacity) {
+            struct base_child *grown = arena_grow(arena, children, sizeof(struct base_child) * capacity,
+                                                  sizeof(struct base_child) * capacity * 2);
+            if (!grown) break;
+            capacity *= 2;
+            children = grown;
+        }
+        struct base_child *c = &children[(*out_count)++];
+        c->name = e.name.ptr;
+        c->sha1 = e.sha1;
+        c->is_dir = e.is_dir;
+        c->seen = 0;
+    }
+    return children;
+}
+
+// Tree entries are sorted by name, so the HEAD listing is binary searched.
+static struct base_child *find_base_child(struct base_child *children, int count, const char *name) {
+    int lo = 0, hi = count - 1;
+    while (lo <= hi) {
+        int mid = lo + (hi - lo) / 2;
+        int cmp = strcmp(name, children[mid].name);
+        if (cmp == 0) return &children[mid];
+        if (cmp < 0) hi = mid - 1;
+        else lo = mid + 1;
+    }
+    return NULL;
+}
+
+static struct tree_entry *dir_add_entry(struct dir_task *dir, const char *name) {
+    if (dir->count >= dir->capacity) {
+        dir->entries = arena_grow(dir->arena, dir->entries, sizeof(struct tree_entry*) * dir->capacity,
+                                  sizeof(struct tree_entry*) * dir->capacity * 2);
+        dir->capacity *= 2;
+    }
+    struct tree_entry *te = arena_calloc(dir->arena, sizeof(struct tree_entry));
+    te->name = arena_strdup(dir->arena, name);
+    dir->entries[dir->count++] = te;
+    return te;
+}
+
+// 'dir_fd' is the parent's open directory (or -1); the child is opened
+// relative to it while the parent's scan still holds it.
+static void submit_dir(struct dir_task *dir, int dir_fd, struct tree_entry *te, const char *name,
+                       const char *rel_path, int sparse, const struct base_child *base) {
+    strcpy(te->mode, "040000");
+    char full_path[1024];
+    snprintf(full_path, sizeof(full_path), "%s/%s", dir->path, name);
+    struct dir_task *child = dir_task_new(dir->walk, dir, te, full_path, rel_path);
+    if (!child) {
+        te->skip = 1;
+        __atomic_store_n(&dir->error_occurred, 1, __ATOMIC_RELAXED);
+        return;
+    }
+    child->sparse = sparse;
+    if (dir_fd >= 0 && __atomic_add_fetch(&dir->walk->open_dirs, 1, __ATOMIC_RELAXED) <= MAX_QUEUED_DIR_FDS)
+        child->fd = openat(dir_fd, name, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (child->fd < 0 && dir_fd >= 0) __atomic_sub_fetch(&dir->walk->open_dirs, 1, __ATOMIC_RELAXED);
+    if (base && base->is_dir) {
+        child->has_base = 1;
+        memcpy(child->base_sha1, base->sha1, SHA_DIGEST_LENGTH);
+    }
+    __atomic_add_fetch(&dir->pending, 1, __ATOMIC_RELAXED);
+    if (threadpool_group_submit(dir->walk->group, scan_dir_task, child) != 0) scan_dir_task(child);
+}
+
+// Adds the HEAD subdirectories of a SPARSE_PARENT directory that the disk
+// scan did not cover: those outside the cone are spliced in as they are in
+// HEAD, and partly included ones missing from disk are walked for theirs.
+static void splice_base_dirs(struct dir_task *dir, struct base_child *children, int count) {
+    for (int i = 0; i < count; i++) {
+        struct base_child *c = &children[i];
+        if (!c->is_dir || c->seen) continue;
+
+        char rel_path[1024];
+        if (dir->rel_path[0]) snprintf(rel_path, sizeof(rel_path), "%s/%s", dir->rel_path, c->name);
+        else snprintf(rel_path, sizeof(rel_path), "%s", c->name);
+
+        int state = sparse_match_dir(dir->walk->cone, rel_path);
+        if (state == SPARSE_EXCLUDED) {
+            struct tree_entry *te = dir_add_entry(dir, c->name);
+            strcpy(te->mode, "040000");
+            memcpy(te->sha1, c->sha1, SHA_DIGEST_LENGTH);
+            // Not 'reused': the parent's cached tree may predate a HEAD change.
+        } else if (state == SPARSE_PARENT) {
+            submit_dir(dir, -1, dir_add_entry(dir, c->name), c->name, rel_path, state, c);
+        }
+        // A missing SPARSE_RECURSIVE directory was really deleted.
+    }
+}
+
+// --- Directory Scan Task ---
+// Adds one directory entry: a subdirectory task, a stat cache hit, or a file task.
+static void scan_entry(struct dir_task *dir, int fd, const struct linux_dirent64 *dir_entry,
+                       struct base_child *base, int base_count) {
+    struct tree_walk *walk = dir->walk;
+    struct index *index = walk->index;
+    int parent = walk->cone && dir->sparse == SPARSE_PARENT;
+
+    if (strcmp(dir_entry->d_name, ".") == 0 || 
+        strcmp(dir_entry->d_name, "..") == 0 || 
+        strcmp(dir_entry->d_name, ".minivcs") == 0 ||
+        strcmp(dir_entry->d_name, "version_forge") == 0) return;
+
+    char entry_rel_path[1024];
+    if (dir->rel_path[0]) snprintf(entry_rel_path, sizeof(entry_rel_path), "%s/%s", dir->rel_path, dir_entry->d_name);
+    else snprintf(entry_rel_path, sizeof(entry_rel_path), "%s", dir_entry->d_name);
+
+    // Directories need no stat. Symlinks are followed, as stat() did;
+    // DT_UNKNOWN comes from file systems that do not fill in d_type.
+    struct stat s;
+    int is_dir = dir_entry->d_type == DT_DIR;
+    if (!is_dir) {
+        int flags = dir_entry->d_type == DT_REG ? AT_SYMLINK_NOFOLLOW : 0;
+        if (fstatat(fd, dir_entry->d_name, &s, flags) != 0) return;
+        is_dir = S_ISDIR(s.st_mode);
+    }
+    if (dir->ignore_chain && ignore_match(dir->ignore_chain, entry_rel_path, is_dir)) return;
+
+    if (is_dir) {
+        int state = dir->sparse;
+        struct base_child *bc = NULL;
+        if (parent) {
+            state = sparse_match_dir(walk->cone, entry_rel_path);
+            bc = find_base_child(base, base_count, dir_entry->d_name);
+            if (bc) bc->seen = state != SPARSE_EXCLUDED;
+        }
+        if (state == SPARSE_EXCLUDED) return; // Spliced from HEAD below
+        unsigned char kept_sha1[SHA_DIGEST_LENGTH];
+        if (state == SPARSE_RECURSIVE && !dir->rescan && keep_unchanged_dir(walk, entry_rel_path, kept_sha1)) {
+            struct tree_entry *te = dir_add_entry(dir, dir_entry->d_name);
+            strcpy(te->mode, "040000");
+            memcpy(te->sha1, kept_sha1, SHA_DIGEST_LENGTH);
+            te->reused = 1;
+            return;
+        }
+        submit_dir(dir, fd, dir_add_entry(dir, dir_entry->d_name), dir_entry->d_name, entry_rel_path, state, bc);
+        return;
+    }
+
+    struct tree_entry *te = dir_add_entry(dir, dir_entry->d_name);
+
+    // File: hash the live content from disk unless the stat cache
+    // proves it is unchanged since we last hashed it.
+    strcpy(te->mode, "100644");
+    // A blob only hashed by status is written now, unless it is already stored.
+    struct index_entry cached;
+    if (index_lookup(index, entry_rel_path, &s, &cached)) {
+        uint16_t flags = cached.flags & INDEX_ENTRY_STORED;
+        if (!flags && !walk->hash_only && has_object(cached.sha1)) flags = INDEX_ENTRY_STORED;
+        if (flags || walk->hash_only) {
+            memcpy(te->sha1, cached.sha1, SHA_DIGEST_LENGTH);
+            index_add(index, entry_rel_path, &s, te->sha1, flags);
+            __atomic_fetch_add(&index->hits, 1, __ATOMIC_RELAXED);
+            return;
+        }
+    }
+    // Counted here rather than in index_lookup(): a match whose blob still
+    // has to be written is read and stored like any other miss.
+    if (index) __atomic_fetch_add(&index->misses, 1, __ATOMIC_RELAXED);
+
+    // Only misses need the full path: the file task outlives this fd.
+    char full_path[1024];
+    snprintf(full_path, sizeof(full_path), "%s/%s", dir->path, dir_entry->d_name);
+    dir->clean = 0;
+    struct worker_args *args = arena_alloc(dir->arena, sizeof(struct worker_args));
+    args->filepath = arena_strdup(dir->arena, full_path); args->entry = te; args->dir = dir;
+    args->index_path = arena_strdup(dir->arena, entry_rel_path); args->st = s; args->index = index;
+    __atomic_add_fetch(&dir->pending, 1, __ATOMIC_RELAXED);
+    if (walk->blobs && s.st_size < STREAM_THRESHOLD &&
+        blob_pipeline_submit(walk->blobs, full_path, s.st_size, blob_stored, args) == 0) return;
+    if (threadpool_group_submit(walk->group, process_file_task, args) != 0) process_file_task(args);
+}
+
+static void scan_dir_task(void *arg) {
+    struct dir_task *dir = (struct dir_task *)arg;
+    struct tree_walk *walk = dir->walk;
+
+    struct object_view *base_tree = NULL;
+    struct base_child *base = NULL;
+    int base_count = 0;
+    int parent = walk->cone && dir->sparse == SPARSE_PARENT;
+    if (parent && dir->has_base) base = load_base_children(dir->arena, dir->base_sha1, &base_tree, &base_count);
+
+    int fd = dir->fd;
+    if (fd >= 0) __atomic_sub_fetch(&walk->open_dirs, 1, __ATOMIC_RELAXED);
+    else fd = open(dir->path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    // The whole listing is read before any entry is handled, so the
+    // .vfignore that applies to them is known without probing for it.
+    size_t capacity = DIRENT_BUFFER_SIZE, size = 0;
+    char *buffer = fd >= 0 ? malloc(capacity) : NULL;
+    long nread = 0;
+    while (buffer && (nread = syscall(SYS_getdents64, fd, buffer + size, capacity - size)) > 0) {
+        size += nread;
+        if (capacity - size >= DIRENT_MIN_SPACE) continue;
+        char *grown = realloc(buffer, capacity * 2);
+        if (!grown) { nread = -1; break; }
+        buffer = grown;
+        capacity *= 2;
+    }
+    if (!buffer || nread < 0) {
+        // A directory on the way to the cone may be absent from disk.
+        if (parent && fd < 0 && errno == ENOENT) splice_base_dirs(dir, base, base_count);
+        else dir->unreadable = 1;
+        free(buffer);
+        if (fd >= 0) close(fd);
+        object_view_release(base_tree);
+        dir_task_release(dir);
+        return;
+    }
+
+    // Its own rules come first; the subdirectories inherit them.
+    for (size_t offset = 0; offset < size;) {
+        struct linux_dirent64 *dir_entry = (struct linux_dirent64 *)(buffer + offset);
+        offset += dir_entry->d_reclen;
+        if (dir_entry->d_type != DT_DIR && strcmp(dir_entry->d_name, IGNORE_FILE) == 0) {
+            dir->ignore = ignore_load(fd, dir->rel_path, dir->ignore_chain);
+            break;
+        }
+    }
+    if (dir->ignore) dir->ignore_chain = dir->ignore;
+    if (walk->changes && !dir->rescan) {
+        char ignore_path[1024];
+        if (dir->rel_path[0]) snprintf(ignore_path, sizeof(ignore_path), "%s/%s", dir->rel_path, IGNORE_FILE);
+        else snprintf(ignore_path, sizeof(ignore_path), "%s", IGNORE_FILE);
+        dir->rescan = fsmonitor_is_dirty(walk->changes, ignore_path);
+    }
+
+    for (size_t offset = 0; offset < size && !shutdown_requested;) {
+        struct linux_dirent64 *dir_entry = (struct linux_dirent64 *)(buffer + offset);
+        offset += dir_entry->d_reclen;
+        scan_entry(dir, fd, dir_entry, base, base_count);
+    }
+    if (shutdown_requested) __atomic_store_n(&dir->error_occurred, 1, __ATOMIC_RELAXED);
+    free(buffer);
+    close(fd);
+
+    if (parent) splice_base_dirs(dir, base, base_count);
+    object_view_release(base_tree);
+    dir_task_release(dir);
+}
+
+// The tree of the commit HEAD points at; -1 if there is none yet.
+static int head_tree_hash(char *out_tree_hash) {
+    char ref_path[256];
+    char commit_hash[41];
+    if (resolve_ref("HEAD", ref_path) != 0 || read_ref(ref_path, commit_hash) != 0) return -1;
+    struct object_view *commit = object_view_open(commit_hash);
+    if (!commit) return -1;
+    struct commit_view cv;
+    int result = commit_view_parse(commit, &cv);
+    if (result == 0) object_slice_copy(cv.tree, out_tree_hash, 41);
+    object_view_release(commit);
+    return result;
+}
+
+static int build_tree(threadpool_t *pool, struct index *index, const char *path, int hash_only,
+                      char *out_sha1_hex, unsigned char *out_sha1_binary) {
+    struct tree_walk walk;
+    memset(&walk, 0, sizeof(walk));
+    walk.index = index;
+    walk.hash_only = hash_only;
+    walk.group = threadpool_group_create(pool);
+    if (!walk.group) return -1;
+
+    int worktree = strcmp(path, ".") == 0;
+    if (worktree) walk.cone = sparse_load(SPARSE_APPLIED_FILE);
+    struct fsmonitor_changes *changes = NULL;
+    if (worktree && index) {
+        // The new token is taken before the walk, so anything changed
+        // while it runs is reported again next time.
+        changes = fsmonitor_query(index->fsmonitor_token);
+        index_set_fsmonitor_token(index, changes ? changes->token : NULL);
+        if (changes && !changes->full_scan) {
+            walk.changes = changes;
+            index->fsmonitor_dirty = changes->count;
+        }
+    }
+
+    if (walk.changes && !walk.cone && keep_unchanged_dir(&walk, "", walk.sha1)) {
+        walk.result = 0; // Nothing changed anywhere
+    } else {
+        // The caller helps run the walk's tasks until all of them are done,
+        // then waits for the files still in the pipeline.
+        if (!hash_only) walk.blobs = blob_pipeline_start();
+        struct dir_task *root = dir_task_new(&walk, NULL, NULL, path, "");
+        walk.result = -1; // Until the root is finished
+        if (root && walk.cone) {
+            root->sparse = sparse_match_dir(walk.cone, "");
+            char head_tree[41];
+            if (head_tree_hash(head_tree) == 0 && sha1_hex_to_bin(head_tree, root->base_sha1) == 0)
+                root->has_base = 1;
+        }
+        if (root && threadpool_group_submit(walk.group, scan_dir_task, root) != 0) scan_dir_task(root);
+        threadpool_group_wait(walk.group);
+        blob_pipeline_finish(walk.blobs);
+    }
+    threadpool_group_destroy(walk.group);
+    sparse_free(walk.cone);
+    fsmonitor_free(changes);
+
+    if (walk.result == 0) {
+        if (out_sha1_hex) sha1_bin_to_hex(walk.sha1, out_sha1_hex);
+        if (out_sha1_binary) memcpy(out_sha1_binary, walk.sha1, SHA_DIGEST_LENGTH);
+    }
+    return walk.result;
+}
+
+int write_tree_indexed(threadpool_t *pool, struct index *index, const char *path,
+                       char *out_sha1_hex, unsigned char *out_sha1_binary) {
+    return build_tree(pool, index, path, 0, out_sha1_hex, out_sha1_binary);
+}
+
+int hash_tree_indexed(threadpool_t *pool, struct index *index, const char *path,
+                      char *out_sha1_hex, unsigned char *out_sha1_binary) {
+    return build_tree(pool, index, path, 1, out_sha1_hex, out_sha1_binary);
+}
+
+int write_tree_recursive(threadpool_t *pool, const char *path, char *out_sha1_hex, unsigned char *out_sha1_binary) {
+    return write_tree_indexed(pool, NULL, path, out_sha1_hex, out_sha1_binary);
+}
@@ -0,0 +1,166 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#include "uring.h"
+
+#ifdef VF_HAVE_IO_URING
+
+struct uring {
+    int fd;
+    unsigned sq_entries;
+    unsigned *sq_head;              // Shared with the kernel
+    unsigned *sq_tail;
+    unsigned *sq_mask;
+    unsigned *sq_array;
+    unsigned sq_queued;             // Our tail; published by uring_submit()
+    unsigned sq_submitted;          // Entries the kernel has consumed
+    struct io_uring_sqe *sqes;
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned *cq_mask;
+    struct io_uring_cqe *cqes;
+    void *sq_map;
+    size_t sq_map_size;
+    void *cq_map;                   // Same as sq_map with IORING_FEAT_SINGLE_MMAP
+    size_t cq_map_size;
+    size_t sqes_size;
+    int has_buffers;
+    int broken;                     // A submission fell short; queue nothing more
+};
+
+static int sys_setup(unsigned entries, struct io_uring_params *p) {
+    return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int sys_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags) {
+    return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+static int sys_register(int fd, unsigned opcode, const void *arg, unsigned nr_args) {
+    return (int)syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+static int map_rings(struct uring *r, const struct io_uring_params *p) {
+    r->sq_map_size = p->sq_off.array + p->sq_entries * sizeof(unsigned);
+    r->cq_map_size = p->cq_off.cqes + p->cq_entries * sizeof(struct io_uring_cqe);
+    int single = p->features & IORING_FEAT_SINGLE_MMAP;
+    if (single && r->cq_map_size > r->sq_map_size) r->sq_map_size = r->cq_map_size;
+
+    r->sq_map = mmap(NULL, r->sq_map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQ_RING);
+    if (r->sq_map == MAP_FAILED) return -1;
+    r->cq_map = single ? r->sq_map
+                       : mmap(NULL, r->cq_map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_CQ_RING);
+    if (r->cq_map == MAP_FAILED) return -1;
+    r->sqes_size = p->sq_entries * sizeof(struct io_uring_sqe);
+    r->sqes = mmap(NULL, r->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQES);
+    if (r->sqes == MAP_FAILED) return -1;
+
+    char *sq = r->sq_map, *cq = r->cq_map;
+    r->sq_entries = p->sq_entries;
+    r->sq_head = (unsigned *)(sq + p->sq_off.head);
+    r->sq_tail = (unsigned *)(sq + p->sq_off.tail);
+    r->sq_mask = (unsigned *)(sq + p->sq_off.ring_mask);
+    r->sq_array = (unsigned *)(sq + p->sq_off.array);
+    r->cq_head = (unsigned *)(cq + p->cq_off.head);
+    r->cq_tail = (unsigned *)(cq + p->cq_off.tail);
+    r->cq_mask = (unsigned *)(cq + p->cq_off.ring_mask);
+    r->cqes = (struct io_uring_cqe *)(cq + p->cq_off.cqes);
+    r->sq_queued = r->sq_submitted = *r->sq_tail;
+    return 0;
+}
+
+struct uring *uring_create(unsigned entries, unsigned files, const struct iovec *buffers, unsigned buffer_count) {
+    const char *env = getenv(URING_ENV);
+    if (env && strcmp(env, "0") == 0) return NULL;
+
+    struct uring *r = calloc(1, sizeof(struct uring));
+    if (!r) return NULL;
+    r->sq_map = r->cq_map = r->sqes = MAP_FAILED;
+
+    // Older kernels reject the newer flags; they only save work, so retry without.
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    p.flags = IORING_SETUP_SUBMIT_ALL | IORING_SETUP_COOP_TASKRUN | IORING_SETUP_SINGLE_ISSUER;
+    r->fd = sys_setup(entries, &p);
+    if (r->fd < 0 && errno == EINVAL) {
+        memset(&p, 0, sizeof(p));
+        r->fd = sys_setup(entries, &p);
+    }
+    if (r->fd < 0 || map_rings(r, &p) != 0) goto fail;
+
+    struct io_uring_rsrc_register reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.nr = files;
+    reg.flags = IORING_RSRC_REGISTER_SPARSE;
+    if (sys_register(r->fd, IORING_REGISTER_FILES2, &reg, sizeof(reg)) != 0) goto fail;
+    if (buffers && buffer_count)
+        r->has_buffers = sys_register(r->fd, IORING_REGISTER_BUFFERS, buffers, buffer_count) == 0;
+    return r;
+
+fail:
+    uring_destroy(r);
+    return NULL;
+}
+
+int uring_has_buffers(const struct uring *r) {
+    return r->has_buffers;
+}
+
+unsigned uring_space(const struct uring *r) {
+    if (r->broken) return 0;
+    return r->sq_entries - (r->sq_queued - __atomic_load_n(r->sq_head, __ATOMIC_ACQUIRE));
+}
+
+struct io_uring_sqe *uring_sqe(struct uring *r) {
+    if (uring_space(r) == 0) return NULL;
+    unsigned index = r->sq_queued & *r->sq_mask;
+    struct io_uring_sqe *sqe = &r->sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    r->sq_array[index] = index;
+    r->sq_queued++;
+    return sqe;
+}
+
+int uring_submit(struct uring *r, unsigned wait_nr) {
+    __atomic_store_n(r->sq_tail, r->sq_queued, __ATOMIC_RELEASE);
+    unsigned to_submit = r->sq_queued - r->sq_submitted;
+    int ret;
+    while ((ret = sys_enter(r->fd, to_submit, wait_nr, wait_nr ? IORING_ENTER_GETEVENTS : 0)) < 0 && errno == EINTR) {}
+    if (ret < 0) ret = 0;
+    r->sq_submitted += ret;
+    // Entries left in the queue would go out with some later submission
+    // and complete under the wrong caller: stop using the ring instead.
+    if ((unsigned)ret < to_submit) r->broken = 1;
+    return ret;
+}
+
+int uring_complete(struct uring *r, int wait, uint64_t *user_data, int *res) {
+    while (1) {
+        unsigned head = *r->cq_head;
+        if (head != __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE)) {
+            struct io_uring_cqe *cqe = &r->cqes[head & *r->cq_mask];
+            *user_data = cqe->user_data;
+            *res = cqe->res;
+            __atomic_store_n(r->cq_head, head + 1, __ATOMIC_RELEASE);
+            return 1;
+        }
+        if (!wait) return 0;
+        if (sys_enter(r->fd, 0, 1, IORING_ENTER_GETEVENTS) < 0 && errno != EINTR) return -errno;
+    }
+}
+
+void uring_destroy(struct uring *r) {
+    if (!r) return;
+    if (r->sqes != MAP_FAILED) munmap(r->sqes, r->sqes_size);
+    if (r->cq_map != MAP_FAILED && r->cq_map != r->sq_map) munmap(r->cq_map, r->cq_map_size);
+    if (r->sq_map != MAP_FAILED) munmap(r->sq_map, r->sq_map_size);
+    if (r->fd >= 0) close(r->fd);
+    free(r);
+}
+
+#endif // VF_HAVE_IO_URING
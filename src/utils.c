@@ -74,10 +74,12 @@ int read_ref(const char *ref_path, char *out_sha1_hex) {
     }
     
     if (strncmp(content, "ref: ", 5) == 0) {
-        // This is a ref-to-ref (like HEAD -> refs/heads/main), so read again
-        char *new_ref = content + 5;
-        char *newline = strchr(new_ref, '\n');
+        // This is a ref-to-ref (like HEAD -> refs/heads/main), so read again.
+        // The target is copied out first: it points into 'content'.
+        char new_ref[256];
+        char *newline = strchr(content + 5, '\n');
         if (newline) *newline = '\0';
+        snprintf(new_ref, sizeof(new_ref), "%s", content + 5);
         free(content);
         return read_ref(new_ref, out_sha1_hex);
     }
@@ -110,3 +112,50 @@ void sha1_bin_to_hex(const unsigned char *sha1, char *hex_out) {
     }
     hex_out[40] = '\0';
 }
+
+static int hex_digit(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+int sha1_hex_to_bin(const char *hex, unsigned char *sha1_out) {
+    for (int i = 0; i < SHA_DIGEST_LENGTH; i++) {
+        int hi = hex_digit(hex[i * 2]);
+        int lo = hi < 0 ? -1 : hex_digit(hex[i * 2 + 1]);
+        if (lo < 0) return -1;
+        sha1_out[i] = (unsigned char)((hi << 4) | lo);
+    }
+    return 0;
+}
+
+uint16_t get_be16(const unsigned char *p) {
+    return (uint16_t)((p[0] << 8) | p[1]);
+}
+
+uint32_t get_be32(const unsigned char *p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) |
+           ((uint32_t)p[2] << 8) | (uint32_t)p[3];
+}
+
+uint64_t get_be64(const unsigned char *p) {
+    return ((uint64_t)get_be32(p) << 32) | get_be32(p + 4);
+}
+
+void put_be16(unsigned char *p, uint16_t v) {
+    p[0] = v >> 8;
+    p[1] = v & 0xff;
+}
+
+void put_be32(unsigned char *p, uint32_t v) {
+    p[0] = v >> 24;
+    p[1] = (v >> 16) & 0xff;
+    p[2] = (v >> 8) & 0xff;
+    p[3] = v & 0xff;
+}
+
+void put_be64(unsigned char *p, uint64_t v) {
+    put_be32(p, (uint32_t)(v >> 32));
+    put_be32(p + 4, (uint32_t)v);
+}
@@ -0,0 +1,205 @@
+#define _GNU_SOURCE // For sched_getaffinity and CPU_COUNT
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <limits.h> // For PATH_MAX
+
+#include "worker_pool.h"
+#include "config.h"
+
+#define WORKER_POOL_MAX_THREADS 64      // threadpool_create's limit
+#define WORKER_POOL_QUEUE_SIZE 1024     // Per-worker deque and inject queue slots
+
+static threadpool_t *worker_pool;
+static int worker_count;
+static pthread_once_t worker_pool_once = PTHREAD_ONCE_INIT;
+
+// Parses a positive thread count; returns 0 if 'value' is not one.
+static int parse_thread_count(const char *value) {
+    char *end;
+    long n = strtol(value, &end, 10);
+    if (end == value || *end != '\0' || n <= 0) return 0;
+    return n > WORKER_POOL_MAX_THREADS ? WORKER_POOL_MAX_THREADS : (int)n;
+}
+
+// CPUs allowed by the quota in one cgroup directory, rounded up, or 0 if it
+// sets none (the root cgroup has no quota files at all).
+static int cgroup_dir_limit(int version, const char *dir) {
+    char file[PATH_MAX];
+    long long quota = 0, period = 0;
+    FILE *f;
+    if (version == 2) {
+        // "max 100000" or "<quota> <period>"
+        snprintf(file, sizeof(file), "%s/cpu.max", dir);
+        if ((f = fopen(file, "r"))) {
+            char max[32];
+            if (fscanf(f, "%31s %lld", max, &period) == 2 && strcmp(max, "max") != 0) quota = atoll(max);
+            fclose(f);
+        }
+    } else {
+        // The quota is -1 when unlimited
+        snprintf(file, sizeof(file), "%s/cpu.cfs_quota_us", dir);
+        if ((f = fopen(file, "r"))) {
+            if (fscanf(f, "%lld", &quota) != 1) quota = 0;
+            fclose(f);
+        }
+        snprintf(file, sizeof(file), "%s/cpu.cfs_period_us", dir);
+        if ((f = fopen(file, "r"))) {
+            if (fscanf(f, "%lld", &period) != 1) period = 0;
+            fclose(f);
+        }
+    }
+    if (quota <= 0 || period <= 0) return 0;
+    return (int)((quota + period - 1) / period);
+}
+
+// The process's own cgroup from /proc/self/cgroup: the v1 line whose
+// controllers include "cpu" (it is the one enforced on hybrid systems), else
+// the v2 "0::<path>" line. Returns the version, or 0 if there is neither.
+static int own_cgroup(char *path, size_t size) {
+    FILE *f = fopen("/proc/self/cgroup", "r");
+    if (!f) return 0;
+    char line[PATH_MAX + 256];
+    int version = 0;
+    while (version != 1 && fgets(line, sizeof(line), f)) {
+        line[strcspn(line, "\n")] = '\0';
+        char *controllers = strchr(line, ':');
+        char *cgroup = controllers ? strchr(controllers + 1, ':') : NULL;
+        if (!cgroup) continue;
+        *controllers++ = '\0';
+        *cgroup++ = '\0';
+        if (strcmp(line, "0") == 0 && controllers[0] == '\0') {
+            snprintf(path, size, "%s", cgroup);
+            version = 2;
+            continue;
+        }
+        char *save;
+        for (char *c = strtok_r(controllers, ",", &save); c; c = strtok_r(NULL, ",", &save)) {
+            if (strcmp(c, "cpu") == 0) {
+                snprintf(path, size, "%s", cgroup);
+                version = 1;
+                break;
+            }
+        }
+    }
+    fclose(f);
+    return version;
+}
+
+// Where the hierarchy is mounted, from /proc/self/mountinfo, and which
+// cgroup is the root of that mount (not "/" inside a container that has
+// its own mount but no cgroup namespace).
+static int cgroup_mount(int version, char *mount_point, char *mount_root) {
+    FILE *f = fopen("/proc/self/mountinfo", "r");
+    if (!f) return -1;
+    char line[2 * PATH_MAX + 512];
+    int found = -1;
+    while (found != 0 && fgets(line, sizeof(line), f)) {
+        // "<id> <parent> <dev> <root> <mount point> <options...> - <type> <source> <super options>"
+        char root[PATH_MAX], point[PATH_MAX], type[32], super_options[256];
+        char *dash = strstr(line, " - ");
+        if (!dash || sscanf(line, "%*s %*s %*s %4095s %4095s", root, point) != 2 ||
+            sscanf(dash + 3, "%31s %*s %255s", type, super_options) != 2) continue;
+        if (version == 2) {
+            if (strcmp(type, "cgroup2") != 0) continue;
+        } else {
+            if (strcmp(type, "cgroup") != 0) continue;
+            int has_cpu = 0;
+            char *save;
+            for (char *o = strtok_r(super_options, ",", &save); o; o = strtok_r(NULL, ",", &save)) {
+                if (strcmp(o, "cpu") == 0) has_cpu = 1;
+            }
+            if (!has_cpu) continue;
+        }
+        strcpy(mount_point, point);
+        strcpy(mount_root, root);
+        found = 0;
+    }
+    fclose(f);
+    return found;
+}
+
+// CPUs allowed by the cgroup quotas that apply to this process, rounded up,
+// or 0 if there is none. A quota on any ancestor (a systemd slice, say)
+// limits us too, so the tightest one between our cgroup and the mount
+// point wins.
+static int cgroup_cpu_limit() {
+    char cgroup[PATH_MAX], mount_point[PATH_MAX], mount_root[PATH_MAX];
+    int version = own_cgroup(cgroup, sizeof(cgroup));
+    if (!version || cgroup_mount(version, mount_point, mount_root) != 0) return 0;
+
+    // The cgroup path is relative to the hierarchy's root; the mount may
+    // show a subtree of it. Outside of that subtree only the mount point
+    // itself can be read.
+    const char *relative = "";
+    size_t root_len = strcmp(mount_root, "/") == 0 ? 0 : strlen(mount_root);
+    if (strncmp(cgroup, mount_root, root_len) == 0 && (cgroup[root_len] == '/' || cgroup[root_len] == '\0')) {
+        relative = cgroup + root_len;
+    }
+
+    char dir[PATH_MAX];
+    size_t base_len = strlen(mount_point);
+    snprintf(dir, sizeof(dir), "%s%s", mount_point, strcmp(relative, "/") == 0 ? "" : relative);
+    int limit = 0;
+    while (1) {
+        int n = cgroup_dir_limit(version, dir);
+        if (n > 0 && (limit == 0 || n < limit)) limit = n;
+        char *slash = strrchr(dir, '/');
+        if (strlen(dir) <= base_len || !slash || (size_t)(slash - dir) < base_len) break;
+        *slash = '\0';
+    }
+    return limit;
+}
+
+static int detect_cpu_count() {
+    int cpus = 0;
+    cpu_set_t set;
+    if (sched_getaffinity(0, sizeof(set), &set) == 0) cpus = CPU_COUNT(&set);
+    if (cpus <= 0) cpus = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (cpus <= 0) cpus = 1;
+
+    int limit = cgroup_cpu_limit();
+    if (limit > 0 && limit < cpus) cpus = limit;
+    return cpus > WORKER_POOL_MAX_THREADS ? WORKER_POOL_MAX_THREADS : cpus;
+}
+
+static void choose_worker_count() {
+    const char *env = getenv(WORKER_POOL_THREADS_ENV);
+    if (env && (worker_count = parse_thread_count(env)) > 0) return;
+    if (env) fprintf(stderr, "Warning: ignoring invalid %s=%s\n", WORKER_POOL_THREADS_ENV, env);
+
+    char value[64];
+    if (get_config_value(WORKER_POOL_THREADS_KEY, value, sizeof(value)) == 0) {
+        if ((worker_count = parse_thread_count(value)) > 0) return;
+        fprintf(stderr, "Warning: ignoring invalid %s=%s\n", WORKER_POOL_THREADS_KEY, value);
+    }
+    worker_count = detect_cpu_count();
+}
+
+static void stop_worker_pool() {
+    threadpool_destroy(worker_pool);
+    worker_pool = NULL;
+}
+
+static void start_worker_pool() {
+    choose_worker_count();
+    worker_pool = threadpool_create(worker_count, WORKER_POOL_QUEUE_SIZE);
+    if (!worker_pool) {
+        fprintf(stderr, "Warning: could not start %d worker threads; running serially.\n", worker_count);
+        return;
+    }
+    atexit(stop_worker_pool);
+}
+
+threadpool_t *get_worker_pool() {
+    pthread_once(&worker_pool_once, start_worker_pool);
+    return worker_pool;
+}
+
+int worker_pool_size() {
+    pthread_once(&worker_pool_once, start_worker_pool);
+    return worker_pool ? worker_count : 1;
+}